@@ -693,10 +693,32 @@ static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
 	return ack;
 }
 
+/*
+ * Without wmediumd every frame goes out once, at the first rate. Legacy
+ * rates are timed like mac80211 does; for MCS rates, which there's no
+ * helper for, mac80211 is left to estimate the airtime.
+ */
+static u16 mac80211_hwsim_tx_time(struct ieee80211_hw *hw, struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_rate *rate;
+
+	if (info->control.rates[0].flags & IEEE80211_TX_RC_MCS)
+		return 0;
+
+	rate = ieee80211_get_tx_rate(hw, info);
+	if (!rate)
+		return 0;
+
+	return le16_to_cpu(ieee80211_generic_frame_duration(hw,
+				info->control.vif, skb->len, rate));
+}
+
 static void mac80211_hwsim_tx(struct ieee80211_hw *hw, struct sk_buff *skb)
 {
 	bool ack;
 	struct ieee80211_tx_info *txi;
+	u16 tx_time;
 	u32 _pid;
 	struct ieee80211_mgmt *mgmt = (struct ieee80211_mgmt *) skb->data;
 	struct mac80211_hwsim_data *data = hw->priv;
@@ -734,7 +756,11 @@ static void mac80211_hwsim_tx(struct ieee80211_hw *hw, struct sk_buff *skb)
 	if (txi->control.sta)
 		hwsim_check_sta_magic(txi->control.sta);
 
+	/* the status overlaps the control information */
+	tx_time = mac80211_hwsim_tx_time(hw, skb);
+
 	ieee80211_tx_info_clear_status(txi);
+	txi->status.tx_time = tx_time;
 	if (!(txi->flags & IEEE80211_TX_CTL_NO_ACK) && ack)
 		txi->flags |= IEEE80211_TX_STAT_ACK;
 	ieee80211_tx_status_irqsafe(hw, skb);
@@ -1789,7 +1815,9 @@ static int __init init_mac80211_hwsim(void)
 			    IEEE80211_HW_SIGNAL_DBM |
 			    IEEE80211_HW_SUPPORTS_STATIC_SMPS |
 			    IEEE80211_HW_SUPPORTS_DYNAMIC_SMPS |
-			    IEEE80211_HW_AMPDU_AGGREGATION;
+			    IEEE80211_HW_AMPDU_AGGREGATION |
+			    IEEE80211_HW_TX_AMSDU |
+			    IEEE80211_HW_REPORTS_TX_AIRTIME;
 
 		hw->wiphy->flags |= WIPHY_FLAG_SUPPORTS_TDLS;
 
@@ -967,6 +967,13 @@ struct ieee80211_ht_cap {
 #define IEEE80211_HT_CAP_40MHZ_INTOLERANT	0x4000
 #define IEEE80211_HT_CAP_LSIG_TXOP_PROT		0x8000
 
+/* maximum A-MSDU length, selected by IEEE80211_HT_CAP_MAX_AMSDU */
+#define IEEE80211_MAX_AMSDU_LEN_HT_3839		3839
+#define IEEE80211_MAX_AMSDU_LEN_HT_7935		7935
+
+/* maximum MPDU length inside an A-MPDU, A-MSDUs included */
+#define IEEE80211_MAX_MPDU_LEN_HT_BA		4095
+
 /* 802.11n HT extended capabilities masks (for extended_ht_cap_info) */
 #define IEEE80211_HT_EXT_CAP_PCO		0x0001
 #define IEEE80211_HT_EXT_CAP_PCO_TIME		0x0006
@@ -1049,6 +1056,7 @@ struct ieee80211_ht_info {
 
 
 /* block-ack parameters */
+#define IEEE80211_ADDBA_PARAM_AMSDU_MASK 0x0001
 #define IEEE80211_ADDBA_PARAM_POLICY_MASK 0x0002
 #define IEEE80211_ADDBA_PARAM_TID_MASK 0x003C
 #define IEEE80211_ADDBA_PARAM_BUF_SIZE_MASK 0xFFC0
@@ -548,6 +548,14 @@
  * @NL80211_CMD_SET_NOACK_MAP: sets a bitmap for the individual TIDs whether
  *      No Acknowledgement Policy should be applied.
  *
+ * @NL80211_CMD_FRAME_BATCH: RX notification carrying several management
+ *	frames for a registration made with %NL80211_ATTR_FRAME_BATCH_SIZE.
+ *	The frames are in %NL80211_ATTR_FRAME_BATCH, each one a nested
+ *	attribute holding %NL80211_ATTR_FRAME, %NL80211_ATTR_WIPHY_FREQ and
+ *	optionally %NL80211_ATTR_RX_SIGNAL_DBM as in %NL80211_CMD_FRAME.
+ *	%NL80211_ATTR_FRAME_BATCH_DROPPED reports the number of frames
+ *	dropped for this registration so far.
+ *
  * @NL80211_CMD_MAX: highest used command number
  * @__NL80211_CMD_AFTER_LAST: internal use
  */
@@ -689,6 +697,8 @@ enum nl80211_commands {
 
 	NL80211_CMD_SET_NOACK_MAP,
 
+	NL80211_CMD_FRAME_BATCH,
+
 	/* add new commands above here */
 
 	/* used to define NL80211_CMD_MAX below */
@@ -1215,6 +1225,31 @@ enum nl80211_commands {
  * @NL80211_ATTR_BG_SCAN_PERIOD: Background scan period in seconds
  *      or 0 to disable background scan.
  *
+ * @NL80211_ATTR_SCAN_SINCE_GENERATION: BSS list generation (u32) given to
+ *	%NL80211_CMD_GET_SCAN to only dump the BSSes that changed after it,
+ *	typically the %NL80211_ATTR_GENERATION seen in the previous dump. If
+ *	BSSes were removed from the list since that generation the full list
+ *	is dumped instead; in a partial dump every message carries this
+ *	attribute back, so its absence tells userspace to replace its cache.
+ * @NL80211_ATTR_SCAN_OMIT_IES: flag given to %NL80211_CMD_GET_SCAN to leave
+ *	out %NL80211_BSS_INFORMATION_ELEMENTS and %NL80211_BSS_BEACON_IES from
+ *	the dump.
+ *
+ * @NL80211_ATTR_FRAME_BATCH_SIZE: maximum number of frames (u32) to
+ *	coalesce into one %NL80211_CMD_FRAME_BATCH message, given to
+ *	%NL80211_CMD_REGISTER_FRAME. Without it, or with a value of 1, each
+ *	frame is sent in its own %NL80211_CMD_FRAME message.
+ * @NL80211_ATTR_FRAME_BATCH_TIMEOUT: maximum time in milliseconds (u32) a
+ *	frame may be held back waiting for the batch to fill up, given to
+ *	%NL80211_CMD_REGISTER_FRAME along with %NL80211_ATTR_FRAME_BATCH_SIZE.
+ * @NL80211_ATTR_FRAME_BATCH: nested list of received frames, see
+ *	%NL80211_CMD_FRAME_BATCH.
+ * @NL80211_ATTR_FRAME_BATCH_DROPPED: number of frames (u32) that matched a
+ *	batched registration but could not be delivered to userspace.
+ *
+ * @NL80211_ATTR_STA_RATE_STATS: flag given to %NL80211_CMD_GET_STATION to
+ *	request %NL80211_STA_INFO_RATE_STATS in the station information.
+ *
  * @NL80211_ATTR_MAX: highest attribute number currently defined
  * @__NL80211_ATTR_AFTER_LAST: internal use
  */
@@ -1466,6 +1501,16 @@ enum nl80211_attrs {
 
 	NL80211_ATTR_BG_SCAN_PERIOD,
 
+	NL80211_ATTR_SCAN_SINCE_GENERATION,
+	NL80211_ATTR_SCAN_OMIT_IES,
+
+	NL80211_ATTR_FRAME_BATCH_SIZE,
+	NL80211_ATTR_FRAME_BATCH_TIMEOUT,
+	NL80211_ATTR_FRAME_BATCH,
+	NL80211_ATTR_FRAME_BATCH_DROPPED,
+
+	NL80211_ATTR_STA_RATE_STATS,
+
 	/* add attributes here, update the policy in nl80211.c */
 
 	__NL80211_ATTR_AFTER_LAST,
@@ -1685,6 +1730,13 @@ enum nl80211_sta_bss_param {
  * @NL80211_STA_INFO_CONNECTED_TIME: time since the station is last connected
  * @NL80211_STA_INFO_STA_FLAGS: Contains a struct nl80211_sta_flag_update.
  * @NL80211_STA_INFO_BEACON_LOSS: count of times beacon loss was detected (u32)
+ * @NL80211_STA_INFO_TX_AIRTIME: total airtime spent transmitting to this
+ *	station (u64, usecs)
+ * @NL80211_STA_INFO_TX_QUEUE_DELAY: average time frames to this station
+ *	spent in the TX queues before being handed to the device (u32, usecs)
+ * @NL80211_STA_INFO_RATE_STATS: binary rate control statistics, a
+ *	&struct nl80211_rate_stats_hdr followed by the per-rate records;
+ *	only included when %NL80211_ATTR_STA_RATE_STATS was requested
  * @__NL80211_STA_INFO_AFTER_LAST: internal
  * @NL80211_STA_INFO_MAX: highest possible station info attribute
  */
@@ -1708,12 +1760,136 @@ enum nl80211_sta_info {
 	NL80211_STA_INFO_CONNECTED_TIME,
 	NL80211_STA_INFO_STA_FLAGS,
 	NL80211_STA_INFO_BEACON_LOSS,
+	NL80211_STA_INFO_TX_AIRTIME,
+	NL80211_STA_INFO_TX_QUEUE_DELAY,
+	NL80211_STA_INFO_RATE_STATS,
 
 	/* keep last */
 	__NL80211_STA_INFO_AFTER_LAST,
 	NL80211_STA_INFO_MAX = __NL80211_STA_INFO_AFTER_LAST - 1
 };
 
+#define NL80211_RATE_STATS_VERSION	1
+
+/**
+ * enum nl80211_rate_stats_algo - rate control algorithm
+ *
+ * @NL80211_RATE_STATS_ALGO_UNSPEC: unknown algorithm
+ * @NL80211_RATE_STATS_ALGO_MINSTREL: minstrel (legacy rates)
+ * @NL80211_RATE_STATS_ALGO_MINSTREL_HT: minstrel_ht
+ * @NL80211_RATE_STATS_ALGO_TRAMS_HT: trams_ht
+ */
+enum nl80211_rate_stats_algo {
+	NL80211_RATE_STATS_ALGO_UNSPEC,
+	NL80211_RATE_STATS_ALGO_MINSTREL,
+	NL80211_RATE_STATS_ALGO_MINSTREL_HT,
+	NL80211_RATE_STATS_ALGO_TRAMS_HT,
+};
+
+/**
+ * enum nl80211_rate_stats_hdr_flags - rate statistics header flags
+ *
+ * @NL80211_RATE_STATS_TRUNCATED: not all rates fit into the record
+ */
+enum nl80211_rate_stats_hdr_flags {
+	NL80211_RATE_STATS_TRUNCATED	= 1<<0,
+};
+
+/**
+ * struct nl80211_rate_stats_hdr - rate control statistics header
+ *
+ * @version: %NL80211_RATE_STATS_VERSION
+ * @algo: the algorithm that produced the statistics,
+ *	see &enum nl80211_rate_stats_algo
+ * @flags: flags from &enum nl80211_rate_stats_hdr_flags
+ * @n_rates: number of per-rate records following the header
+ * @rate_len: size of each per-rate record; later versions may append
+ *	fields to &struct nl80211_rate_stats, so userspace must use this
+ *	to step through the records
+ *
+ * Only rates that have been tried, or are currently selected, are
+ * reported. The records are not necessarily aligned.
+ */
+struct nl80211_rate_stats_hdr {
+	__u8 version;
+	__u8 algo;
+	__u16 flags;
+	__u16 n_rates;
+	__u16 rate_len;
+};
+
+/**
+ * enum nl80211_rate_stats_flags - per-rate statistics flags
+ *
+ * @NL80211_RATE_STATS_MCS: @idx is an MCS index, otherwise it is an index
+ *	into the legacy bitrates of the current band
+ * @NL80211_RATE_STATS_40_MHZ_WIDTH: 40 MHz wide transmission
+ * @NL80211_RATE_STATS_SHORT_GI: short guard interval
+ * @NL80211_RATE_STATS_MAX_TP: currently the best throughput rate
+ * @NL80211_RATE_STATS_MAX_TP2: currently the second best throughput rate
+ * @NL80211_RATE_STATS_MAX_PROB: currently the most reliable rate
+ */
+enum nl80211_rate_stats_flags {
+	NL80211_RATE_STATS_MCS			= 1<<0,
+	NL80211_RATE_STATS_40_MHZ_WIDTH		= 1<<1,
+	NL80211_RATE_STATS_SHORT_GI		= 1<<2,
+	NL80211_RATE_STATS_MAX_TP		= 1<<3,
+	NL80211_RATE_STATS_MAX_TP2		= 1<<4,
+	NL80211_RATE_STATS_MAX_PROB		= 1<<5,
+};
+
+/**
+ * struct nl80211_rate_stats - per-rate statistics
+ *
+ * @flags: flags from &enum nl80211_rate_stats_flags
+ * @idx: MCS or legacy rate index, see %NL80211_RATE_STATS_MCS
+ * @retry_count: number of tries at this rate in a retry chain
+ * @throughput: estimated throughput (kbit/s)
+ * @prob: averaged delivery probability, 65536 is 100%
+ * @cur_prob: delivery probability in the last interval, 65536 is 100%
+ * @attempts: transmission attempts in the last interval
+ * @success: successful transmissions in the last interval
+ * @att_hist: total transmission attempts
+ * @succ_hist: total successful transmissions
+ */
+struct nl80211_rate_stats {
+	__u16 flags;
+	__u8 idx;
+	__u8 retry_count;
+	__u32 throughput;
+	__u32 prob;
+	__u32 cur_prob;
+	__u32 attempts;
+	__u32 success;
+	__u64 att_hist;
+	__u64 succ_hist;
+};
+
+/**
+ * struct nl80211_rate_stats_event - rate control decision event
+ *
+ * Written by mac80211 to the per-CPU rc/events<cpu> relay files in
+ * debugfs whenever the rate control algorithm changes its rate
+ * selection for a station.
+ *
+ * @version: %NL80211_RATE_STATS_VERSION
+ * @algo: see &enum nl80211_rate_stats_algo
+ * @addr: the station's MAC address
+ * @timestamp: time of the decision (CLOCK_MONOTONIC, nsecs)
+ * @max_tp: the new best throughput rate
+ * @max_tp2: the new second best throughput rate
+ * @max_prob: the new most reliable rate
+ */
+struct nl80211_rate_stats_event {
+	__u8 version;
+	__u8 algo;
+	__u8 addr[6];
+	__u64 timestamp;
+	struct nl80211_rate_stats max_tp;
+	struct nl80211_rate_stats max_tp2;
+	struct nl80211_rate_stats max_prob;
+};
+
 /**
  * enum nl80211_mpath_flags - nl80211 mesh path flags
  *
@@ -521,6 +521,9 @@ struct station_parameters {
  * @STATION_INFO_ASSOC_REQ_IES: @assoc_req_ies filled
  * @STATION_INFO_STA_FLAGS: @sta_flags filled
  * @STATION_INFO_BEACON_LOSS_COUNT: @beacon_loss_count filled
+ * @STATION_INFO_TX_AIRTIME: @tx_airtime filled
+ * @STATION_INFO_TX_QUEUE_DELAY: @tx_queue_delay filled
+ * @STATION_INFO_RATE_STATS: @rate_stats filled
  */
 enum station_info_flags {
 	STATION_INFO_INACTIVE_TIME	= 1<<0,
@@ -542,7 +545,10 @@ enum station_info_flags {
 	STATION_INFO_CONNECTED_TIME	= 1<<16,
 	STATION_INFO_ASSOC_REQ_IES	= 1<<17,
 	STATION_INFO_STA_FLAGS		= 1<<18,
-	STATION_INFO_BEACON_LOSS_COUNT	= 1<<19
+	STATION_INFO_BEACON_LOSS_COUNT	= 1<<19,
+	STATION_INFO_TX_AIRTIME		= 1<<20,
+	STATION_INFO_TX_QUEUE_DELAY	= 1<<21,
+	STATION_INFO_RATE_STATS		= 1<<22,
 };
 
 /**
@@ -643,6 +649,14 @@ struct sta_bss_parameters {
  * @assoc_req_ies_len: Length of assoc_req_ies buffer in octets.
  * @sta_flags: station flags mask & values
  * @beacon_loss_count: Number of times beacon loss event has triggered.
+ * @tx_airtime: total airtime (in usecs) used transmitting to this station
+ * @tx_queue_delay: average time (in usecs) frames to this station were
+ *	queued before being passed to the hardware
+ * @rate_stats: buffer provided by the caller for the rate control
+ *	statistics, see &struct nl80211_rate_stats_hdr, or %NULL if they
+ *	aren't wanted
+ * @rate_stats_len: size of the @rate_stats buffer; the driver sets it
+ *	to the length of the statistics it wrote
  */
 struct station_info {
 	u32 filled;
@@ -672,6 +686,12 @@ struct station_info {
 
 	u32 beacon_loss_count;
 
+	u64 tx_airtime;
+	u32 tx_queue_delay;
+
+	void *rate_stats;
+	size_t rate_stats_len;
+
 	/*
 	 * Note: Add a new enum station_info_flags value for each new field and
 	 * use it to check which fields are initialized.
@@ -2460,6 +2480,26 @@ extern int ieee80211_radiotap_iterator_init(
 extern int ieee80211_radiotap_iterator_next(
 	struct ieee80211_radiotap_iterator *iterator);
 
+/* number of fields in the default namespace the layout lookup knows */
+#define IEEE80211_RADIOTAP_LAYOUT_FIELDS	(IEEE80211_RADIOTAP_DATA_RETRIES + 1)
+
+/**
+ * struct ieee80211_radiotap_layout - field offsets of a radiotap header
+ * @present: the (single) present bitmap word of the header
+ * @len: CPU-endian total radiotap header length
+ * @offset: offset of each present field from the start of the header,
+ *	only valid for fields whose bit is set in @present
+ */
+struct ieee80211_radiotap_layout {
+	u32 present;
+	int len;
+	u8 offset[IEEE80211_RADIOTAP_LAYOUT_FIELDS];
+};
+
+extern int ieee80211_radiotap_get_layout(
+	struct ieee80211_radiotap_header *radiotap_header,
+	int max_length, struct ieee80211_radiotap_layout *layout);
+
 
 extern const unsigned char rfc1042_header[6];
 extern const unsigned char bridge_tunnel_header[6];
@@ -2515,7 +2555,9 @@ int ieee80211_data_from_8023(struct sk_buff *skb, const u8 *addr,
  *
  * Decode an IEEE 802.11n A-MSDU frame and convert it to a list of
  * 802.3 frames. The @list will be empty if the decode fails. The
- * @skb is consumed after the function returns.
+ * @skb is consumed after the function returns. The @skb need not be
+ * linear; the payload of the subframes is shared with it, as page
+ * fragments or clones, rather than copied.
  *
  * @skb: The input IEEE 802.11n A-MSDU frame.
  * @list: The output list of 802.3 frames. It must be allocated and
@@ -532,6 +532,10 @@ struct ieee80211_tx_rate {
  * @ampdu_len: number of aggregated frames.
  * 	relevant only if IEEE80211_TX_STAT_AMPDU was set.
  * @ack_signal: signal strength of the ACK frame
+ * @tx_time: airtime (in usecs) the frame, including all retries, used on
+ *	the medium. Only looked at if the driver sets
+ *	%IEEE80211_HW_REPORTS_TX_AIRTIME; if left at zero, or without that
+ *	flag, mac80211 estimates it from the rates that were tried.
  */
 struct ieee80211_tx_info {
 	/* common information */
@@ -564,7 +568,8 @@ struct ieee80211_tx_info {
 			u8 ampdu_ack_len;
 			int ack_signal;
 			u8 ampdu_len;
-			/* 15 bytes free */
+			u16 tx_time;
+			/* 13 bytes free */
 		} status;
 		struct {
 			struct ieee80211_tx_rate driver_rates[
@@ -1174,6 +1179,16 @@ enum sta_notify_cmd {
  * @IEEE80211_HW_SCAN_WHILE_IDLE: The device can do hw scan while
  *	being idle (i.e. mac80211 doesn't have to go idle-off during the
  *	the scan).
+ *
+ * @IEEE80211_HW_TX_AMSDU: The device can transmit A-MSDUs built in
+ *	software. mac80211 will then opportunistically pack MSDUs queued
+ *	back-to-back for the same station and TID into a single A-MSDU,
+ *	but only while a TX BA session is operational on that TID. The
+ *	A-MSDU length is bounded by the peer's advertised maximum.
+ *
+ * @IEEE80211_HW_REPORTS_TX_AIRTIME: The driver fills in, or clears with
+ *	ieee80211_tx_info_clear_status(), the @tx_time of all frames it
+ *	reports the TX status of.
  */
 enum ieee80211_hw_flags {
 	IEEE80211_HW_HAS_RATE_CONTROL			= 1<<0,
@@ -1201,6 +1216,8 @@ enum ieee80211_hw_flags {
 	IEEE80211_HW_AP_LINK_PS				= 1<<22,
 	IEEE80211_HW_TX_AMPDU_SETUP_IN_HW		= 1<<23,
 	IEEE80211_HW_SCAN_WHILE_IDLE			= 1<<24,
+	IEEE80211_HW_TX_AMSDU				= 1<<25,
+	IEEE80211_HW_REPORTS_TX_AIRTIME			= 1<<26,
 };
 
 /**
@@ -1266,6 +1283,10 @@ enum ieee80211_hw_flags {
  * @max_tx_aggregation_subframes: maximum number of subframes in an
  *	aggregate an HT driver will transmit, used by the peer as a
  *	hint to size its reorder buffer.
+ *
+ * @max_tx_ba_sessions: maximum number of TX BlockAck sessions the
+ *	hardware can handle concurrently, 0 if there's no limit. Session
+ *	requests beyond this are refused with -EBUSY.
  */
 struct ieee80211_hw {
 	struct ieee80211_conf conf;
@@ -1286,6 +1307,7 @@ struct ieee80211_hw {
 	u8 max_rate_tries;
 	u8 max_rx_aggregation_subframes;
 	u8 max_tx_aggregation_subframes;
+	u16 max_tx_ba_sessions;
 };
 
 /**
@@ -2125,6 +2147,14 @@ enum ieee80211_frame_release_type {
  *	The @tids parameter is a bitmap and tells the driver which TIDs the
  *	frames will be on; it will at most have two bits set.
  *	This callback must be atomic.
+ *
+ * @wake_tx_queue: Called when new frames were put on mac80211's per-station
+ *	TX queues for the given access category. Implementing this callback
+ *	makes mac80211 queue unicast data frames per station and TID instead
+ *	of passing them to @tx; the driver then pulls them, in airtime fair
+ *	order, with ieee80211_tx_dequeue() whenever it has room in the
+ *	hardware queue of that access category.
+ *	This callback must be atomic.
  */
 struct ieee80211_ops {
 	void (*tx)(struct ieee80211_hw *hw, struct sk_buff *skb);
@@ -2254,6 +2284,7 @@ struct ieee80211_ops {
 					u16 tids, int num_frames,
 					enum ieee80211_frame_release_type reason,
 					bool more_data);
+	void (*wake_tx_queue)(struct ieee80211_hw *hw, u8 ac);
 };
 
 /**
@@ -2874,6 +2905,23 @@ __le16 ieee80211_generic_frame_duration(struct ieee80211_hw *hw,
 struct sk_buff *
 ieee80211_get_buffered_bc(struct ieee80211_hw *hw, struct ieee80211_vif *vif);
 
+/**
+ * ieee80211_tx_dequeue - dequeue a frame from the per-station TX queues
+ * @hw: pointer as obtained from ieee80211_alloc_hw().
+ * @ac: access category to dequeue from
+ *
+ * Drivers implementing the wake_tx_queue() callback use this function to
+ * fetch the next frame to transmit on the given access category. Stations
+ * are served in deficit round-robin order according to the airtime they
+ * used, as reported through ieee80211_tx_status(), so a slow station can't
+ * take more than its share of the medium. The frame has already been
+ * through the TX handlers and can be handed to the hardware directly.
+ *
+ * Returns %NULL if no frames are queued for @ac. Must not be called
+ * from hard interrupt context.
+ */
+struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw, u8 ac);
+
 /**
  * ieee80211_get_tkip_p1k_iv - get a TKIP phase 1 key for IV32
  *
@@ -3588,6 +3636,18 @@ struct rate_control_ops {
 	void (*add_sta_debugfs)(void *priv, void *priv_sta,
 				struct dentry *dir);
 	void (*remove_sta_debugfs)(void *priv, void *priv_sta);
+
+	/* fill in a struct nl80211_rate_stats_hdr blob, returns its length */
+	size_t (*get_rate_stats)(void *priv, void *priv_sta,
+				 void *buf, size_t len);
+
+	/*
+	 * seed a freshly initialized station from the rate statistics
+	 * another algorithm gathered for it, see get_rate_stats
+	 */
+	void (*migrate_sta)(void *priv, void *priv_sta,
+			    struct ieee80211_sta *sta,
+			    const void *stats, size_t len);
 };
 
 static inline int rate_supported(struct ieee80211_sta *sta,
@@ -57,6 +57,12 @@
  * and the driver must later call ieee80211_stop_tx_ba_cb_irqsafe().
  * Note that the sta can get destroyed before the BA tear down is
  * complete.
+ *
+ * Unless the driver does its own rate control, mac80211 decides when
+ * to start sessions itself, see ieee80211_agg_tx_policy(): a session
+ * is requested once a TID carries enough traffic, and torn down again
+ * by the session timer once the TID has been idle. The number of
+ * concurrent sessions is limited to what the hardware supports.
  */
 
 static void ieee80211_send_addba_request(struct ieee80211_sub_if_data *sdata,
@@ -97,7 +103,10 @@ static void ieee80211_send_addba_request(struct ieee80211_sub_if_data *sdata,
 	mgmt->u.action.u.addba_req.action_code = WLAN_ACTION_ADDBA_REQ;
 
 	mgmt->u.action.u.addba_req.dialog_token = dialog_token;
-	capab = (u16)(1 << 1);		/* bit 1 aggregation policy */
+	capab = 0;
+	if (local->hw.flags & IEEE80211_HW_TX_AMSDU)
+		capab |= IEEE80211_ADDBA_PARAM_AMSDU_MASK;
+	capab |= (u16)(1 << 1);		/* bit 1 aggregation policy */
 	capab |= (u16)(tid << 2); 	/* bit 5:2 TID number */
 	capab |= (u16)(agg_size << 6);	/* bit 15:6 max size of aggergation */
 
@@ -148,6 +157,13 @@ void ieee80211_assign_tid_tx(struct sta_info *sta, int tid,
 	rcu_assign_pointer(sta->ampdu_mlme.tid_tx[tid], tid_tx);
 }
 
+static void ieee80211_agg_tx_free(struct ieee80211_local *local,
+				  struct tid_ampdu_tx *tid_tx)
+{
+	atomic_dec(&local->agg_tx_sessions);
+	kfree_rcu(tid_tx, rcu_head);
+}
+
 int ___ieee80211_stop_tx_ba_session(struct sta_info *sta, u16 tid,
 				    enum ieee80211_back_parties initiator,
 				    bool tx)
@@ -176,7 +192,24 @@ int ___ieee80211_stop_tx_ba_session(struct sta_info *sta, u16 tid,
 		/* not even started yet! */
 		ieee80211_assign_tid_tx(sta, tid, NULL);
 		spin_unlock_bh(&sta->lock);
-		kfree_rcu(tid_tx, rcu_head);
+		ieee80211_agg_tx_free(local, tid_tx);
+		return 0;
+	}
+
+	if (test_bit(HT_AGG_STATE_START_SYNC, &tid_tx->state)) {
+		/*
+		 * The driver doesn't know about the session yet, but
+		 * the TX path may already have queued frames on it.
+		 * Clear the state so that the aggregation start work,
+		 * which may still find the session under RCU, doesn't
+		 * kick the station for it.
+		 */
+		clear_bit(HT_AGG_STATE_START_SYNC, &tid_tx->state);
+		ieee80211_agg_splice_packets(local, tid_tx, tid);
+		ieee80211_assign_tid_tx(sta, tid, NULL);
+		ieee80211_agg_splice_finish(local, tid);
+		spin_unlock_bh(&sta->lock);
+		ieee80211_agg_tx_free(local, tid_tx);
 		return 0;
 	}
 
@@ -265,6 +298,7 @@ static void sta_addba_resp_timer_expired(unsigned long data)
 	printk(KERN_DEBUG "addBA response timer expired on tid %d\n", tid);
 #endif
 
+	sta->local->agg_tx_failed++;
 	ieee80211_stop_tx_ba_session(&sta->sta, tid);
 	rcu_read_unlock();
 }
@@ -318,6 +352,7 @@ ieee80211_agg_splice_packets(struct ieee80211_local *local,
 			     struct tid_ampdu_tx *tid_tx, u16 tid)
 {
 	int queue = ieee80211_ac_from_tid(tid);
+	struct sk_buff *skb;
 	unsigned long flags;
 
 	ieee80211_stop_queue_agg(local, tid);
@@ -328,7 +363,13 @@ ieee80211_agg_splice_packets(struct ieee80211_local *local,
 
 	if (!skb_queue_empty(&tid_tx->pending)) {
 		spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
-		/* copy over remaining packets */
+		/*
+		 * copy over remaining packets, those that were on the
+		 * pending queue before keep their time
+		 */
+		skb_queue_walk(&tid_tx->pending, skb)
+			if (!skb->tstamp.tv64)
+				ieee80211_codel_stamp(skb);
 		skb_queue_splice_tail_init(&tid_tx->pending,
 					   &local->pending[queue]);
 		spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
@@ -341,13 +382,115 @@ ieee80211_agg_splice_finish(struct ieee80211_local *local, u16 tid)
 	ieee80211_wake_queue_agg(local, tid);
 }
 
+/*
+ * Before the driver is told about a new session, all TX paths that may
+ * have seen the TID without the session must have finished, so that the
+ * starting sequence number is valid and no frames for the TID go to the
+ * driver during the ampdu_action call. Rather than blocking for an RCU
+ * grace period per session, sessions wait for a shared RCU callback:
+ * all sessions being set up at the same time share a grace period and
+ * the aggregation work can continue with other stations meanwhile.
+ */
+static void ieee80211_agg_start_rcu(struct rcu_head *head)
+{
+	struct ieee80211_local *local =
+		container_of(head, struct ieee80211_local, agg_start_rcu);
+
+	spin_lock_bh(&local->agg_start_lock);
+	local->agg_start_synced = local->agg_start_gen;
+	if (local->agg_start_want_more) {
+		local->agg_start_want_more = false;
+		local->agg_start_gen++;
+		call_rcu(&local->agg_start_rcu, ieee80211_agg_start_rcu);
+	} else {
+		local->agg_start_rcu_pending = false;
+	}
+
+	/* no work may be queued while suspending, kick it on resume */
+	if (local->quiescing || local->suspended)
+		local->agg_start_kick = true;
+	else
+		ieee80211_queue_work(&local->hw, &local->agg_start_work);
+	spin_unlock_bh(&local->agg_start_lock);
+}
+
+void ieee80211_agg_start_restart(struct ieee80211_local *local)
+{
+	spin_lock_bh(&local->agg_start_lock);
+	if (local->agg_start_kick) {
+		local->agg_start_kick = false;
+		ieee80211_queue_work(&local->hw, &local->agg_start_work);
+	}
+	spin_unlock_bh(&local->agg_start_lock);
+}
+
+/*
+ * Returns the generation after which the TX path is known to no
+ * longer be using any state it saw before this was called.
+ */
+static u32 ieee80211_agg_start_sync(struct ieee80211_local *local)
+{
+	u32 gen;
+
+	spin_lock_bh(&local->agg_start_lock);
+	if (!local->agg_start_rcu_pending) {
+		local->agg_start_rcu_pending = true;
+		local->agg_start_gen++;
+		call_rcu(&local->agg_start_rcu, ieee80211_agg_start_rcu);
+		gen = local->agg_start_gen;
+	} else {
+		/* the pending grace period may have started before us */
+		local->agg_start_want_more = true;
+		gen = local->agg_start_gen + 1;
+	}
+	spin_unlock_bh(&local->agg_start_lock);
+
+	return gen;
+}
+
+static bool ieee80211_agg_start_synced(struct ieee80211_local *local,
+				       struct tid_ampdu_tx *tid_tx)
+{
+	bool synced;
+
+	spin_lock_bh(&local->agg_start_lock);
+	synced = (s32)(local->agg_start_synced - tid_tx->start_gen) >= 0;
+	spin_unlock_bh(&local->agg_start_lock);
+
+	return synced;
+}
+
+void ieee80211_agg_start_work(struct work_struct *work)
+{
+	struct ieee80211_local *local =
+		container_of(work, struct ieee80211_local, agg_start_work);
+	struct tid_ampdu_tx *tid_tx;
+	struct sta_info *sta;
+	int tid;
+
+	/* kick the stations that have sessions waiting to be started */
+	rcu_read_lock();
+	list_for_each_entry_rcu(sta, &local->sta_list, list) {
+		/* the station is being destroyed, don't queue its work */
+		if (sta->dead || test_sta_flag(sta, WLAN_STA_BLOCK_BA))
+			continue;
+
+		for (tid = 0; tid < STA_TID_NUM; tid++) {
+			tid_tx = rcu_dereference(sta->ampdu_mlme.tid_tx[tid]);
+			if (tid_tx &&
+			    test_bit(HT_AGG_STATE_START_SYNC, &tid_tx->state)) {
+				ieee80211_queue_work(&local->hw,
+						     &sta->ampdu_mlme.work);
+				break;
+			}
+		}
+	}
+	rcu_read_unlock();
+}
+
 void ieee80211_tx_ba_session_handle_start(struct sta_info *sta, int tid)
 {
 	struct tid_ampdu_tx *tid_tx;
-	struct ieee80211_local *local = sta->local;
-	struct ieee80211_sub_if_data *sdata = sta->sdata;
-	u16 start_seq_num;
-	int ret;
 
 	tid_tx = rcu_dereference_protected_tid_tx(sta, tid);
 
@@ -358,13 +501,29 @@ void ieee80211_tx_ba_session_handle_start(struct sta_info *sta, int tid)
 	 */
 	clear_bit(HT_AGG_STATE_WANT_START, &tid_tx->state);
 
-	/*
-	 * Make sure no packets are being processed. This ensures that
-	 * we have a valid starting sequence number and that in-flight
-	 * packets have been flushed out and no packets for this TID
-	 * will go into the driver during the ampdu_action call.
-	 */
-	synchronize_net();
+	tid_tx->start_gen = ieee80211_agg_start_sync(sta->local);
+	set_bit(HT_AGG_STATE_START_SYNC, &tid_tx->state);
+}
+
+/*
+ * Called from the aggregation work for sessions waiting in
+ * %HT_AGG_STATE_START_SYNC, returns whether the session has
+ * been handed to the driver (or removed).
+ */
+bool ieee80211_tx_ba_session_handle_synced(struct sta_info *sta, int tid)
+{
+	struct tid_ampdu_tx *tid_tx;
+	struct ieee80211_local *local = sta->local;
+	struct ieee80211_sub_if_data *sdata = sta->sdata;
+	u16 start_seq_num;
+	int ret;
+
+	tid_tx = rcu_dereference_protected_tid_tx(sta, tid);
+
+	if (!ieee80211_agg_start_synced(local, tid_tx))
+		return false;
+
+	clear_bit(HT_AGG_STATE_START_SYNC, &tid_tx->state);
 
 	start_seq_num = sta->tid_seq[tid] >> 4;
 
@@ -381,8 +540,9 @@ void ieee80211_tx_ba_session_handle_start(struct sta_info *sta, int tid)
 		ieee80211_agg_splice_finish(local, tid);
 		spin_unlock_bh(&sta->lock);
 
-		kfree_rcu(tid_tx, rcu_head);
-		return;
+		local->agg_tx_failed++;
+		ieee80211_agg_tx_free(local, tid_tx);
+		return true;
 	}
 
 	/* activate the timer for the recipient's addBA response */
@@ -401,6 +561,7 @@ void ieee80211_tx_ba_session_handle_start(struct sta_info *sta, int tid)
 				     tid_tx->dialog_token, start_seq_num,
 				     local->hw.max_tx_aggregation_subframes,
 				     tid_tx->timeout);
+	return true;
 }
 
 /*
@@ -422,6 +583,7 @@ static void sta_tx_agg_session_timer_expired(unsigned long data)
 	printk(KERN_DEBUG "tx session timer expired on tid %d\n", (u16)*ptid);
 #endif
 
+	sta->local->agg_tx_idle++;
 	ieee80211_stop_tx_ba_session(&sta->sta, *ptid);
 }
 
@@ -522,9 +684,20 @@ int ieee80211_start_tx_ba_session(struct ieee80211_sta *pubsta, u16 tid,
 		goto err_unlock_sta;
 	}
 
+	/* don't exceed the number of sessions the hardware can handle */
+	if (atomic_inc_return(&local->agg_tx_sessions) >
+			local->hw.max_tx_ba_sessions &&
+	    local->hw.max_tx_ba_sessions) {
+		atomic_dec(&local->agg_tx_sessions);
+		local->agg_tx_denied++;
+		ret = -EBUSY;
+		goto err_unlock_sta;
+	}
+
 	/* prepare A-MPDU MLME for Tx aggregation */
 	tid_tx = kzalloc(sizeof(struct tid_ampdu_tx), GFP_ATOMIC);
 	if (!tid_tx) {
+		atomic_dec(&local->agg_tx_sessions);
 		ret = -ENOMEM;
 		goto err_unlock_sta;
 	}
@@ -533,6 +706,7 @@ int ieee80211_start_tx_ba_session(struct ieee80211_sta *pubsta, u16 tid,
 	__set_bit(HT_AGG_STATE_WANT_START, &tid_tx->state);
 
 	tid_tx->timeout = timeout;
+	tid_tx->start_time = jiffies;
 
 	/* response timer */
 	tid_tx->addba_resp_timer.function = sta_addba_resp_timer_expired;
@@ -563,6 +737,55 @@ int ieee80211_start_tx_ba_session(struct ieee80211_sta *pubsta, u16 tid,
 }
 EXPORT_SYMBOL(ieee80211_start_tx_ba_session);
 
+/**
+ * ieee80211_agg_tx_policy - account TX traffic and start sessions
+ *
+ * Called by the TX path for QoS data frames on TIDs without a session.
+ * A session is requested once a TID carried at least agg_min_pps frames
+ * per second, measured over %HT_AGG_TX_WINDOW.
+ *
+ * @sta: the destination station
+ * @tid: the TID of the frame
+ * @skb: the frame
+ */
+void ieee80211_agg_tx_policy(struct sta_info *sta, int tid,
+			     struct sk_buff *skb)
+{
+	struct ieee80211_local *local = sta->local;
+	struct sta_ampdu_mlme *mlme = &sta->ampdu_mlme;
+	u32 threshold;
+
+	/* drivers doing their own rate control decide themselves */
+	if (local->hw.flags & IEEE80211_HW_HAS_RATE_CONTROL)
+		return;
+
+	if (!local->agg_min_pps || !sta->sta.ht_cap.ht_supported)
+		return;
+
+	if (unlikely(skb->protocol == cpu_to_be16(ETH_P_PAE)))
+		return;
+
+	if (skb_get_queue_mapping(skb) == IEEE80211_AC_VO)
+		return;
+
+	/* the TX path may run concurrently, these are just estimates */
+	if (time_after(jiffies, mlme->tx_window_start[tid] + HT_AGG_TX_WINDOW)) {
+		mlme->tx_window_start[tid] = jiffies;
+		mlme->tx_window_frames[tid] = 0;
+	}
+
+	threshold = DIV_ROUND_UP(local->agg_min_pps * HT_AGG_TX_WINDOW, HZ);
+	if (++mlme->tx_window_frames[tid] != max_t(u32, threshold, 1))
+		return;
+
+	/* cheap checks first, ieee80211_start_tx_ba_session() rechecks */
+	if (mlme->tid_start_tx[tid] ||
+	    mlme->addba_req_num[tid] > HT_AGG_MAX_RETRIES)
+		return;
+
+	ieee80211_start_tx_ba_session(&sta->sta, tid, local->agg_idle_timeout);
+}
+
 static void ieee80211_agg_tx_operational(struct ieee80211_local *local,
 					 struct sta_info *sta, u16 tid)
 {
@@ -576,6 +799,11 @@ static void ieee80211_agg_tx_operational(struct ieee80211_local *local,
 	printk(KERN_DEBUG "Aggregation is on for tid %d\n", tid);
 #endif
 
+	local->agg_tx_setups++;
+	local->agg_tx_setup_time += jiffies - tid_tx->start_time;
+	local->agg_tx_setup_max = max(local->agg_tx_setup_max,
+				      jiffies - tid_tx->start_time);
+
 	drv_ampdu_action(local, sta->sdata,
 			 IEEE80211_AMPDU_TX_OPERATIONAL,
 			 &sta->sta, tid, NULL, tid_tx->buf_size);
@@ -785,7 +1013,7 @@ void ieee80211_stop_tx_ba_cb(struct ieee80211_vif *vif, u8 *ra, u8 tid)
 
 	ieee80211_agg_splice_finish(local, tid);
 
-	kfree_rcu(tid_tx, rcu_head);
+	ieee80211_agg_tx_free(local, tid_tx);
 
  unlock_sta:
 	spin_unlock_bh(&sta->lock);
@@ -878,6 +1106,7 @@ void ieee80211_process_addba_resp(struct ieee80211_local *local,
 		}
 
 		tid_tx->buf_size = buf_size;
+		tid_tx->amsdu = !!(capab & IEEE80211_ADDBA_PARAM_AMSDU_MASK);
 
 		if (test_bit(HT_AGG_STATE_DRV_READY, &tid_tx->state))
 			ieee80211_agg_tx_operational(local, sta, tid);
@@ -889,6 +1118,7 @@ void ieee80211_process_addba_resp(struct ieee80211_local *local,
 				  TU_TO_EXP_TIME(tid_tx->timeout));
 
 	} else {
+		local->agg_tx_failed++;
 		___ieee80211_stop_tx_ba_session(sta, tid, WLAN_BACK_INITIATOR,
 						true);
 	}
@@ -353,6 +353,7 @@ void sta_set_rate_info_tx(struct sta_info *sta,
 static void sta_set_sinfo(struct sta_info *sta, struct station_info *sinfo)
 {
 	struct ieee80211_sub_if_data *sdata = sta->sdata;
+	struct ieee80211_sta_pcpu_stats stats;
 	struct timespec uptime;
 
 	sinfo->generation = sdata->local->sta_generation;
@@ -376,15 +377,32 @@ static void sta_set_sinfo(struct sta_info *sta, struct station_info *sinfo)
 	sinfo->connected_time = uptime.tv_sec - sta->last_connected;
 
 	sinfo->inactive_time = jiffies_to_msecs(jiffies - sta->last_rx);
-	sinfo->rx_bytes = sta->rx_bytes;
-	sinfo->tx_bytes = sta->tx_bytes;
-	sinfo->rx_packets = sta->rx_packets;
-	sinfo->tx_packets = sta->tx_packets;
+	sta_info_get_stats(sta, &stats);
+	sinfo->rx_bytes = stats.rx_bytes;
+	sinfo->tx_bytes = stats.tx_bytes;
+	sinfo->rx_packets = stats.rx_packets;
+	sinfo->tx_packets = stats.tx_packets;
 	sinfo->tx_retries = sta->tx_retry_count;
 	sinfo->tx_failed = sta->tx_retry_failed;
 	sinfo->rx_dropped_misc = sta->rx_dropped;
 	sinfo->beacon_loss_count = sta->beacon_loss_count;
 
+	if (sdata->local->ops->wake_tx_queue) {
+		sinfo->filled |= STATION_INFO_TX_AIRTIME |
+				 STATION_INFO_TX_QUEUE_DELAY;
+		sinfo->tx_airtime = sta->tx_airtime;
+		sinfo->tx_queue_delay = ewma_read(&sta->avg_txq_delay);
+	}
+
+	/* only if the caller asked for them, see nl80211 */
+	if (sinfo->rate_stats) {
+		sinfo->rate_stats_len =
+			rate_control_get_rate_stats(sta, sinfo->rate_stats,
+						    sinfo->rate_stats_len);
+		if (sinfo->rate_stats_len)
+			sinfo->filled |= STATION_INFO_RATE_STATS;
+	}
+
 	if ((sta->local->hw.flags & IEEE80211_HW_SIGNAL_DBM) ||
 	    (sta->local->hw.flags & IEEE80211_HW_SIGNAL_UNSPEC)) {
 		sinfo->filled |= STATION_INFO_SIGNAL | STATION_INFO_SIGNAL_AVG;
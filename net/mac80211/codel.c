@@ -0,0 +1,188 @@
+/*
+ * CoDel (controlled delay) queue management for mac80211 internal queues
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This follows the algorithm by Kathleen Nichols and Van Jacobson: a
+ * queue is considered congested once the time its frames spend queued
+ * (the sojourn time) has stayed above a target for a whole interval.
+ * From then on frames are dropped, or ECN marked where possible, at a
+ * rate growing with the square root of the number of drops until the
+ * sojourn time falls below the target again.
+ *
+ * The queues this is used on hold frames that have already been
+ * converted to 802.11, so ECN marking is only done as long as the
+ * frame hasn't been encrypted yet. Some of the frames may also have
+ * been assigned a sequence number already, those are never dropped.
+ */
+
+#include <linux/kernel.h>
+#include <linux/skbuff.h>
+#include <linux/ieee80211.h>
+#include <net/inet_ecn.h>
+#include <net/mac80211.h>
+#include "codel.h"
+
+static inline u32 codel_now(void)
+{
+	return ktime_to_us(ktime_get());
+}
+
+#define codel_time_after_eq(a, b)	((s32)((a) - (b)) >= 0)
+#define codel_time_before(a, b)		((s32)((a) - (b)) < 0)
+
+static u32 codel_control_law(u32 t, u32 interval, u32 count)
+{
+	return t + interval / int_sqrt(count);
+}
+
+static bool codel_should_drop(struct sk_buff *skb,
+			      struct sk_buff_head *queue,
+			      const struct ieee80211_codel_params *params,
+			      struct ieee80211_codel_vars *vars, u32 now)
+{
+	u32 sojourn;
+
+	if (!skb) {
+		vars->first_above_time = 0;
+		return false;
+	}
+
+	sojourn = now - (u32)ktime_to_us(skb->tstamp);
+
+	/* never drop the last frame, there's no standing queue then */
+	if (sojourn < params->target || skb_queue_empty(queue)) {
+		vars->first_above_time = 0;
+		return false;
+	}
+
+	if (!vars->first_above_time) {
+		vars->first_above_time = (now + params->interval) | 1;
+		return false;
+	}
+
+	return codel_time_after_eq(now, vars->first_above_time);
+}
+
+/*
+ * Dropping a single fragment throws away the whole MSDU at the receiver,
+ * and dropping a frame that already has its sequence number within a
+ * BlockAck session leaves a hole the recipient's reorder buffer waits
+ * for until it times out. Such frames are sent rather than dropped.
+ */
+static bool codel_may_drop(struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_hdr *hdr = (void *)skb->data;
+
+	if (info->flags & (IEEE80211_TX_CTL_AMPDU |
+			   IEEE80211_TX_INTFL_RETRANSMISSION))
+		return false;
+
+	return !ieee80211_has_morefrags(hdr->frame_control) &&
+	       !(hdr->seq_ctrl & cpu_to_le16(IEEE80211_SCTL_FRAG));
+}
+
+static bool codel_mark(struct sk_buff *skb, struct ieee80211_codel_vars *vars)
+{
+	struct ieee80211_hdr *hdr = (void *)skb->data;
+
+	if (!ieee80211_is_data_present(hdr->frame_control) ||
+	    ieee80211_has_protected(hdr->frame_control))
+		return false;
+
+	if (!INET_ECN_set_ce(skb))
+		return false;
+
+	vars->marks++;
+	return true;
+}
+
+static void codel_drop(struct sk_buff *skb, struct ieee80211_codel_vars *vars,
+		       struct sk_buff_head *dropped)
+{
+	__skb_queue_tail(dropped, skb);
+	vars->drops++;
+}
+
+/**
+ * ieee80211_codel_dequeue - dequeue a frame from a CoDel managed queue
+ * @queue: the queue, the caller must hold its lock
+ * @params: CoDel parameters for the queue
+ * @vars: CoDel state of the queue
+ * @dropped: frames CoDel decides to drop are put here, for the caller
+ *	to free once it has released the queue lock
+ *
+ * Returns the next frame to transmit, or %NULL if the queue is empty.
+ * All frames on @queue must have been stamped with ieee80211_codel_stamp().
+ * The stamp stays on the frame returned, so that it keeps its sojourn
+ * time if it's put back; it's cleared when the frame is handed to the
+ * driver.
+ */
+struct sk_buff *ieee80211_codel_dequeue(struct sk_buff_head *queue,
+				const struct ieee80211_codel_params *params,
+				struct ieee80211_codel_vars *vars,
+				struct sk_buff_head *dropped)
+{
+	u32 now = codel_now();
+	struct sk_buff *skb = __skb_dequeue(queue);
+	bool drop = codel_should_drop(skb, queue, params, vars, now);
+	u32 delta;
+
+	if (vars->dropping) {
+		if (!drop) {
+			/* sojourn time below target, leave dropping state */
+			vars->dropping = false;
+			return skb;
+		}
+
+		while (vars->dropping &&
+		       codel_time_after_eq(now, vars->drop_next)) {
+			vars->count++;
+			if (!codel_may_drop(skb) || codel_mark(skb, vars)) {
+				vars->drop_next =
+					codel_control_law(vars->drop_next,
+							  params->interval,
+							  vars->count);
+				return skb;
+			}
+
+			codel_drop(skb, vars, dropped);
+			skb = __skb_dequeue(queue);
+			if (!codel_should_drop(skb, queue, params, vars, now))
+				vars->dropping = false;
+			else
+				vars->drop_next =
+					codel_control_law(vars->drop_next,
+							  params->interval,
+							  vars->count);
+		}
+	} else if (drop) {
+		if (codel_may_drop(skb) && !codel_mark(skb, vars)) {
+			codel_drop(skb, vars, dropped);
+			skb = __skb_dequeue(queue);
+			codel_should_drop(skb, queue, params, vars, now);
+		}
+
+		vars->dropping = true;
+
+		/*
+		 * If we were dropping recently, resume at the previous
+		 * drop rate rather than starting over.
+		 */
+		delta = vars->count - vars->lastcount;
+		if (delta > 1 &&
+		    codel_time_before(now - vars->drop_next,
+				      16 * params->interval))
+			vars->count = delta;
+		else
+			vars->count = 1;
+		vars->lastcount = vars->count;
+		vars->drop_next = codel_control_law(now, params->interval,
+						    vars->count);
+	}
+
+	return skb;
+}
@@ -0,0 +1,68 @@
+/*
+ * CoDel (controlled delay) queue management for mac80211 internal queues
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef IEEE80211_CODEL_H
+#define IEEE80211_CODEL_H
+
+#include <linux/types.h>
+#include <linux/ktime.h>
+#include <linux/skbuff.h>
+
+/* default sojourn time target and interval, in usecs */
+#define IEEE80211_CODEL_TARGET		5000
+#define IEEE80211_CODEL_INTERVAL	100000
+
+/**
+ * struct ieee80211_codel_params - CoDel parameters of a queue
+ *
+ * @target: acceptable standing queue delay (usecs)
+ * @interval: time (usecs) the delay may stay above @target before
+ *	CoDel starts dropping
+ */
+struct ieee80211_codel_params {
+	u32 target;
+	u32 interval;
+};
+
+/**
+ * struct ieee80211_codel_vars - CoDel state and statistics of a queue
+ *
+ * All zero is the valid initial state. The state is protected by
+ * whatever lock protects the queue it's used for.
+ *
+ * @count: frames dropped or marked since entering the dropping state
+ * @lastcount: @count when the dropping state was last entered
+ * @first_above_time: when the sojourn time will have been above target
+ *	for an interval, zero if it is below target
+ * @drop_next: time of the next drop in the dropping state
+ * @dropping: set while in the dropping state
+ * @drops: number of frames dropped
+ * @marks: number of frames ECN marked instead of dropped
+ */
+struct ieee80211_codel_vars {
+	u32 count;
+	u32 lastcount;
+	u32 first_above_time;
+	u32 drop_next;
+	bool dropping;
+	unsigned long drops;
+	unsigned long marks;
+};
+
+/* record when a frame was put on a CoDel managed queue */
+static inline void ieee80211_codel_stamp(struct sk_buff *skb)
+{
+	skb->tstamp = ktime_get();
+}
+
+struct sk_buff *ieee80211_codel_dequeue(struct sk_buff_head *queue,
+				const struct ieee80211_codel_params *params,
+				struct ieee80211_codel_vars *vars,
+				struct sk_buff_head *dropped);
+
+#endif /* IEEE80211_CODEL_H */
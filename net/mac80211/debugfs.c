@@ -67,10 +67,30 @@ DEBUGFS_READONLY_FILE(frequency, "%d",
 		      local->hw.conf.channel->center_freq);
 DEBUGFS_READONLY_FILE(total_ps_buffered, "%d",
 		      local->total_ps_buffered);
+DEBUGFS_READONLY_FILE(ps_stats,
+		      "buffered: %d\npeak: %d\nstations: %u\n"
+		      "expired: %lu\npurged: %lu",
+		      local->total_ps_buffered, local->ps_buffered_peak,
+		      local->ps_sta_count, local->ps_expired, local->ps_purged);
 DEBUGFS_READONLY_FILE(wep_iv, "%#08x",
 		      local->wep_iv & 0xffffff);
 DEBUGFS_READONLY_FILE(rate_ctrl_alg, "%s",
 	local->rate_ctrl ? local->rate_ctrl->ops->name : "hw/driver");
+DEBUGFS_READONLY_FILE(rx_shared, "shared: %u\ncopied: %u\navoided: %u",
+	local->rx_shared_skbs, local->rx_cow_copies,
+	local->rx_shared_skbs - min(local->rx_cow_copies,
+				    local->rx_shared_skbs));
+DEBUGFS_READONLY_FILE(agg_stats,
+		      "sessions: %d/%u\ndenied: %lu\nfailed: %lu\n"
+		      "idle: %lu\nsetups: %lu\nsetup avg: %u ms\n"
+		      "setup max: %u ms",
+		      atomic_read(&local->agg_tx_sessions),
+		      local->hw.max_tx_ba_sessions,
+		      local->agg_tx_denied, local->agg_tx_failed,
+		      local->agg_tx_idle, local->agg_tx_setups,
+		      jiffies_to_msecs(local->agg_tx_setup_time /
+				       max(local->agg_tx_setups, 1UL)),
+		      jiffies_to_msecs(local->agg_tx_setup_max));
 
 static ssize_t reset_write(struct file *file, const char __user *user_buf,
 			   size_t count, loff_t *ppos)
@@ -180,6 +200,8 @@ static ssize_t hwflags_read(struct file *file, char __user *user_buf,
 		sf += snprintf(buf + sf, mxln - sf, "TX_AMPDU_SETUP_IN_HW\n");
 	if (local->hw.flags & IEEE80211_HW_SCAN_WHILE_IDLE)
 		sf += snprintf(buf + sf, mxln - sf, "SCAN_WHILE_IDLE\n");
+	if (local->hw.flags & IEEE80211_HW_TX_AMSDU)
+		sf += snprintf(buf + sf, mxln - sf, "TX_AMSDU\n");
 
 	rv = simple_read_from_buffer(user_buf, count, ppos, buf, strlen(buf));
 	kfree(buf);
@@ -204,10 +226,80 @@ static ssize_t queues_read(struct file *file, char __user *user_buf,
 	return simple_read_from_buffer(user_buf, count, ppos, buf, res);
 }
 
+static ssize_t scan_stats_read(struct file *file, char __user *user_buf,
+			       size_t count, loff_t *ppos)
+{
+	struct ieee80211_local *local = file->private_data;
+	struct ieee80211_supported_band *sband;
+	struct ieee80211_scan_chan_stats *stats;
+	enum ieee80211_band band;
+	int i, len = 0, bufsz = 100;
+	ssize_t rv;
+	char *buf;
+
+	for (band = 0; band < IEEE80211_NUM_BANDS; band++) {
+		sband = local->hw.wiphy->bands[band];
+		if (sband)
+			bufsz += sband->n_channels * 64;
+	}
+
+	buf = kmalloc(bufsz, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	len += scnprintf(buf + len, bufsz - len,
+			 "freq  visits  idle  dwell_ms  rx_frames\n");
+
+	mutex_lock(&local->mtx);
+	for (band = 0; band < IEEE80211_NUM_BANDS; band++) {
+		sband = local->hw.wiphy->bands[band];
+		if (!sband)
+			continue;
+		for (i = 0; i < sband->n_channels; i++) {
+			stats = ieee80211_scan_get_chan_stats(local,
+						&sband->channels[i]);
+			len += scnprintf(buf + len, bufsz - len,
+					 "%4d  %6u  %4u  %8u  %9u\n",
+					 sband->channels[i].center_freq,
+					 stats->visits, stats->idle,
+					 jiffies_to_msecs(stats->dwell),
+					 stats->rx_frames);
+		}
+	}
+	mutex_unlock(&local->mtx);
+
+	rv = simple_read_from_buffer(user_buf, count, ppos, buf, len);
+	kfree(buf);
+	return rv;
+}
+
 DEBUGFS_READONLY_FILE_OPS(hwflags);
 DEBUGFS_READONLY_FILE_OPS(channel_type);
 DEBUGFS_READONLY_FILE_OPS(queues);
 
+static ssize_t codel_read(struct file *file, char __user *user_buf,
+			  size_t count, loff_t *ppos)
+{
+	struct ieee80211_local *local = file->private_data;
+	unsigned long flags;
+	char buf[IEEE80211_MAX_QUEUES * 48];
+	int q, res = 0;
+
+	spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
+	for (q = 0; q < local->hw.queues; q++)
+		res += scnprintf(buf + res, sizeof(buf) - res,
+				 "%02d: drops %lu marks %lu%s\n", q,
+				 local->pending_cvars[q].drops,
+				 local->pending_cvars[q].marks,
+				 local->pending_cvars[q].dropping ?
+					" dropping" : "");
+	spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, res);
+}
+DEBUGFS_READONLY_FILE_OPS(codel);
+DEBUGFS_READONLY_FILE_OPS(scan_stats);
+
 /* statistics stuff */
 
 static ssize_t format_devstat_counter(struct ieee80211_local *local,
@@ -274,13 +366,22 @@ void debugfs_hw_add(struct ieee80211_local *local)
 
 	DEBUGFS_ADD(frequency);
 	DEBUGFS_ADD(total_ps_buffered);
+	DEBUGFS_ADD(ps_stats);
 	DEBUGFS_ADD(wep_iv);
 	DEBUGFS_ADD(queues);
+	DEBUGFS_ADD(codel);
+	DEBUGFS_ADD(rx_shared);
+	DEBUGFS_ADD(scan_stats);
 	DEBUGFS_ADD_MODE(reset, 0200);
 	DEBUGFS_ADD(channel_type);
 	DEBUGFS_ADD(hwflags);
 	DEBUGFS_ADD(user_power);
 	DEBUGFS_ADD(power);
+	DEBUGFS_ADD(agg_stats);
+
+	debugfs_create_u32("agg_min_pps", 0600, phyd, &local->agg_min_pps);
+	debugfs_create_u32("agg_idle_timeout", 0600, phyd,
+			   &local->agg_idle_timeout);
 
 	statsd = debugfs_create_dir("statistics", phyd);
 
@@ -333,8 +434,6 @@ void debugfs_hw_add(struct ieee80211_local *local)
 		local->tx_expand_skb_head_cloned);
 	DEBUGFS_STATS_ADD(rx_expand_skb_head,
 		local->rx_expand_skb_head);
-	DEBUGFS_STATS_ADD(rx_expand_skb_head2,
-		local->rx_expand_skb_head2);
 	DEBUGFS_STATS_ADD(rx_handlers_fragments,
 		local->rx_handlers_fragments);
 	DEBUGFS_STATS_ADD(tx_status_drop,
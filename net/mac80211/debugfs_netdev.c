@@ -169,12 +169,64 @@ IEEE80211_IF_FILE(flags, flags, HEX);
 IEEE80211_IF_FILE(state, state, LHEX);
 IEEE80211_IF_FILE(channel_type, vif.bss_conf.channel_type, DEC);
 
+static ssize_t ieee80211_if_fmt_fragment_stats(
+	const struct ieee80211_sub_if_data *sdata, char *buf, int buflen)
+{
+	return scnprintf(buf, buflen,
+			 "entries: %u\nmemory: %u\nhits: %lu\nmisses: %lu\n"
+			 "evictions: %lu\n",
+			 sdata->fragment_entries, sdata->fragment_mem,
+			 sdata->fragment_hits, sdata->fragment_misses,
+			 sdata->fragment_evictions);
+}
+__IEEE80211_IF_FILE(fragment_stats, NULL);
+
+static ssize_t ieee80211_if_fmt_rc_algo(
+	const struct ieee80211_sub_if_data *sdata, char *buf, int buflen)
+{
+	if (!sdata->local->rate_ctrl)
+		return scnprintf(buf, buflen, "hw/driver\n");
+
+	return scnprintf(buf, buflen, "%s%s\n",
+			 rate_control_sdata_ref(sdata)->ops->name,
+			 sdata->rate_ctrl ? "" : " (default)");
+}
+
+static ssize_t ieee80211_if_parse_rc_algo(
+	struct ieee80211_sub_if_data *sdata, const char *buf, int buflen)
+{
+	char name[32];
+	int err;
+
+	if (sscanf(buf, "%31s", name) != 1)
+		return -EINVAL;
+
+	err = rate_control_set_sdata(sdata, strcmp(name, "default") ?
+						    name : NULL);
+	return err ?: buflen;
+}
+
+__IEEE80211_IF_FILE_W(rc_algo);
+
 /* STA attributes */
 IEEE80211_IF_FILE(bssid, u.mgd.bssid, MAC);
 IEEE80211_IF_FILE(aid, u.mgd.aid, DEC);
 IEEE80211_IF_FILE(last_beacon, u.mgd.last_beacon_signal, DEC);
 IEEE80211_IF_FILE(ave_beacon, u.mgd.ave_beacon_signal, DEC_DIV_16);
 
+static ssize_t
+ieee80211_if_fmt_beacon_stats(const struct ieee80211_sub_if_data *sdata,
+			      char *buf, int buflen)
+{
+	const struct ieee80211_if_managed *ifmgd = &sdata->u.mgd;
+
+	return scnprintf(buf, buflen,
+			 "filtered: %u\nparsed: %u\nchanged: %u\n",
+			 ifmgd->beacons_filtered, ifmgd->beacons_parsed,
+			 ifmgd->beacons_changed);
+}
+__IEEE80211_IF_FILE(beacon_stats, NULL);
+
 static int ieee80211_set_smps(struct ieee80211_sub_if_data *sdata,
 			      enum ieee80211_smps_mode smps_mode)
 {
@@ -406,6 +458,66 @@ static ssize_t ieee80211_if_fmt_num_buffered_multicast(
 }
 __IEEE80211_IF_FILE(num_buffered_multicast, NULL);
 
+static ssize_t ieee80211_if_fmt_multicast_to_unicast(
+	const struct ieee80211_sub_if_data *sdata, char *buf, int buflen)
+{
+	return scnprintf(buf, buflen, "%u\n", sdata->u.ap.mc2uc_max_sta);
+}
+
+static ssize_t ieee80211_if_parse_multicast_to_unicast(
+	struct ieee80211_sub_if_data *sdata, const char *buf, int buflen)
+{
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return -EINVAL;
+
+	sdata->u.ap.mc2uc_max_sta = val;
+
+	return buflen;
+}
+__IEEE80211_IF_FILE_W(multicast_to_unicast);
+
+static ssize_t ieee80211_if_fmt_multicast_to_unicast_stats(
+	const struct ieee80211_sub_if_data *sdata, char *buf, int buflen)
+{
+	u64 frames = 0, copies = 0, airtime_mc = 0, airtime_uc = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		const struct ieee80211_pcpu_netstats *stats;
+		u64 f, c, mc, uc;
+		unsigned int start;
+
+		stats = per_cpu_ptr(sdata->pcpu_stats, cpu);
+		do {
+			start = u64_stats_fetch_begin_bh(&stats->syncp);
+			f = stats->mc2uc_frames;
+			c = stats->mc2uc_copies;
+			mc = stats->mc2uc_airtime_mc;
+			uc = stats->mc2uc_airtime_uc;
+		} while (u64_stats_fetch_retry_bh(&stats->syncp, start));
+
+		frames += f;
+		copies += c;
+		airtime_mc += mc;
+		airtime_uc += uc;
+	}
+
+	return scnprintf(buf, buflen,
+			 "frames: %llu\ncopies: %llu\n"
+			 "multicast airtime: %llu\nunicast airtime: %llu\n"
+			 "airtime saved: %lld\n",
+			 (unsigned long long)frames,
+			 (unsigned long long)copies,
+			 (unsigned long long)airtime_mc,
+			 (unsigned long long)airtime_uc,
+			 (long long)(airtime_mc - airtime_uc));
+}
+__IEEE80211_IF_FILE(multicast_to_unicast_stats, NULL);
+
 /* IBSS attributes */
 static ssize_t ieee80211_if_fmt_tsf(
 	const struct ieee80211_sub_if_data *sdata, char *buf, int buflen)
@@ -518,11 +630,13 @@ static void add_sta_files(struct ieee80211_sub_if_data *sdata)
 	DEBUGFS_ADD(rc_rateidx_mask_5ghz);
 	DEBUGFS_ADD(rc_rateidx_mcs_mask_2ghz);
 	DEBUGFS_ADD(rc_rateidx_mcs_mask_5ghz);
+	DEBUGFS_ADD_MODE(rc_algo, 0600);
 
 	DEBUGFS_ADD(bssid);
 	DEBUGFS_ADD(aid);
 	DEBUGFS_ADD(last_beacon);
 	DEBUGFS_ADD(ave_beacon);
+	DEBUGFS_ADD(beacon_stats);
 	DEBUGFS_ADD_MODE(smps, 0600);
 	DEBUGFS_ADD_MODE(tkip_mic_test, 0200);
 	DEBUGFS_ADD_MODE(uapsd_queues, 0600);
@@ -539,11 +653,14 @@ static void add_ap_files(struct ieee80211_sub_if_data *sdata)
 	DEBUGFS_ADD(rc_rateidx_mask_5ghz);
 	DEBUGFS_ADD(rc_rateidx_mcs_mask_2ghz);
 	DEBUGFS_ADD(rc_rateidx_mcs_mask_5ghz);
+	DEBUGFS_ADD_MODE(rc_algo, 0600);
 
 	DEBUGFS_ADD(num_sta_authorized);
 	DEBUGFS_ADD(num_sta_ps);
 	DEBUGFS_ADD(dtim_count);
 	DEBUGFS_ADD(num_buffered_multicast);
+	DEBUGFS_ADD_MODE(multicast_to_unicast, 0600);
+	DEBUGFS_ADD(multicast_to_unicast_stats);
 	DEBUGFS_ADD_MODE(tkip_mic_test, 0200);
 }
 
@@ -554,6 +671,7 @@ static void add_ibss_files(struct ieee80211_sub_if_data *sdata)
 	DEBUGFS_ADD(rc_rateidx_mask_5ghz);
 	DEBUGFS_ADD(rc_rateidx_mcs_mask_2ghz);
 	DEBUGFS_ADD(rc_rateidx_mcs_mask_5ghz);
+	DEBUGFS_ADD_MODE(rc_algo, 0600);
 
 	DEBUGFS_ADD_MODE(tsf, 0600);
 }
@@ -568,6 +686,7 @@ static void add_wds_files(struct ieee80211_sub_if_data *sdata)
 	DEBUGFS_ADD(rc_rateidx_mask_5ghz);
 	DEBUGFS_ADD(rc_rateidx_mcs_mask_2ghz);
 	DEBUGFS_ADD(rc_rateidx_mcs_mask_5ghz);
+	DEBUGFS_ADD_MODE(rc_algo, 0600);
 
 	DEBUGFS_ADD(peer);
 }
@@ -582,6 +701,7 @@ static void add_vlan_files(struct ieee80211_sub_if_data *sdata)
 	DEBUGFS_ADD(rc_rateidx_mask_5ghz);
 	DEBUGFS_ADD(rc_rateidx_mcs_mask_2ghz);
 	DEBUGFS_ADD(rc_rateidx_mcs_mask_5ghz);
+	DEBUGFS_ADD_MODE(rc_algo, 0600);
 }
 
 static void add_monitor_files(struct ieee80211_sub_if_data *sdata)
@@ -595,6 +715,7 @@ static void add_monitor_files(struct ieee80211_sub_if_data *sdata)
 
 static void add_mesh_files(struct ieee80211_sub_if_data *sdata)
 {
+	DEBUGFS_ADD_MODE(rc_algo, 0600);
 	DEBUGFS_ADD_MODE(tsf, 0600);
 }
 
@@ -651,6 +772,9 @@ static void add_files(struct ieee80211_sub_if_data *sdata)
 	if (!sdata->debugfs.dir)
 		return;
 
+	if (sdata->vif.type != NL80211_IFTYPE_MONITOR)
+		DEBUGFS_ADD(fragment_stats);
+
 	switch (sdata->vif.type) {
 	case NL80211_IFTYPE_MESH_POINT:
 #ifdef CONFIG_MAC80211_MESH
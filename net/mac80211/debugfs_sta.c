@@ -10,10 +10,13 @@
 
 #include <linux/debugfs.h>
 #include <linux/ieee80211.h>
+#include <linux/rtnetlink.h>
 #include "ieee80211_i.h"
 #include "debugfs.h"
 #include "debugfs_sta.h"
 #include "sta_info.h"
+#include "rate.h"
+#include "wme.h"
 
 /* sta attributtes */
 
@@ -53,6 +56,26 @@ STA_FILE(aid, sta.aid, D);
 STA_FILE(dev, sdata->name, S);
 STA_FILE(last_signal, last_signal, D);
 
+#define STA_STATS_FILE(name)						\
+static ssize_t sta_ ##name## _read(struct file *file,			\
+				   char __user *userbuf,		\
+				   size_t count, loff_t *ppos)		\
+{									\
+	struct sta_info *sta = file->private_data;			\
+	struct ieee80211_sta_pcpu_stats stats;				\
+									\
+	sta_info_get_stats(sta, &stats);				\
+	return mac80211_format_buffer(userbuf, count, ppos, "%llu\n",	\
+				      (unsigned long long)stats.name);	\
+}									\
+STA_OPS(name)
+
+STA_STATS_FILE(rx_packets);
+STA_STATS_FILE(tx_packets);
+STA_STATS_FILE(rx_bytes);
+STA_STATS_FILE(tx_bytes);
+STA_STATS_FILE(tx_fragments);
+
 static ssize_t sta_flags_read(struct file *file, char __user *userbuf,
 			      size_t count, loff_t *ppos)
 {
@@ -93,6 +116,24 @@ static ssize_t sta_num_ps_buf_frames_read(struct file *file,
 }
 STA_OPS(num_ps_buf_frames);
 
+static ssize_t sta_ps_codel_read(struct file *file, char __user *userbuf,
+				 size_t count, loff_t *ppos)
+{
+	struct sta_info *sta = file->private_data;
+	char buf[80 * IEEE80211_NUM_ACS], *p = buf;
+	int ac;
+
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
+		p += scnprintf(p, sizeof(buf) + buf - p,
+			       "AC%d: buffered drops %lu marks %lu, "
+			       "filtered drops %lu marks %lu\n", ac,
+			       sta->ps_cvars[ac].drops, sta->ps_cvars[ac].marks,
+			       sta->filtered_cvars[ac].drops,
+			       sta->filtered_cvars[ac].marks);
+	return simple_read_from_buffer(userbuf, count, ppos, buf, p - buf);
+}
+STA_OPS(ps_codel);
+
 static ssize_t sta_inactive_ms_read(struct file *file, char __user *userbuf,
 				    size_t count, loff_t *ppos)
 {
@@ -237,6 +278,46 @@ static ssize_t sta_agg_status_write(struct file *file, const char __user *userbu
 }
 STA_OPS_RW(agg_status);
 
+static ssize_t sta_rc_algo_read(struct file *file, char __user *userbuf,
+				size_t count, loff_t *ppos)
+{
+	struct sta_info *sta = file->private_data;
+
+	if (!sta->rate_ctrl)
+		return mac80211_format_buffer(userbuf, count, ppos,
+					      "hw/driver\n");
+
+	return mac80211_format_buffer(userbuf, count, ppos, "%s%s\n",
+				      sta->rate_ctrl->ops->name,
+				      sta->rate_ctrl_pinned ? "" :
+				      " (interface)");
+}
+
+static ssize_t sta_rc_algo_write(struct file *file, const char __user *userbuf,
+				 size_t count, loff_t *ppos)
+{
+	char _buf[32], name[32];
+	struct sta_info *sta = file->private_data;
+	int ret;
+
+	if (count >= sizeof(_buf))
+		return -EINVAL;
+
+	if (copy_from_user(_buf, userbuf, count))
+		return -EFAULT;
+	_buf[count] = '\0';
+
+	if (sscanf(_buf, "%31s", name) != 1)
+		return -EINVAL;
+
+	rtnl_lock();
+	ret = rate_control_set_sta(sta, strcmp(name, "default") ? name : NULL);
+	rtnl_unlock();
+
+	return ret ?: count;
+}
+STA_OPS_RW(rc_algo);
+
 static ssize_t sta_ht_capa_read(struct file *file, char __user *userbuf,
 				size_t count, loff_t *ppos)
 {
@@ -319,6 +400,50 @@ static ssize_t sta_ht_capa_read(struct file *file, char __user *userbuf,
 }
 STA_OPS(ht_capa);
 
+static ssize_t sta_amsdu_read(struct file *file, char __user *userbuf,
+			      size_t count, loff_t *ppos)
+{
+	char buf[160];
+	struct sta_info *sta = file->private_data;
+	int res;
+
+	res = scnprintf(buf, sizeof(buf),
+			"A-MSDUs: %lu\nMSDUs: %lu\nfull: %lu\nsingle: %lu\n",
+			sta->tx_amsdu, sta->tx_amsdu_msdus,
+			sta->tx_amsdu_full, sta->tx_amsdu_single);
+	return simple_read_from_buffer(userbuf, count, ppos, buf, res);
+}
+STA_OPS(amsdu);
+
+static ssize_t sta_airtime_read(struct file *file, char __user *userbuf,
+				size_t count, loff_t *ppos)
+{
+	struct sta_info *sta = file->private_data;
+	struct ieee80211_local *local = sta->local;
+	char buf[64 + 40 * IEEE80211_NUM_ACS], *p = buf;
+	int ac, tid, queued;
+
+	spin_lock_bh(&local->txq_lock);
+	p += scnprintf(p, sizeof(buf) + buf - p,
+		       "airtime: %llu\ndrops: %lu\n"
+		       "delay avg: %lu\ndelay max: %u\n",
+		       (unsigned long long)sta->tx_airtime, sta->txq_drops,
+		       ewma_read(&sta->avg_txq_delay), sta->max_txq_delay);
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
+		queued = 0;
+		for (tid = 0; tid < ARRAY_SIZE(sta->txq); tid++)
+			if (ieee802_1d_to_ac[tid] == ac)
+				queued += skb_queue_len(&sta->txq[tid]);
+		p += scnprintf(p, sizeof(buf) + buf - p,
+			       "AC%d: deficit %d queued %d\n", ac,
+			       sta->airtime_deficit[ac], queued);
+	}
+	spin_unlock_bh(&local->txq_lock);
+
+	return simple_read_from_buffer(userbuf, count, ppos, buf, p - buf);
+}
+STA_OPS(airtime);
+
 #define DEBUGFS_ADD(name) \
 	debugfs_create_file(#name, 0400, \
 		sta->debugfs.dir, sta, &sta_ ##name## _ops);
@@ -358,22 +483,26 @@ void ieee80211_sta_debugfs_add(struct sta_info *sta)
 
 	DEBUGFS_ADD(flags);
 	DEBUGFS_ADD(num_ps_buf_frames);
+	DEBUGFS_ADD(ps_codel);
 	DEBUGFS_ADD(inactive_ms);
 	DEBUGFS_ADD(connected_time);
 	DEBUGFS_ADD(last_seq_ctrl);
 	DEBUGFS_ADD(agg_status);
+	DEBUGFS_ADD(rc_algo);
 	DEBUGFS_ADD(dev);
 	DEBUGFS_ADD(last_signal);
 	DEBUGFS_ADD(ht_capa);
+	DEBUGFS_ADD(amsdu);
+	DEBUGFS_ADD(airtime);
+	DEBUGFS_ADD(rx_packets);
+	DEBUGFS_ADD(tx_packets);
+	DEBUGFS_ADD(rx_bytes);
+	DEBUGFS_ADD(tx_bytes);
+	DEBUGFS_ADD(tx_fragments);
 
-	DEBUGFS_ADD_COUNTER(rx_packets, rx_packets);
-	DEBUGFS_ADD_COUNTER(tx_packets, tx_packets);
-	DEBUGFS_ADD_COUNTER(rx_bytes, rx_bytes);
-	DEBUGFS_ADD_COUNTER(tx_bytes, tx_bytes);
 	DEBUGFS_ADD_COUNTER(rx_duplicates, num_duplicates);
 	DEBUGFS_ADD_COUNTER(rx_fragments, rx_fragments);
 	DEBUGFS_ADD_COUNTER(rx_dropped, rx_dropped);
-	DEBUGFS_ADD_COUNTER(tx_fragments, tx_fragments);
 	DEBUGFS_ADD_COUNTER(tx_filtered, tx_filtered_count);
 	DEBUGFS_ADD_COUNTER(tx_retry_failed, tx_retry_failed);
 	DEBUGFS_ADD_COUNTER(tx_retry_count, tx_retry_count);
@@ -33,6 +33,11 @@ static inline void drv_tx_frags(struct ieee80211_local *local,
 	local->ops->tx_frags(&local->hw, vif, sta, skbs);
 }
 
+static inline void drv_wake_tx_queue(struct ieee80211_local *local, u8 ac)
+{
+	local->ops->wake_tx_queue(&local->hw, ac);
+}
+
 static inline int drv_start(struct ieee80211_local *local)
 {
 	int ret;
@@ -205,6 +205,7 @@ void ieee80211_ba_session_work(struct work_struct *work)
 {
 	struct sta_info *sta =
 		container_of(work, struct sta_info, ampdu_mlme.work);
+	struct ieee80211_local *local = sta->local;
 	struct tid_ampdu_tx *tid_tx;
 	int tid;
 
@@ -240,10 +241,13 @@ void ieee80211_ba_session_work(struct work_struct *work)
 
 			sta->ampdu_mlme.tid_start_tx[tid] = NULL;
 			/* could there be a race? */
-			if (sta->ampdu_mlme.tid_tx[tid])
+			if (sta->ampdu_mlme.tid_tx[tid]) {
+				spin_unlock_bh(&sta->lock);
+				atomic_dec(&local->agg_tx_sessions);
 				kfree(tid_tx);
-			else
-				ieee80211_assign_tid_tx(sta, tid, tid_tx);
+				continue;
+			}
+			ieee80211_assign_tid_tx(sta, tid, tid_tx);
 			spin_unlock_bh(&sta->lock);
 
 			ieee80211_tx_ba_session_handle_start(sta, tid);
@@ -256,6 +260,9 @@ void ieee80211_ba_session_work(struct work_struct *work)
 			___ieee80211_stop_tx_ba_session(sta, tid,
 							WLAN_BACK_INITIATOR,
 							true);
+		else if (tid_tx && test_bit(HT_AGG_STATE_START_SYNC,
+					    &tid_tx->state))
+			ieee80211_tx_ba_session_handle_synced(sta, tid);
 	}
 	mutex_unlock(&sta->ampdu_mlme.mtx);
 }
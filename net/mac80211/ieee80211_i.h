@@ -30,6 +30,7 @@
 #include <net/mac80211.h>
 #include "key.h"
 #include "sta_info.h"
+#include "codel.h"
 
 struct ieee80211_local;
 
@@ -46,11 +47,24 @@ struct ieee80211_local;
 #define IEEE80211_ENCRYPT_HEADROOM 8
 #define IEEE80211_ENCRYPT_TAILROOM 18
 
+/* Upper bound on the number of MSDUs packed into one software A-MSDU */
+#define IEEE80211_AMSDU_MAX_SUBFRAMES 16
+
+/* Airtime (in usecs) a station may use per round of the TX scheduler */
+#define IEEE80211_AIRTIME_QUANTUM 300
+
+/* Frames held in the per-station TX queues of one AC, and of one TID */
+#define IEEE80211_TXQ_AC_LIMIT 1024
+#define IEEE80211_TXQ_TID_LIMIT 256
+
 /* IEEE 802.11 (Ch. 9.5 Defragmentation) requires support for concurrent
- * reception of at least three fragmented frames. This limit can be increased
- * by changing this define, at the cost of slower frame reassembly and
- * increased memory use (about 2 kB of RAM per entry). */
-#define IEEE80211_FRAGMENT_MAX 4
+ * reception of at least three fragmented frames. Entries are hashed by
+ * transmitter and RX queue, so the limit only bounds memory use; the
+ * fragments held by all entries are additionally limited to the budget
+ * (in bytes of skb truesize), the oldest entries are evicted first. */
+#define IEEE80211_FRAGMENT_MAX 64
+#define IEEE80211_FRAGMENT_HASH_SIZE 16
+#define IEEE80211_FRAGMENT_MEM_BUDGET (128 * 1024)
 
 #define TU_TO_EXP_TIME(x)	(jiffies + usecs_to_jiffies((x) * 1024))
 
@@ -64,12 +78,16 @@ struct ieee80211_local;
 	IEEE80211_WMM_IE_STA_QOSINFO_SP_ALL
 
 struct ieee80211_fragment_entry {
+	struct hlist_node hash_node;
+	struct list_head lru;
+	u8 addr[ETH_ALEN]; /* transmitter of the fragments */
 	unsigned long first_frag_time;
 	unsigned int seq;
 	unsigned int rx_queue;
 	unsigned int last_frag;
-	unsigned int extra_len;
-	struct sk_buff_head skb_list;
+	unsigned int mem; /* truesize of the fragments held */
+	/* first fragment, the others are chained on its frag_list */
+	struct sk_buff *skb, *tail;
 	int ccmp; /* Whether fragments were encrypted with CCMP */
 	u8 last_pn[6]; /* PN of the last fragment if CCMP was used */
 };
@@ -279,11 +297,26 @@ struct ieee80211_if_ap {
 	 * bitmap_empty :)
 	 * NB: don't touch this bitmap, use sta_info_{set,clear}_tim_bit */
 	u8 tim[sizeof(unsigned long) * BITS_TO_LONGS(IEEE80211_MAX_AID + 1)];
+	/*
+	 * number of bits set in tim and the range of bytes that may have
+	 * bits set, so beacons don't need to scan the whole bitmap; the
+	 * range is tightened lazily when building the beacon
+	 */
+	int tim_bits;
+	u16 tim_min, tim_max;
 	struct sk_buff_head ps_bc_buf;
 	atomic_t num_sta_ps; /* number of stations in PS mode */
 	atomic_t num_sta_authorized; /* number of authorized stations */
 	int dtim_count;
 	bool dtim_bc_mc;
+
+	/*
+	 * Multicast-to-unicast conversion: multicast data is sent as one
+	 * unicast copy per station if there are no more than this many
+	 * authorized stations (0 disables it). The statistics are kept
+	 * with the per-CPU interface counters.
+	 */
+	unsigned int mc2uc_max_sta;
 };
 
 struct ieee80211_if_wds {
@@ -453,6 +486,17 @@ struct ieee80211_if_managed {
 	bool beacon_crc_valid;
 	u32 beacon_crc;
 
+	/*
+	 * Digest of the whole beacon body (minus TIM and BSS load) the
+	 * beacon_crc above was computed for, beacons with a matching
+	 * digest aren't parsed again. Also count how many beacons were
+	 * filtered this way, parsed, and actually found to be changed.
+	 */
+	u32 beacon_digest;
+	unsigned int beacons_filtered;
+	unsigned int beacons_parsed;
+	unsigned int beacons_changed;
+
 	enum {
 		IEEE80211_MFP_DISABLED,
 		IEEE80211_MFP_OPTIONAL,
@@ -644,6 +688,31 @@ enum ieee80211_sdata_state_bits {
 	SDATA_STATE_OFFCHANNEL,
 };
 
+/**
+ * struct ieee80211_pcpu_netstats - per-CPU virtual interface counters
+ *
+ * Summed up into the netdev statistics when they're read, the drop
+ * and error counters are rare enough to stay in &net_device.stats.
+ *
+ * @syncp: synchronisation for the 64-bit counters on 32-bit hosts
+ * @rx_packets: frames passed up to the network stack
+ * @rx_bytes: bytes passed up to the network stack
+ * @tx_packets: frames accepted for transmission
+ * @tx_bytes: bytes accepted for transmission
+ * @mc2uc_frames: multicast frames converted to unicast (AP only)
+ * @mc2uc_copies: unicast copies sent for them
+ * @mc2uc_airtime_mc: estimated airtime (usecs) they would have used
+ *	as multicast
+ * @mc2uc_airtime_uc: estimated airtime (usecs) of the unicast copies
+ */
+struct ieee80211_pcpu_netstats {
+	struct u64_stats_sync syncp;
+	u64 rx_packets, rx_bytes;
+	u64 tx_packets, tx_bytes;
+	u64 mc2uc_frames, mc2uc_copies;
+	u64 mc2uc_airtime_mc, mc2uc_airtime_uc;
+};
+
 struct ieee80211_sub_if_data {
 	struct list_head list;
 
@@ -654,6 +723,8 @@ struct ieee80211_sub_if_data {
 
 	/* count for keys needing tailroom space allocation */
 	int crypto_tx_tailroom_needed_cnt;
+	int crypto_tx_tailroom_pending_dec;
+	struct delayed_work dec_tailroom_needed_wk;
 
 	struct net_device *dev;
 	struct ieee80211_local *local;
@@ -666,6 +737,8 @@ struct ieee80211_sub_if_data {
 
 	char name[IFNAMSIZ];
 
+	struct ieee80211_pcpu_netstats __percpu *pcpu_stats;
+
 	/*
 	 * keep track of whether the HT opmode (stored in
 	 * vif.bss_info.ht_operation_mode) is valid.
@@ -675,9 +748,11 @@ struct ieee80211_sub_if_data {
 	/* to detect idle changes */
 	bool old_idle;
 
-	/* Fragment table for host-based reassembly */
-	struct ieee80211_fragment_entry	fragments[IEEE80211_FRAGMENT_MAX];
-	unsigned int fragment_next;
+	/* Fragment table for host-based reassembly, oldest entries first */
+	struct hlist_head fragments[IEEE80211_FRAGMENT_HASH_SIZE];
+	struct list_head fragment_lru;
+	unsigned int fragment_entries, fragment_mem;
+	unsigned long fragment_hits, fragment_misses, fragment_evictions;
 
 	/* TID bitmap for NoAck policy */
 	u16 noack_map;
@@ -709,6 +784,9 @@ struct ieee80211_sub_if_data {
 	u32 rc_rateidx_mask[IEEE80211_NUM_BANDS];
 	u8  rc_rateidx_mcs_mask[IEEE80211_NUM_BANDS][IEEE80211_HT_MCS_MASK_LEN];
 
+	/* rate control instance for this interface, NULL for the default */
+	struct rate_control_ref *rate_ctrl;
+
 	union {
 		struct ieee80211_if_ap ap;
 		struct ieee80211_if_wds wds;
@@ -805,6 +883,8 @@ enum {
  *	operating channel
  * @SCAN_SET_CHANNEL: Set the next channel to be scanned
  * @SCAN_SEND_PROBE: Send probe requests and wait for probe responses
+ * @SCAN_CHECK_CHANNEL: Leave the channel early if nothing was received
+ *	on it since it was set, otherwise keep waiting for probe responses
  * @SCAN_SUSPEND: Suspend the scan and go back to operating channel to
  *	send out data
  * @SCAN_RESUME: Resume the scan and scan the next channel
@@ -813,10 +893,26 @@ enum mac80211_scan_state {
 	SCAN_DECISION,
 	SCAN_SET_CHANNEL,
 	SCAN_SEND_PROBE,
+	SCAN_CHECK_CHANNEL,
 	SCAN_SUSPEND,
 	SCAN_RESUME,
 };
 
+/**
+ * struct ieee80211_scan_chan_stats - software scan statistics of a channel
+ *
+ * @visits: number of times the channel was scanned
+ * @idle: number of visits cut short because nothing was received
+ * @dwell: total time spent on the channel, in jiffies
+ * @rx_frames: frames received while on the channel
+ */
+struct ieee80211_scan_chan_stats {
+	u32 visits;
+	u32 idle;
+	unsigned long dwell;
+	u32 rx_frames;
+};
+
 struct ieee80211_local {
 	/* embed the driver visible part.
 	 * don't cast (use the static inlines below), but we keep
@@ -932,15 +1028,63 @@ struct ieee80211_local {
 	struct timer_list sta_cleanup;
 	int sta_generation;
 
+	/*
+	 * Stations with PS-buffered or filtered frames, so that purging
+	 * and expiring those doesn't need to walk all stations; stations
+	 * are taken off lazily once their buffers are empty. The list is
+	 * ordered by the stations' ps_deadline, the sta_cleanup timer is
+	 * armed for the first one.
+	 */
+	spinlock_t ps_sta_lock;
+	struct list_head ps_sta_list;
+	unsigned int ps_sta_count;
+
+	/* PS buffer statistics */
+	int ps_buffered_peak;
+	unsigned long ps_expired, ps_purged;
+
 	struct sk_buff_head pending[IEEE80211_MAX_QUEUES];
+	/* protected by queue_stop_reason_lock, like pending */
+	struct ieee80211_codel_vars pending_cvars[IEEE80211_MAX_QUEUES];
 	struct tasklet_struct tx_pending_tasklet;
 
+	/* stations holding frames for A-MSDU aggregation */
+	spinlock_t amsdu_lock;
+	struct list_head amsdu_list;
+	struct tasklet_struct amsdu_tasklet;
+
+	/*
+	 * Stations with frames on their per-TID TX queues, per AC, in
+	 * airtime round-robin order; only used with wake_tx_queue().
+	 */
+	spinlock_t txq_lock;
+	struct list_head active_txqs[IEEE80211_NUM_ACS];
+	int txq_len[IEEE80211_NUM_ACS];
+
 	atomic_t agg_queue_stop[IEEE80211_MAX_QUEUES];
 
+	/*
+	 * TX aggregation policy: minimum per-TID frame rate to start a
+	 * session, session idle timeout (in TUs) and statistics.
+	 */
+	u32 agg_min_pps, agg_idle_timeout;
+	atomic_t agg_tx_sessions;
+	unsigned long agg_tx_denied, agg_tx_failed, agg_tx_idle;
+	unsigned long agg_tx_setups, agg_tx_setup_time, agg_tx_setup_max;
+
+	/* shared RCU sync for TX aggregation session setup, see agg-tx.c */
+	spinlock_t agg_start_lock;
+	struct rcu_head agg_start_rcu;
+	bool agg_start_rcu_pending, agg_start_want_more, agg_start_kick;
+	u32 agg_start_gen, agg_start_synced;
+	struct work_struct agg_start_work;
+
 	/* number of interfaces with corresponding IFF_ flags */
 	atomic_t iff_allmultis, iff_promiscs;
 
 	struct rate_control_ref *rate_ctrl;
+	/* additional instances selected at runtime, protected by RTNL */
+	struct list_head rate_ctrl_list;
 
 	struct crypto_cipher *wep_tx_tfm;
 	struct crypto_cipher *wep_rx_tfm;
@@ -956,6 +1100,15 @@ struct ieee80211_local {
 	 */
 	struct mutex key_mtx;
 
+	/*
+	 * Keys waiting to be removed from the hardware and freed once an
+	 * RCU grace period has passed since they were unlinked, see key.c
+	 */
+	spinlock_t key_free_lock;
+	struct list_head key_free_list;
+	struct work_struct key_free_work;
+	atomic_t key_free_pending;
+
 	/* mutex for scan and work locking */
 	struct mutex mtx;
 
@@ -974,6 +1127,10 @@ struct ieee80211_local {
 	struct work_struct sched_scan_stopped_work;
 
 	unsigned long leave_oper_channel_time;
+	unsigned long scan_channel_time;
+	unsigned int scan_rx_frames;
+	unsigned int scan_off_channel_count;
+	struct ieee80211_scan_chan_stats *scan_chan_stats;
 	enum mac80211_scan_state next_scan_state;
 	struct delayed_work scan_work;
 	struct ieee80211_sub_if_data *scan_sdata;
@@ -996,6 +1153,14 @@ struct ieee80211_local {
 	u32 dot11MulticastReceivedFrameCount;
 	u32 dot11TransmittedFrameCount;
 
+	/*
+	 * RX frames handed to monitor and additional virtual interfaces
+	 * as shared clones, and the copies the RX handlers still had to
+	 * make of them because they needed to modify the data.
+	 */
+	unsigned int rx_shared_skbs;
+	unsigned int rx_cow_copies;
+
 #ifdef CONFIG_MAC80211_LEDS
 	int tx_led_counter, rx_led_counter;
 	struct led_trigger *tx_led, *rx_led, *assoc_led, *radio_led;
@@ -1022,7 +1187,6 @@ struct ieee80211_local {
 	unsigned int tx_expand_skb_head;
 	unsigned int tx_expand_skb_head_cloned;
 	unsigned int rx_expand_skb_head;
-	unsigned int rx_expand_skb_head2;
 	unsigned int rx_handlers_fragments;
 	unsigned int tx_status_drop;
 #define I802_DEBUG_INC(c) (c)++
@@ -1066,7 +1230,6 @@ struct ieee80211_local {
 
 #ifdef CONFIG_MAC80211_DEBUGFS
 	struct local_debugfsdentries {
-		struct dentry *rcdir;
 		struct dentry *keys;
 	} debugfs;
 #endif
@@ -1095,6 +1258,42 @@ IEEE80211_DEV_TO_SUB_IF(struct net_device *dev)
 	return netdev_priv(dev);
 }
 
+static inline void ieee80211_sdata_rx_stats(struct ieee80211_sub_if_data *sdata,
+					    unsigned int len)
+{
+	struct ieee80211_pcpu_netstats *stats = this_cpu_ptr(sdata->pcpu_stats);
+
+	u64_stats_update_begin(&stats->syncp);
+	stats->rx_packets++;
+	stats->rx_bytes += len;
+	u64_stats_update_end(&stats->syncp);
+}
+
+static inline void ieee80211_sdata_tx_stats(struct ieee80211_sub_if_data *sdata,
+					    unsigned int len)
+{
+	struct ieee80211_pcpu_netstats *stats = this_cpu_ptr(sdata->pcpu_stats);
+
+	u64_stats_update_begin(&stats->syncp);
+	stats->tx_packets++;
+	stats->tx_bytes += len;
+	u64_stats_update_end(&stats->syncp);
+}
+
+static inline void
+ieee80211_sdata_mc2uc_stats(struct ieee80211_sub_if_data *sdata,
+			    unsigned int copies, u32 mc_dur, u32 uc_dur)
+{
+	struct ieee80211_pcpu_netstats *stats = this_cpu_ptr(sdata->pcpu_stats);
+
+	u64_stats_update_begin(&stats->syncp);
+	stats->mc2uc_frames++;
+	stats->mc2uc_copies += copies;
+	stats->mc2uc_airtime_mc += mc_dur;
+	stats->mc2uc_airtime_uc += uc_dur;
+	u64_stats_update_end(&stats->syncp);
+}
+
 /* this struct represents 802.11n's RA/TID combination */
 struct ieee80211_ra_tid {
 	u8 ra[ETH_ALEN];
@@ -1246,6 +1445,9 @@ int ieee80211_request_scan(struct ieee80211_sub_if_data *sdata,
 void ieee80211_scan_cancel(struct ieee80211_local *local);
 ieee80211_rx_result
 ieee80211_scan_rx(struct ieee80211_sub_if_data *sdata, struct sk_buff *skb);
+struct ieee80211_scan_chan_stats *
+ieee80211_scan_get_chan_stats(struct ieee80211_local *local,
+			      struct ieee80211_channel *chan);
 
 void ieee80211_mlme_notify_scan_completed(struct ieee80211_local *local);
 struct ieee80211_bss *
@@ -1289,6 +1491,7 @@ u32 __ieee80211_recalc_idle(struct ieee80211_local *local);
 void ieee80211_recalc_idle(struct ieee80211_local *local);
 void ieee80211_adjust_monitor_flags(struct ieee80211_sub_if_data *sdata,
 				    const int offset);
+void ieee80211_fragment_purge(struct ieee80211_sub_if_data *sdata);
 
 static inline bool ieee80211_sdata_running(struct ieee80211_sub_if_data *sdata)
 {
@@ -1298,6 +1501,12 @@ static inline bool ieee80211_sdata_running(struct ieee80211_sub_if_data *sdata)
 /* tx handling */
 void ieee80211_clear_tx_pending(struct ieee80211_local *local);
 void ieee80211_tx_pending(unsigned long data);
+void ieee80211_amsdu_tasklet(unsigned long data);
+void ieee80211_sta_amsdu_purge(struct sta_info *sta);
+void ieee80211_sta_txq_purge(struct sta_info *sta);
+void ieee80211_sta_txq_ps_start(struct sta_info *sta);
+void ieee80211_sta_txq_wakeup(struct sta_info *sta);
+void ieee80211_sta_register_airtime(struct sta_info *sta, u8 ac, u32 airtime);
 netdev_tx_t ieee80211_monitor_start_xmit(struct sk_buff *skb,
 					 struct net_device *dev);
 netdev_tx_t ieee80211_subif_start_xmit(struct sk_buff *skb,
@@ -1346,6 +1555,11 @@ void ieee80211_start_tx_ba_cb(struct ieee80211_vif *vif, u8 *ra, u16 tid);
 void ieee80211_stop_tx_ba_cb(struct ieee80211_vif *vif, u8 *ra, u8 tid);
 void ieee80211_ba_session_work(struct work_struct *work);
 void ieee80211_tx_ba_session_handle_start(struct sta_info *sta, int tid);
+bool ieee80211_tx_ba_session_handle_synced(struct sta_info *sta, int tid);
+void ieee80211_agg_start_work(struct work_struct *work);
+void ieee80211_agg_start_restart(struct ieee80211_local *local);
+void ieee80211_agg_tx_policy(struct sta_info *sta, int tid,
+			     struct sk_buff *skb);
 void ieee80211_release_reorder_timeout(struct sta_info *sta, int tid);
 
 /* Spectrum management */
@@ -1390,6 +1604,12 @@ u8 *ieee80211_get_bssid(struct ieee80211_hdr *hdr, size_t len,
 			enum nl80211_iftype type);
 int ieee80211_frame_duration(struct ieee80211_local *local, size_t len,
 			     int rate, int erp, int short_preamble);
+int ieee80211_tx_rate_duration(struct ieee80211_local *local,
+			       struct ieee80211_supported_band *sband,
+			       const struct ieee80211_tx_rate *r, size_t len);
+u32 ieee80211_tx_airtime(struct ieee80211_local *local,
+			 struct ieee80211_supported_band *sband,
+			 struct sk_buff *skb);
 void mac80211_ev_michael_mic_failure(struct ieee80211_sub_if_data *sdata, int keyidx,
 				     struct ieee80211_hdr *hdr, const u8 *tsc,
 				     gfp_t gfp);
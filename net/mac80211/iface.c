@@ -641,16 +641,13 @@ static void ieee80211_teardown_sdata(struct net_device *dev)
 	struct ieee80211_sub_if_data *sdata = IEEE80211_DEV_TO_SUB_IF(dev);
 	struct ieee80211_local *local = sdata->local;
 	int flushed;
-	int i;
 
 	/* free extra data */
 	ieee80211_free_keys(sdata);
 
 	ieee80211_debugfs_remove_netdev(sdata);
 
-	for (i = 0; i < IEEE80211_FRAGMENT_MAX; i++)
-		__skb_queue_purge(&sdata->fragments[i].skb_list);
-	sdata->fragment_next = 0;
+	ieee80211_fragment_purge(sdata);
 
 	if (ieee80211_vif_is_mesh(&sdata->vif))
 		mesh_rmc_free(sdata);
@@ -667,6 +664,41 @@ static u16 ieee80211_netdev_select_queue(struct net_device *dev,
 	return ieee80211_select_queue(IEEE80211_DEV_TO_SUB_IF(dev), skb);
 }
 
+static struct net_device_stats *ieee80211_get_stats(struct net_device *dev)
+{
+	struct ieee80211_sub_if_data *sdata = IEEE80211_DEV_TO_SUB_IF(dev);
+	u64 rx_packets = 0, rx_bytes = 0, tx_packets = 0, tx_bytes = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		const struct ieee80211_pcpu_netstats *stats;
+		u64 rxp, rxb, txp, txb;
+		unsigned int start;
+
+		stats = per_cpu_ptr(sdata->pcpu_stats, cpu);
+		do {
+			start = u64_stats_fetch_begin_bh(&stats->syncp);
+			rxp = stats->rx_packets;
+			rxb = stats->rx_bytes;
+			txp = stats->tx_packets;
+			txb = stats->tx_bytes;
+		} while (u64_stats_fetch_retry_bh(&stats->syncp, start));
+
+		rx_packets += rxp;
+		rx_bytes += rxb;
+		tx_packets += txp;
+		tx_bytes += txb;
+	}
+
+	/* the drop and error counters are still kept in dev->stats */
+	dev->stats.rx_packets = rx_packets;
+	dev->stats.rx_bytes = rx_bytes;
+	dev->stats.tx_packets = tx_packets;
+	dev->stats.tx_bytes = tx_bytes;
+
+	return &dev->stats;
+}
+
 static const struct net_device_ops ieee80211_dataif_ops = {
 	.ndo_open		= ieee80211_open,
 	.ndo_stop		= ieee80211_stop,
@@ -676,6 +708,7 @@ static const struct net_device_ops ieee80211_dataif_ops = {
 	.ndo_change_mtu 	= ieee80211_change_mtu,
 	.ndo_set_mac_address 	= ieee80211_change_mac,
 	.ndo_select_queue	= ieee80211_netdev_select_queue,
+	.ndo_get_stats		= ieee80211_get_stats,
 };
 
 static u16 ieee80211_monitor_select_queue(struct net_device *dev,
@@ -707,8 +740,15 @@ static const struct net_device_ops ieee80211_monitorif_ops = {
 	.ndo_change_mtu 	= ieee80211_change_mtu,
 	.ndo_set_mac_address 	= eth_mac_addr,
 	.ndo_select_queue	= ieee80211_monitor_select_queue,
+	.ndo_get_stats		= ieee80211_get_stats,
 };
 
+static void ieee80211_if_free(struct net_device *dev)
+{
+	free_percpu(IEEE80211_DEV_TO_SUB_IF(dev)->pcpu_stats);
+	free_netdev(dev);
+}
+
 static void ieee80211_if_setup(struct net_device *dev)
 {
 	ether_setup(dev);
@@ -719,7 +759,7 @@ static void ieee80211_if_setup(struct net_device *dev)
 	/* we will validate the address ourselves in ->open */
 	dev->validate_addr = NULL;
 #endif
-	dev->destructor = free_netdev;
+	dev->destructor = ieee80211_if_free;
 }
 
 static void ieee80211_iface_work(struct work_struct *work)
@@ -1180,6 +1220,12 @@ int ieee80211_if_add(struct ieee80211_local *local, const char *name,
 	/* don't use IEEE80211_DEV_TO_SUB_IF because it checks too much */
 	sdata = netdev_priv(ndev);
 	ndev->ieee80211_ptr = &sdata->wdev;
+
+	sdata->pcpu_stats = alloc_percpu(struct ieee80211_pcpu_netstats);
+	if (!sdata->pcpu_stats) {
+		ret = -ENOMEM;
+		goto fail;
+	}
 	memcpy(sdata->vif.addr, ndev->dev_addr, ETH_ALEN);
 	memcpy(sdata->name, ndev->name, IFNAMSIZ);
 
@@ -1191,10 +1237,13 @@ int ieee80211_if_add(struct ieee80211_local *local, const char *name,
 	sdata->arp_filter_state = true;
 #endif
 
-	for (i = 0; i < IEEE80211_FRAGMENT_MAX; i++)
-		skb_queue_head_init(&sdata->fragments[i].skb_list);
+	for (i = 0; i < IEEE80211_FRAGMENT_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&sdata->fragments[i]);
+	INIT_LIST_HEAD(&sdata->fragment_lru);
 
 	INIT_LIST_HEAD(&sdata->key_list);
+	INIT_DELAYED_WORK(&sdata->dec_tailroom_needed_wk,
+			  ieee80211_delayed_tailroom_dec);
 
 	for (i = 0; i < IEEE80211_NUM_BANDS; i++) {
 		struct ieee80211_supported_band *sband;
@@ -1233,6 +1282,8 @@ int ieee80211_if_add(struct ieee80211_local *local, const char *name,
 	return 0;
 
  fail:
+	if (sdata)
+		free_percpu(sdata->pcpu_stats);
 	free_netdev(ndev);
 	return ret;
 }
@@ -48,7 +48,13 @@
  * references, protected by RCU. Note, however, that some things are
  * unprotected, namely the key->sta dereferences within the hardware
  * acceleration functions. This means that sta_info_destroy() must
- * remove the key which waits for an RCU grace period.
+ * remove the keys before the station itself is freed.
+ *
+ * A key is only removed from the hardware and freed after an RCU grace
+ * period, as the TX path may still be about to hand a frame using it
+ * to the driver. Rather than waiting for that with the key mutex held,
+ * unlinked keys are passed to an RCU callback which has a work item
+ * destroy them; keys that go away together share one callback.
  */
 
 static const u8 bcast_addr[ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
@@ -62,30 +68,14 @@ static void increment_tailroom_need_count(struct ieee80211_sub_if_data *sdata)
 {
 	/*
 	 * When this count is zero, SKB resizing for allocating tailroom
-	 * for IV or MMIC is skipped. But, this check has created two race
-	 * cases in xmit path while transiting from zero count to one:
-	 *
-	 * 1. SKB resize was skipped because no key was added but just before
-	 * the xmit key is added and SW encryption kicks off.
-	 *
-	 * 2. SKB resize was skipped because all the keys were hw planted but
-	 * just before xmit one of the key is deleted and SW encryption kicks
-	 * off.
-	 *
-	 * In both the above case SW encryption will find not enough space for
-	 * tailroom and exits with WARN_ON. (See WARN_ONs at wpa.c)
-	 *
-	 * Solution has been explained at
-	 * http://mid.gmane.org/1308590980.4322.19.camel@jlt3.sipsolutions.net
+	 * for IV or MMIC is skipped. Frames that were resized while it
+	 * was still zero may then reach SW encryption when the count goes
+	 * from zero to one, either because a key was just added or because
+	 * a key was just removed from the hardware. Rather than flushing
+	 * the TX path here, ieee80211_tx_h_select_key() makes room for
+	 * those few frames.
 	 */
-
-	if (!sdata->crypto_tx_tailroom_needed_cnt++) {
-		/*
-		 * Flush all XMIT packets currently using HW encryption or no
-		 * encryption at all if the count transition is from 0 -> 1.
-		 */
-		synchronize_net();
-	}
+	sdata->crypto_tx_tailroom_needed_cnt++;
 }
 
 static int ieee80211_key_enable_hw_accel(struct ieee80211_key *key)
@@ -416,45 +406,129 @@ struct ieee80211_key *ieee80211_key_alloc(u32 cipher, int idx, size_t key_len,
 	return key;
 }
 
+/*
+ * Remove the key from the hardware and free it. The key must have been
+ * unlinked and an RCU grace period must have passed since, so that the
+ * TX/RX paths can no longer be using it.
+ */
 static void __ieee80211_key_destroy(struct ieee80211_key *key)
 {
+	struct ieee80211_sub_if_data *sdata;
+
 	if (!key)
 		return;
 
-	/*
-	 * Synchronize so the TX path can no longer be using
-	 * this key before we free/remove it.
-	 */
-	synchronize_rcu();
+	if (key->local) {
+		sdata = key->sdata;
 
-	if (key->local)
 		ieee80211_key_disable_hw_accel(key);
+		ieee80211_debugfs_key_remove(key);
+
+		/* see ieee80211_delayed_tailroom_dec() */
+		sdata->crypto_tx_tailroom_pending_dec++;
+		schedule_delayed_work(&sdata->dec_tailroom_needed_wk, HZ / 2);
+	}
 
 	if (key->conf.cipher == WLAN_CIPHER_SUITE_CCMP)
 		ieee80211_aes_key_free(key->u.ccmp.tfm);
 	if (key->conf.cipher == WLAN_CIPHER_SUITE_AES_CMAC)
 		ieee80211_aes_cmac_key_free(key->u.aes_cmac.tfm);
-	if (key->local) {
-		ieee80211_debugfs_key_remove(key);
-		key->sdata->crypto_tx_tailroom_needed_cnt--;
-	}
 
 	kfree(key);
 }
 
-int ieee80211_key_link(struct ieee80211_key *key,
-		       struct ieee80211_sub_if_data *sdata,
-		       struct sta_info *sta)
+/* unlink the key so that it can no longer be found */
+static void __ieee80211_key_unlink(struct ieee80211_key *key)
 {
-	struct ieee80211_key *old_key;
-	int idx, ret;
-	bool pairwise;
+	/*
+	 * Replace key with nothingness if it was ever used.
+	 */
+	if (key->sdata)
+		__ieee80211_key_replace(key->sdata, key->sta,
+				key->conf.flags & IEEE80211_KEY_FLAG_PAIRWISE,
+				key, NULL);
+}
 
-	BUG_ON(!sdata);
-	BUG_ON(!key);
+static void ieee80211_key_free_rcu(struct rcu_head *head)
+{
+	struct ieee80211_key *key =
+		container_of(head, struct ieee80211_key, rcu_head);
+	struct ieee80211_local *local = key->local;
 
-	pairwise = key->conf.flags & IEEE80211_KEY_FLAG_PAIRWISE;
-	idx = key->conf.keyidx;
+	/* the other keys of the batch are on this key's list */
+	spin_lock_bh(&local->key_free_lock);
+	list_splice_tail_init(&key->list, &local->key_free_list);
+	list_add_tail(&key->list, &local->key_free_list);
+	spin_unlock_bh(&local->key_free_lock);
+
+	schedule_work(&local->key_free_work);
+}
+
+/*
+ * Destroy the unlinked keys on @keys once an RCU grace period has
+ * passed, without waiting for it. All keys share a single RCU callback.
+ */
+static void ieee80211_key_defer_free(struct ieee80211_local *local,
+				     struct list_head *keys)
+{
+	struct ieee80211_key *key, *first;
+
+	if (list_empty(keys))
+		return;
+
+	list_for_each_entry(key, keys, list)
+		atomic_inc(&local->key_free_pending);
+
+	first = list_first_entry(keys, struct ieee80211_key, list);
+	list_del_init(&first->list);
+	list_splice_init(keys, &first->list);
+
+	call_rcu(&first->rcu_head, ieee80211_key_free_rcu);
+}
+
+void ieee80211_key_free_work(struct work_struct *wk)
+{
+	struct ieee80211_local *local =
+		container_of(wk, struct ieee80211_local, key_free_work);
+	struct ieee80211_key *key, *tmp;
+	LIST_HEAD(keys);
+
+	spin_lock_bh(&local->key_free_lock);
+	list_splice_init(&local->key_free_list, &keys);
+	spin_unlock_bh(&local->key_free_lock);
+
+	mutex_lock(&local->key_mtx);
+	list_for_each_entry_safe(key, tmp, &keys, list) {
+		__ieee80211_key_destroy(key);
+		atomic_dec(&local->key_free_pending);
+	}
+	mutex_unlock(&local->key_mtx);
+}
+
+/**
+ * ieee80211_flush_freed_keys - wait for keys being freed to be destroyed
+ *
+ * Keys refer to their interface and station until they're destroyed,
+ * which must therefore not go away while any keys are still waiting
+ * for their grace period. Must not be called with the key mutex held.
+ *
+ * @local: the local data
+ */
+void ieee80211_flush_freed_keys(struct ieee80211_local *local)
+{
+	might_sleep();
+
+	if (!atomic_read(&local->key_free_pending))
+		return;
+
+	rcu_barrier();
+	flush_work(&local->key_free_work);
+}
+
+static void ieee80211_key_prepare_link(struct ieee80211_key *key,
+				       struct ieee80211_sub_if_data *sdata,
+				       struct sta_info *sta)
+{
 	key->local = sdata->local;
 	key->sdata = sdata;
 	key->sta = sta;
@@ -484,43 +558,103 @@ int ieee80211_key_link(struct ieee80211_key *key,
 			}
 		}
 	}
+}
 
-	mutex_lock(&sdata->local->key_mtx);
+/**
+ * ieee80211_key_link_multi - install several keys at once
+ *
+ * Each key replaces the key with the same index, if any. The keys that
+ * were replaced are freed together after a single RCU grace period, so
+ * that e.g. replacing all group keys of an interface costs no more than
+ * replacing one of them. All keys are linked even if some of them can
+ * be used neither by the hardware nor in software; an error is returned
+ * then and the caller must free the keys.
+ *
+ * @keys: the keys to install
+ * @n_keys: number of keys
+ * @sdata: the interface the keys are for
+ * @sta: the station the keys are for, %NULL for interface keys
+ */
+int ieee80211_key_link_multi(struct ieee80211_key **keys, int n_keys,
+			     struct ieee80211_sub_if_data *sdata,
+			     struct sta_info *sta)
+{
+	struct ieee80211_local *local;
+	struct ieee80211_key *key, *old_key;
+	LIST_HEAD(old_keys);
+	int i, idx, err, ret = 0;
+	bool pairwise;
 
-	if (sta && pairwise)
-		old_key = key_mtx_dereference(sdata->local, sta->ptk);
-	else if (sta)
-		old_key = key_mtx_dereference(sdata->local, sta->gtk[idx]);
-	else
-		old_key = key_mtx_dereference(sdata->local, sdata->keys[idx]);
+	BUG_ON(!sdata);
+	BUG_ON(!keys);
 
-	increment_tailroom_need_count(sdata);
+	local = sdata->local;
 
-	__ieee80211_key_replace(sdata, sta, pairwise, old_key, key);
-	__ieee80211_key_destroy(old_key);
+	for (i = 0; i < n_keys; i++) {
+		BUG_ON(!keys[i]);
+		ieee80211_key_prepare_link(keys[i], sdata, sta);
+	}
 
-	ieee80211_debugfs_key_add(key);
+	mutex_lock(&local->key_mtx);
 
-	ret = ieee80211_key_enable_hw_accel(key);
+	for (i = 0; i < n_keys; i++) {
+		key = keys[i];
+		pairwise = key->conf.flags & IEEE80211_KEY_FLAG_PAIRWISE;
+		idx = key->conf.keyidx;
 
-	mutex_unlock(&sdata->local->key_mtx);
+		if (sta && pairwise)
+			old_key = key_mtx_dereference(local, sta->ptk);
+		else if (sta)
+			old_key = key_mtx_dereference(local, sta->gtk[idx]);
+		else
+			old_key = key_mtx_dereference(local, sdata->keys[idx]);
+
+		increment_tailroom_need_count(sdata);
+
+		__ieee80211_key_replace(sdata, sta, pairwise, old_key, key);
+		if (old_key)
+			list_add_tail(&old_key->list, &old_keys);
+
+		ieee80211_debugfs_key_add(key);
+
+		err = ieee80211_key_enable_hw_accel(key);
+		if (err)
+			ret = err;
+	}
+
+	/* the TX path may still be using the old keys */
+	ieee80211_key_defer_free(local, &old_keys);
+
+	mutex_unlock(&local->key_mtx);
 
 	return ret;
 }
 
+int ieee80211_key_link(struct ieee80211_key *key,
+		       struct ieee80211_sub_if_data *sdata,
+		       struct sta_info *sta)
+{
+	BUG_ON(!key);
+
+	return ieee80211_key_link_multi(&key, 1, sdata, sta);
+}
+
 void __ieee80211_key_free(struct ieee80211_key *key)
 {
+	LIST_HEAD(keys);
+
 	if (!key)
 		return;
 
-	/*
-	 * Replace key with nothingness if it was ever used.
-	 */
-	if (key->sdata)
-		__ieee80211_key_replace(key->sdata, key->sta,
-				key->conf.flags & IEEE80211_KEY_FLAG_PAIRWISE,
-				key, NULL);
-	__ieee80211_key_destroy(key);
+	/* a key that was never linked can't be in use */
+	if (!key->sdata) {
+		__ieee80211_key_destroy(key);
+		return;
+	}
+
+	__ieee80211_key_unlink(key);
+	list_add_tail(&key->list, &keys);
+	ieee80211_key_defer_free(key->local, &keys);
 }
 
 void ieee80211_key_free(struct ieee80211_local *local,
@@ -543,6 +677,7 @@ void ieee80211_enable_keys(struct ieee80211_sub_if_data *sdata)
 	mutex_lock(&sdata->local->key_mtx);
 
 	sdata->crypto_tx_tailroom_needed_cnt = 0;
+	sdata->crypto_tx_tailroom_pending_dec = 0;
 
 	list_for_each_entry(key, &sdata->key_list, list) {
 		increment_tailroom_need_count(sdata);
@@ -602,17 +737,83 @@ void ieee80211_disable_keys(struct ieee80211_sub_if_data *sdata)
 void ieee80211_free_keys(struct ieee80211_sub_if_data *sdata)
 {
 	struct ieee80211_key *key, *tmp;
+	LIST_HEAD(keys);
 
 	mutex_lock(&sdata->local->key_mtx);
 
 	ieee80211_debugfs_key_remove_mgmt_default(sdata);
 
-	list_for_each_entry_safe(key, tmp, &sdata->key_list, list)
-		__ieee80211_key_free(key);
+	/* unlink all keys first so they only need one grace period */
+	list_for_each_entry_safe(key, tmp, &sdata->key_list, list) {
+		__ieee80211_key_unlink(key);
+		list_add_tail(&key->list, &keys);
+	}
+
+	ieee80211_key_defer_free(sdata->local, &keys);
 
 	ieee80211_debugfs_key_update_default(sdata);
 
 	mutex_unlock(&sdata->local->key_mtx);
+
+	/* the keys still refer to the interface until they're destroyed */
+	ieee80211_flush_freed_keys(sdata->local);
+
+	/* no need to delay the decrement, all keys are gone */
+	if (cancel_delayed_work_sync(&sdata->dec_tailroom_needed_wk))
+		ieee80211_delayed_tailroom_dec(
+				&sdata->dec_tailroom_needed_wk.work);
+}
+
+/**
+ * ieee80211_free_sta_keys - free the keys of a station being destroyed
+ *
+ * @local: the local data
+ * @sta: the station, which must have been unlinked an RCU grace period
+ *	ago so that its keys can no longer be found through it
+ */
+void ieee80211_free_sta_keys(struct ieee80211_local *local,
+			     struct sta_info *sta)
+{
+	struct ieee80211_key *key;
+	int i;
+
+	mutex_lock(&local->key_mtx);
+	for (i = 0; i < NUM_DEFAULT_KEYS; i++) {
+		key = key_mtx_dereference(local, sta->gtk[i]);
+		if (!key)
+			continue;
+		__ieee80211_key_unlink(key);
+		__ieee80211_key_destroy(key);
+	}
+
+	key = key_mtx_dereference(local, sta->ptk);
+	if (key) {
+		__ieee80211_key_unlink(key);
+		__ieee80211_key_destroy(key);
+	}
+	mutex_unlock(&local->key_mtx);
+}
+
+void ieee80211_delayed_tailroom_dec(struct work_struct *wk)
+{
+	struct ieee80211_sub_if_data *sdata;
+
+	sdata = container_of(wk, struct ieee80211_sub_if_data,
+			     dec_tailroom_needed_wk.work);
+
+	/*
+	 * The tailroom count is decremented only a while after a software
+	 * key was removed. When a key is replaced during rekeying, the new
+	 * key is then added while the count is still non-zero, and the
+	 * TX path keeps reserving tailroom instead of having to make room
+	 * for software encryption after the 0 -> 1 transition in
+	 * increment_tailroom_need_count().
+	 */
+	mutex_lock(&sdata->local->key_mtx);
+	sdata->crypto_tx_tailroom_needed_cnt -=
+		sdata->crypto_tx_tailroom_pending_dec;
+	sdata->crypto_tx_tailroom_pending_dec = 0;
+	mutex_unlock(&sdata->local->key_mtx);
 }
 
 
@@ -67,9 +67,12 @@ struct ieee80211_key {
 	struct ieee80211_sub_if_data *sdata;
 	struct sta_info *sta;
 
-	/* for sdata list */
+	/* for sdata list, or the list of keys waiting to be freed */
 	struct list_head list;
 
+	/* for freeing the key after an RCU grace period */
+	struct rcu_head rcu_head;
+
 	/* protected by key mutex */
 	unsigned int flags;
 
@@ -133,6 +136,10 @@ struct ieee80211_key *ieee80211_key_alloc(u32 cipher, int idx, size_t key_len,
 int __must_check ieee80211_key_link(struct ieee80211_key *key,
 				    struct ieee80211_sub_if_data *sdata,
 				    struct sta_info *sta);
+int __must_check ieee80211_key_link_multi(struct ieee80211_key **keys,
+					  int n_keys,
+					  struct ieee80211_sub_if_data *sdata,
+					  struct sta_info *sta);
 void __ieee80211_key_free(struct ieee80211_key *key);
 void ieee80211_key_free(struct ieee80211_local *local,
 			struct ieee80211_key *key);
@@ -141,8 +148,13 @@ void ieee80211_set_default_key(struct ieee80211_sub_if_data *sdata, int idx,
 void ieee80211_set_default_mgmt_key(struct ieee80211_sub_if_data *sdata,
 				    int idx);
 void ieee80211_free_keys(struct ieee80211_sub_if_data *sdata);
+void ieee80211_free_sta_keys(struct ieee80211_local *local,
+			     struct sta_info *sta);
 void ieee80211_enable_keys(struct ieee80211_sub_if_data *sdata);
 void ieee80211_disable_keys(struct ieee80211_sub_if_data *sdata);
+void ieee80211_delayed_tailroom_dec(struct work_struct *wk);
+void ieee80211_key_free_work(struct work_struct *wk);
+void ieee80211_flush_freed_keys(struct ieee80211_local *local);
 
 #define key_mtx_dereference(local, ref) \
 	rcu_dereference_protected(ref, lockdep_is_held(&((local)->key_mtx)))
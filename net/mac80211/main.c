@@ -599,6 +599,7 @@ struct ieee80211_hw *ieee80211_alloc_hw(size_t priv_data_len,
 	wiphy->ht_capa_mod_mask = &mac80211_ht_capa_mod_mask;
 
 	INIT_LIST_HEAD(&local->interfaces);
+	INIT_LIST_HEAD(&local->rate_ctrl_list);
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,35))
 
 	__hw_addr_init(&local->mc_list);
@@ -608,6 +609,9 @@ struct ieee80211_hw *ieee80211_alloc_hw(size_t priv_data_len,
 	mutex_init(&local->mtx);
 
 	mutex_init(&local->key_mtx);
+	spin_lock_init(&local->key_free_lock);
+	INIT_LIST_HEAD(&local->key_free_list);
+	INIT_WORK(&local->key_free_work, ieee80211_key_free_work);
 	spin_lock_init(&local->filter_lock);
 	spin_lock_init(&local->queue_stop_reason_lock);
 
@@ -652,9 +656,24 @@ struct ieee80211_hw *ieee80211_alloc_hw(size_t priv_data_len,
 		skb_queue_head_init(&local->pending[i]);
 		atomic_set(&local->agg_queue_stop[i], 0);
 	}
+
+	local->agg_min_pps = HT_AGG_DEFAULT_MIN_PPS;
+	local->agg_idle_timeout = HT_AGG_DEFAULT_IDLE_TIMEOUT;
+	atomic_set(&local->agg_tx_sessions, 0);
+	spin_lock_init(&local->agg_start_lock);
+	INIT_WORK(&local->agg_start_work, ieee80211_agg_start_work);
 	tasklet_init(&local->tx_pending_tasklet, ieee80211_tx_pending,
 		     (unsigned long)local);
 
+	spin_lock_init(&local->amsdu_lock);
+	INIT_LIST_HEAD(&local->amsdu_list);
+	tasklet_init(&local->amsdu_tasklet, ieee80211_amsdu_tasklet,
+		     (unsigned long)local);
+
+	spin_lock_init(&local->txq_lock);
+	for (i = 0; i < IEEE80211_NUM_ACS; i++)
+		INIT_LIST_HEAD(&local->active_txqs[i]);
+
 	tasklet_init(&local->tasklet,
 		     ieee80211_tasklet_handler,
 		     (unsigned long) local);
@@ -736,6 +755,14 @@ int ieee80211_register_hw(struct ieee80211_hw *hw)
 	if (!local->int_scan_req)
 		return -ENOMEM;
 
+	local->scan_chan_stats = kcalloc(channels,
+					 sizeof(*local->scan_chan_stats),
+					 GFP_KERNEL);
+	if (!local->scan_chan_stats) {
+		kfree(local->int_scan_req);
+		return -ENOMEM;
+	}
+
 	for (band = 0; band < IEEE80211_NUM_BANDS; band++) {
 		if (!local->hw.wiphy->bands[band])
 			continue;
@@ -974,6 +1001,7 @@ int ieee80211_register_hw(struct ieee80211_hw *hw)
 	if (local->wiphy_ciphers_allocated)
 		kfree(local->hw.wiphy->cipher_suites);
 	kfree(local->int_scan_req);
+	kfree(local->scan_chan_stats);
 	return result;
 }
 EXPORT_SYMBOL(ieee80211_register_hw);
@@ -983,6 +1011,7 @@ void ieee80211_unregister_hw(struct ieee80211_hw *hw)
 	struct ieee80211_local *local = hw_to_local(hw);
 
 	tasklet_kill(&local->tx_pending_tasklet);
+	tasklet_kill(&local->amsdu_tasklet);
 	tasklet_kill(&local->tasklet);
 
 	pm_qos_remove_notifier(PM_QOS_NETWORK_LATENCY,
@@ -1008,6 +1037,11 @@ void ieee80211_unregister_hw(struct ieee80211_hw *hw)
 	 */
 	del_timer_sync(&local->work_timer);
 
+	/* the aggregation start and key free callbacks may still be pending */
+	rcu_barrier();
+	cancel_work_sync(&local->agg_start_work);
+	flush_work(&local->key_free_work);
+
 	cancel_work_sync(&local->restart_work);
 	cancel_work_sync(&local->reconfig_filter);
 
@@ -1027,6 +1061,7 @@ void ieee80211_unregister_hw(struct ieee80211_hw *hw)
 	ieee80211_wep_free(local);
 	ieee80211_led_exit(local);
 	kfree(local->int_scan_req);
+	kfree(local->scan_chan_stats);
 }
 EXPORT_SYMBOL(ieee80211_unregister_hw);
 
@@ -20,6 +20,7 @@
 #include <linux/rtnetlink.h>
 #include <linux/pm_qos.h>
 #include <linux/crc32.h>
+#include <linux/jhash.h>
 #include <linux/slab.h>
 #include <linux/export.h>
 #include <net/mac80211.h>
@@ -2321,6 +2322,52 @@ static const u64 care_about_ies =
 	(1ULL << WLAN_EID_HT_CAPABILITY) |
 	(1ULL << WLAN_EID_HT_INFORMATION);
 
+/*
+ * Digest the fixed beacon fields and all the elements except those
+ * that change from beacon to beacon anyway (TIM and BSS load), and
+ * find the TIM element on the way. This only hops over the elements
+ * and is a lot cheaper than ieee802_11_parse_elems_crc(), which then
+ * only needs to run when the digest changed.
+ */
+static u32 ieee80211_beacon_digest(struct ieee80211_mgmt *mgmt, size_t len,
+				   struct ieee80211_tim_ie **tim, u8 *tim_len)
+{
+	u8 *pos = mgmt->u.beacon.variable;
+	u8 *start = pos, *end = (u8 *)mgmt + len;
+	u32 digest;
+
+	*tim = NULL;
+	*tim_len = 0;
+
+	digest = jhash(&mgmt->u.beacon.beacon_int, 4, 0);
+
+	while (end - pos >= 2) {
+		u8 id = pos[0], elen = pos[1];
+
+		if (pos + 2 + elen > end)
+			break;
+
+		if (id == WLAN_EID_TIM || id == WLAN_EID_QBSS_LOAD) {
+			if (pos > start)
+				digest = jhash(start, pos - start, digest);
+			start = pos + 2 + elen;
+
+			if (id == WLAN_EID_TIM &&
+			    elen >= sizeof(struct ieee80211_tim_ie)) {
+				*tim = (void *)(pos + 2);
+				*tim_len = elen;
+			}
+		}
+
+		pos += 2 + elen;
+	}
+
+	if (end > start)
+		digest = jhash(start, end - start, digest);
+
+	return digest;
+}
+
 static void ieee80211_rx_mgmt_beacon(struct ieee80211_sub_if_data *sdata,
 				     struct ieee80211_mgmt *mgmt,
 				     size_t len,
@@ -2334,7 +2381,9 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_sub_if_data *sdata,
 	u32 changed = 0;
 	bool erp_valid, directed_tim = false;
 	u8 erp_value = 0;
-	u32 ncrc;
+	u32 ncrc, digest;
+	struct ieee80211_tim_ie *tim;
+	u8 tim_len;
 	u8 *bssid;
 
 	lockdep_assert_held(&ifmgd->mtx);
@@ -2448,14 +2497,23 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_sub_if_data *sdata,
 	 */
 	ieee80211_sta_reset_beacon_monitor(sdata);
 
-	ncrc = crc32_be(0, (void *)&mgmt->u.beacon.beacon_int, 4);
-	ncrc = ieee802_11_parse_elems_crc(mgmt->u.beacon.variable,
-					  len - baselen, &elems,
-					  care_about_ies, ncrc);
+	digest = ieee80211_beacon_digest(mgmt, len, &tim, &tim_len);
+
+	if (ifmgd->beacon_crc_valid && digest == ifmgd->beacon_digest) {
+		/* nothing covered by the CRC can have changed either */
+		ifmgd->beacons_filtered++;
+		ncrc = ifmgd->beacon_crc;
+	} else {
+		ifmgd->beacons_parsed++;
+		ncrc = crc32_be(0, (void *)&mgmt->u.beacon.beacon_int, 4);
+		ncrc = ieee802_11_parse_elems_crc(mgmt->u.beacon.variable,
+						  len - baselen, &elems,
+						  care_about_ies, ncrc);
+		ifmgd->beacon_digest = digest;
+	}
 
 	if (local->hw.flags & IEEE80211_HW_PS_NULLFUNC_STACK)
-		directed_tim = ieee80211_check_tim(elems.tim, elems.tim_len,
-						   ifmgd->aid);
+		directed_tim = ieee80211_check_tim(tim, tim_len, ifmgd->aid);
 
 	if (ncrc != ifmgd->beacon_crc || !ifmgd->beacon_crc_valid) {
 		ieee80211_rx_bss_info(sdata, mgmt, len, rx_status, &elems,
@@ -2492,6 +2550,7 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_sub_if_data *sdata,
 		return;
 	ifmgd->beacon_crc = ncrc;
 	ifmgd->beacon_crc_valid = true;
+	ifmgd->beacons_changed++;
 
 	if (elems.erp_info && elems.erp_info_len >= 1) {
 		erp_valid = true;
@@ -77,6 +77,7 @@ int __ieee80211_suspend(struct ieee80211_hw *hw, struct cfg80211_wowlan *wowlan)
 		int err = drv_suspend(local, wowlan);
 		if (err < 0) {
 			local->quiescing = false;
+			ieee80211_agg_start_restart(local);
 			return err;
 		} else if (err > 0) {
 			WARN_ON(err != 1);
@@ -90,7 +91,8 @@ int __ieee80211_suspend(struct ieee80211_hw *hw, struct cfg80211_wowlan *wowlan)
 		}
 	}
 
-	/* disable keys */
+	/* disable keys, including those still waiting to be freed */
+	ieee80211_flush_freed_keys(local);
 	list_for_each_entry(sdata, &local->interfaces, list)
 		ieee80211_disable_keys(sdata);
 
@@ -12,6 +12,7 @@
 #include <linux/rtnetlink.h>
 #include <linux/slab.h>
 #include <linux/module.h>
+#include <linux/relay.h>
 #include "rate.h"
 #include "ieee80211_i.h"
 #include "debugfs.h"
@@ -127,6 +128,21 @@ ieee80211_rate_control_ops_get(const char *name)
 	return ops;
 }
 
+/* Get exactly the requested algorithm, without falling back to another one. */
+static struct rate_control_ops *
+ieee80211_rate_control_ops_find(const char *name)
+{
+	struct rate_control_ops *ops;
+
+	ops = ieee80211_try_rate_control_ops_get(name);
+	if (!ops) {
+		request_module("rc80211_%s", name);
+		ops = ieee80211_try_rate_control_ops_get(name);
+	}
+
+	return ops;
+}
+
 static void ieee80211_rate_control_ops_put(struct rate_control_ops *ops)
 {
 	module_put(ops->module);
@@ -148,26 +164,103 @@ static const struct file_operations rcname_ops = {
 	.open = simple_open,
 	.llseek = default_llseek,
 };
+
+#ifdef CONFIG_RELAY
+/*
+ * Rate control decisions are streamed to userspace as binary
+ * struct nl80211_rate_stats_event records through the per-CPU
+ * relay files rc/events0, rc/events1, ...
+ */
+#define RC_EVENTS_SUBBUF_SIZE	(16 * 1024)
+#define RC_EVENTS_N_SUBBUFS	4
+
+static struct dentry *
+rc_events_create_buf_file(const char *filename, struct dentry *parent,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,3,0))
+			  umode_t mode,
+#else
+			  int mode,
 #endif
+			  struct rchan_buf *buf, int *is_global)
+{
+	return debugfs_create_file(filename, mode, parent, buf,
+				   &relay_file_operations);
+}
 
-static struct rate_control_ref *rate_control_alloc(const char *name,
-					    struct ieee80211_local *local)
+static int rc_events_remove_buf_file(struct dentry *dentry)
+{
+	debugfs_remove(dentry);
+	return 0;
+}
+
+static struct rchan_callbacks rc_events_cb = {
+	.create_buf_file = rc_events_create_buf_file,
+	.remove_buf_file = rc_events_remove_buf_file,
+};
+#endif
+#endif
+
+/**
+ * rate_control_event - report a rate control decision
+ *
+ * Called by the rate control algorithms when they changed the rates
+ * selected for a station; @ev has the selected rates filled in.
+ *
+ * @hw: the hardware
+ * @sta: the station
+ * @ev: the event
+ * @algo: the reporting algorithm, see &enum nl80211_rate_stats_algo
+ */
+void rate_control_event(struct ieee80211_hw *hw, struct ieee80211_sta *sta,
+			struct nl80211_rate_stats_event *ev, u8 algo)
+{
+#if defined(CONFIG_MAC80211_DEBUGFS) && defined(CONFIG_RELAY)
+	struct rate_control_ref *ref = container_of(sta, struct sta_info,
+						    sta)->rate_ctrl;
+	struct timespec ts;
+
+	if (!ref || !ref->events)
+		return;
+
+	ktime_get_ts(&ts);
+	ev->version = NL80211_RATE_STATS_VERSION;
+	ev->algo = algo;
+	memcpy(ev->addr, sta->addr, ETH_ALEN);
+	ev->timestamp = timespec_to_ns(&ts);
+	relay_write(ref->events, ev, sizeof(*ev));
+#endif
+}
+
+/*
+ * Instantiate @ops for @local, the caller passes its reference on the
+ * ops to the instance. The debugfs files of the instance live in
+ * phyX/@dirname.
+ */
+static struct rate_control_ref *
+rate_control_alloc(struct rate_control_ops *ops,
+		   struct ieee80211_local *local, const char *dirname)
 {
 	struct dentry *debugfsdir = NULL;
 	struct rate_control_ref *ref;
 
-	ref = kmalloc(sizeof(struct rate_control_ref), GFP_KERNEL);
+	ref = kzalloc(sizeof(struct rate_control_ref), GFP_KERNEL);
 	if (!ref)
-		goto fail_ref;
+		return NULL;
 	ref->local = local;
-	ref->ops = ieee80211_rate_control_ops_get(name);
-	if (!ref->ops)
-		goto fail_ops;
+	ref->ops = ops;
+	INIT_LIST_HEAD(&ref->list);
 
 #ifdef CONFIG_MAC80211_DEBUGFS
-	debugfsdir = debugfs_create_dir("rc", local->hw.wiphy->debugfsdir);
-	local->debugfs.rcdir = debugfsdir;
+	debugfsdir = debugfs_create_dir(dirname, local->hw.wiphy->debugfsdir);
+	ref->debugfsdir = debugfsdir;
 	debugfs_create_file("name", 0400, debugfsdir, ref, &rcname_ops);
+#ifdef CONFIG_RELAY
+	if (debugfsdir)
+		ref->events = relay_open("events", debugfsdir,
+					 RC_EVENTS_SUBBUF_SIZE,
+					 RC_EVENTS_N_SUBBUFS,
+					 &rc_events_cb, NULL);
+#endif
 #endif
 
 	ref->priv = ref->ops->alloc(&local->hw, debugfsdir);
@@ -176,10 +269,14 @@ static struct rate_control_ref *rate_control_alloc(const char *name,
 	return ref;
 
 fail_priv:
-	ieee80211_rate_control_ops_put(ref->ops);
-fail_ops:
+#ifdef CONFIG_MAC80211_DEBUGFS
+#ifdef CONFIG_RELAY
+	if (ref->events)
+		relay_close(ref->events);
+#endif
+	debugfs_remove_recursive(ref->debugfsdir);
+#endif
 	kfree(ref);
-fail_ref:
 	return NULL;
 }
 
@@ -188,8 +285,11 @@ static void rate_control_free(struct rate_control_ref *ctrl_ref)
 	ctrl_ref->ops->free(ctrl_ref->priv);
 
 #ifdef CONFIG_MAC80211_DEBUGFS
-	debugfs_remove_recursive(ctrl_ref->local->debugfs.rcdir);
-	ctrl_ref->local->debugfs.rcdir = NULL;
+#ifdef CONFIG_RELAY
+	if (ctrl_ref->events)
+		relay_close(ctrl_ref->events);
+#endif
+	debugfs_remove_recursive(ctrl_ref->debugfsdir);
 #endif
 
 	ieee80211_rate_control_ops_put(ctrl_ref->ops);
@@ -431,7 +531,7 @@ void rate_control_get_rate(struct ieee80211_sub_if_data *sdata,
 			   struct sta_info *sta,
 			   struct ieee80211_tx_rate_control *txrc)
 {
-	struct rate_control_ref *ref = sdata->local->rate_ctrl;
+	struct rate_control_ref *ref = rate_control_sdata_ref(sdata);
 	void *priv_sta = NULL;
 	struct ieee80211_sta *ista = NULL;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(txrc->skb);
@@ -440,6 +540,9 @@ void rate_control_get_rate(struct ieee80211_sub_if_data *sdata,
 	u8 mcs_mask[IEEE80211_HT_MCS_MASK_LEN];
 
 	if (sta && test_sta_flag(sta, WLAN_STA_RATE_CONTROL)) {
+		/* pairs with the barrier in rate_control_switch_sta() */
+		smp_rmb();
+		ref = sta->rate_ctrl;
 		ista = &sta->sta;
 		priv_sta = sta->rate_ctrl_priv;
 	}
@@ -490,6 +593,7 @@ void rate_control_get_rate(struct ieee80211_sub_if_data *sdata,
 int ieee80211_init_rate_ctrl_alg(struct ieee80211_local *local,
 				 const char *name)
 {
+	struct rate_control_ops *ops;
 	struct rate_control_ref *ref;
 
 	ASSERT_RTNL();
@@ -503,8 +607,11 @@ int ieee80211_init_rate_ctrl_alg(struct ieee80211_local *local,
 		return 0;
 	}
 
-	ref = rate_control_alloc(name, local);
+	ops = ieee80211_rate_control_ops_get(name);
+	ref = ops ? rate_control_alloc(ops, local, "rc") : NULL;
 	if (!ref) {
+		if (ops)
+			ieee80211_rate_control_ops_put(ops);
 		wiphy_warn(local->hw.wiphy,
 			   "Failed to select rate control algorithm\n");
 		return -ENOENT;
@@ -521,7 +628,12 @@ int ieee80211_init_rate_ctrl_alg(struct ieee80211_local *local,
 
 void rate_control_deinitialize(struct ieee80211_local *local)
 {
-	struct rate_control_ref *ref;
+	struct rate_control_ref *ref, *tmp;
+
+	list_for_each_entry_safe(ref, tmp, &local->rate_ctrl_list, list) {
+		list_del(&ref->list);
+		rate_control_free(ref);
+	}
 
 	ref = local->rate_ctrl;
 
@@ -532,3 +644,292 @@ void rate_control_deinitialize(struct ieee80211_local *local)
 	rate_control_free(ref);
 }
 
+/*
+ * Look up the instance of algorithm @name on @local, creating it if
+ * this is the first interface or station asking for it. Instances are
+ * kept until the hardware is unregistered, so interfaces and stations
+ * can point at them without holding references.
+ */
+static struct rate_control_ref *
+rate_control_get_instance(struct ieee80211_local *local, const char *name)
+{
+	struct rate_control_ops *ops;
+	struct rate_control_ref *ref;
+	char dirname[32];
+
+	ASSERT_RTNL();
+
+	if (!strcmp(local->rate_ctrl->ops->name, name))
+		return local->rate_ctrl;
+
+	list_for_each_entry(ref, &local->rate_ctrl_list, list)
+		if (!strcmp(ref->ops->name, name))
+			return ref;
+
+	ops = ieee80211_rate_control_ops_find(name);
+	if (!ops)
+		return ERR_PTR(-ENOENT);
+
+	snprintf(dirname, sizeof(dirname), "rc-%s", ops->name);
+	ref = rate_control_alloc(ops, local, dirname);
+	if (!ref) {
+		ieee80211_rate_control_ops_put(ops);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	list_add_tail(&ref->list, &local->rate_ctrl_list);
+	wiphy_debug(local->hw.wiphy,
+		    "Instantiated rate control algorithm '%s'\n", ops->name);
+
+	return ref;
+}
+
+/* room for the statistics handed from one algorithm to the next */
+#define RC_MIGRATE_STATS_LEN	2048
+
+/* a station being moved from one algorithm instance to another */
+struct rate_control_switch {
+	struct sta_info *sta;
+	struct rate_control_ref *ref;
+	void *priv, *stats;
+	size_t stats_len;
+	bool initialized;
+};
+
+/*
+ * Allocate what moving the station over to @ref needs, this is the only
+ * part of a switch that can fail and it doesn't touch the station yet.
+ */
+static int rate_control_switch_prepare(struct rate_control_switch *sw,
+				       struct sta_info *sta,
+				       struct rate_control_ref *ref)
+{
+	memset(sw, 0, sizeof(*sw));
+	sw->sta = sta;
+	sw->ref = ref;
+
+	sw->priv = rate_control_alloc_sta(ref, &sta->sta, GFP_KERNEL);
+	if (!sw->priv)
+		return -ENOMEM;
+
+	sw->initialized = test_sta_flag(sta, WLAN_STA_RATE_CONTROL);
+	if (sw->initialized && ref->ops->migrate_sta) {
+		sw->stats = kmalloc(RC_MIGRATE_STATS_LEN, GFP_KERNEL);
+		if (sw->stats)
+			sw->stats_len = rate_control_get_rate_stats(sta,
+						sw->stats,
+						RC_MIGRATE_STATS_LEN);
+	}
+
+	return 0;
+}
+
+static void rate_control_switch_abort(struct rate_control_switch *sw)
+{
+	sw->ref->ops->free_sta(sw->ref->priv, &sw->sta->sta, sw->priv);
+	kfree(sw->stats);
+}
+
+/*
+ * Stop the TX and status paths from using the old instance, the caller
+ * must wait for those that already picked it up before finishing.
+ */
+static void rate_control_switch_stop(struct rate_control_switch *sw)
+{
+	struct sta_info *sta = sw->sta;
+
+	rate_control_remove_sta_debugfs(sta);
+
+	/*
+	 * From here on rate_control_rate_init() only records that it was
+	 * called, rather than initializing the instance that is going away.
+	 */
+	spin_lock_bh(&sta->lock);
+	/* it may have been initialized since the switch was prepared */
+	sw->initialized = test_sta_flag(sta, WLAN_STA_RATE_CONTROL);
+	sta->rate_ctrl_switching = true;
+	sta->rate_ctrl_init_pending = false;
+	clear_sta_flag(sta, WLAN_STA_RATE_CONTROL);
+	spin_unlock_bh(&sta->lock);
+}
+
+/*
+ * The new algorithm is initialized for the station from scratch and
+ * then, if it supports it, seeded from the statistics the old algorithm
+ * collected, so the association and most of what was learned about the
+ * link survive.
+ */
+static void rate_control_switch_finish(struct rate_control_switch *sw)
+{
+	struct sta_info *sta = sw->sta;
+	struct ieee80211_local *local = sta->local;
+	struct rate_control_ref *old_ref = sta->rate_ctrl;
+	struct rate_control_ref *ref = sw->ref;
+	void *old_priv = sta->rate_ctrl_priv;
+	struct ieee80211_supported_band *sband;
+
+	spin_lock_bh(&sta->lock);
+	sta->rate_ctrl = ref;
+	sta->rate_ctrl_priv = sw->priv;
+
+	if (sw->initialized || sta->rate_ctrl_init_pending) {
+		sband = local->hw.wiphy->bands[local->hw.conf.channel->band];
+		ref->ops->rate_init(ref->priv, sband, &sta->sta, sw->priv);
+		if (sw->stats_len)
+			ref->ops->migrate_sta(ref->priv, sw->priv, &sta->sta,
+					      sw->stats, sw->stats_len);
+		/* publish the instance before the flag */
+		smp_wmb();
+		set_sta_flag(sta, WLAN_STA_RATE_CONTROL);
+	}
+
+	sta->rate_ctrl_switching = false;
+	sta->rate_ctrl_init_pending = false;
+	spin_unlock_bh(&sta->lock);
+
+	rate_control_add_sta_debugfs(sta);
+	old_ref->ops->free_sta(old_ref->priv, &sta->sta, old_priv);
+	kfree(sw->stats);
+}
+
+/* Move @sta over to the algorithm instance @ref. */
+static int rate_control_switch_sta(struct sta_info *sta,
+				   struct rate_control_ref *ref)
+{
+	struct rate_control_switch sw;
+	int ret;
+
+	lockdep_assert_held(&sta->local->sta_mtx);
+
+	if (sta->rate_ctrl == ref)
+		return 0;
+
+	ret = rate_control_switch_prepare(&sw, sta, ref);
+	if (ret)
+		return ret;
+
+	rate_control_switch_stop(&sw);
+	synchronize_net();
+	rate_control_switch_finish(&sw);
+
+	return 0;
+}
+
+/**
+ * rate_control_set_sdata - select the rate control algorithm of an interface
+ *
+ * All stations of the interface that didn't get an algorithm selected
+ * individually are switched over immediately, sharing a single RCU grace
+ * period. If any of them can't be switched, nothing is changed. Must be
+ * called under RTNL.
+ *
+ * @sdata: the interface
+ * @name: the algorithm, or %NULL for the hardware default
+ */
+int rate_control_set_sdata(struct ieee80211_sub_if_data *sdata,
+			   const char *name)
+{
+	struct ieee80211_local *local = sdata->local;
+	struct rate_control_ref *ref = local->rate_ctrl;
+	struct rate_control_switch *sw = NULL;
+	struct sta_info *sta;
+	int i, n = 0, ret = 0;
+
+	ASSERT_RTNL();
+
+	if (!local->rate_ctrl)
+		return -EOPNOTSUPP;
+
+	if (name) {
+		ref = rate_control_get_instance(local, name);
+		if (IS_ERR(ref))
+			return PTR_ERR(ref);
+	}
+
+	mutex_lock(&local->sta_mtx);
+
+	list_for_each_entry(sta, &local->sta_list, list)
+		if (sta->sdata == sdata && !sta->rate_ctrl_pinned &&
+		    sta->rate_ctrl != ref)
+			n++;
+
+	if (n) {
+		sw = kcalloc(n, sizeof(*sw), GFP_KERNEL);
+		if (!sw) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	i = 0;
+	list_for_each_entry(sta, &local->sta_list, list) {
+		if (sta->sdata != sdata || sta->rate_ctrl_pinned ||
+		    sta->rate_ctrl == ref)
+			continue;
+
+		ret = rate_control_switch_prepare(&sw[i], sta, ref);
+		if (ret) {
+			while (i--)
+				rate_control_switch_abort(&sw[i]);
+			goto out;
+		}
+		i++;
+	}
+
+	for (i = 0; i < n; i++)
+		rate_control_switch_stop(&sw[i]);
+
+	if (n)
+		synchronize_net();
+
+	for (i = 0; i < n; i++)
+		rate_control_switch_finish(&sw[i]);
+
+	sdata->rate_ctrl = ref == local->rate_ctrl ? NULL : ref;
+out:
+	mutex_unlock(&local->sta_mtx);
+	kfree(sw);
+
+	return ret;
+}
+
+/**
+ * rate_control_set_sta - select the rate control algorithm of a station
+ *
+ * Must be called under RTNL.
+ *
+ * @sta: the station
+ * @name: the algorithm, or %NULL to follow the interface's selection
+ */
+int rate_control_set_sta(struct sta_info *sta, const char *name)
+{
+	struct ieee80211_local *local = sta->local;
+	struct rate_control_ref *ref;
+	int ret;
+
+	ASSERT_RTNL();
+
+	if (!local->rate_ctrl)
+		return -EOPNOTSUPP;
+
+	if (name)
+		ref = rate_control_get_instance(local, name);
+	else
+		ref = rate_control_sdata_ref(sta->sdata);
+	if (IS_ERR(ref))
+		return PTR_ERR(ref);
+
+	mutex_lock(&local->sta_mtx);
+	if (sta->dead) {
+		ret = -ENOENT;
+		goto out;
+	}
+
+	ret = rate_control_switch_sta(sta, ref);
+	if (!ret)
+		sta->rate_ctrl_pinned = !!name;
+out:
+	mutex_unlock(&local->sta_mtx);
+
+	return ret;
+}
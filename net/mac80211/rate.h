@@ -22,8 +22,22 @@ struct rate_control_ref {
 	struct ieee80211_local *local;
 	struct rate_control_ops *ops;
 	void *priv;
+	struct list_head list;
+#ifdef CONFIG_MAC80211_DEBUGFS
+	struct dentry *debugfsdir;
+#ifdef CONFIG_RELAY
+	struct rchan *events;
+#endif
+#endif
 };
 
+/* the rate control instance new stations of this interface start with */
+static inline struct rate_control_ref *
+rate_control_sdata_ref(const struct ieee80211_sub_if_data *sdata)
+{
+	return sdata->rate_ctrl ?: sdata->local->rate_ctrl;
+}
+
 void rate_control_get_rate(struct ieee80211_sub_if_data *sdata,
 			   struct sta_info *sta,
 			   struct ieee80211_tx_rate_control *txrc);
@@ -33,32 +47,48 @@ static inline void rate_control_tx_status(struct ieee80211_local *local,
 					  struct sta_info *sta,
 					  struct sk_buff *skb)
 {
-	struct rate_control_ref *ref = local->rate_ctrl;
+	struct rate_control_ref *ref;
 	struct ieee80211_sta *ista = &sta->sta;
-	void *priv_sta = sta->rate_ctrl_priv;
 
-	if (!ref || !test_sta_flag(sta, WLAN_STA_RATE_CONTROL))
+	if (!test_sta_flag(sta, WLAN_STA_RATE_CONTROL))
+		return;
+
+	/* pairs with the barrier in rate_control_switch_sta() */
+	smp_rmb();
+	ref = sta->rate_ctrl;
+	if (!ref)
 		return;
 
-	ref->ops->tx_status(ref->priv, sband, ista, priv_sta, skb);
+	ref->ops->tx_status(ref->priv, sband, ista, sta->rate_ctrl_priv, skb);
 }
 
 
 static inline void rate_control_rate_init(struct sta_info *sta)
 {
 	struct ieee80211_local *local = sta->sdata->local;
-	struct rate_control_ref *ref = sta->rate_ctrl;
+	struct rate_control_ref *ref;
 	struct ieee80211_sta *ista = &sta->sta;
-	void *priv_sta = sta->rate_ctrl_priv;
 	struct ieee80211_supported_band *sband;
 
+	/* serializes against rate_control_switch_stop()/_finish() */
+	spin_lock_bh(&sta->lock);
+
+	ref = sta->rate_ctrl;
 	if (!ref)
-		return;
+		goto out;
+
+	/* the new algorithm will be initialized once the switch is done */
+	if (sta->rate_ctrl_switching) {
+		sta->rate_ctrl_init_pending = true;
+		goto out;
+	}
 
 	sband = local->hw.wiphy->bands[local->hw.conf.channel->band];
 
-	ref->ops->rate_init(ref->priv, sband, ista, priv_sta);
+	ref->ops->rate_init(ref->priv, sband, ista, sta->rate_ctrl_priv);
 	set_sta_flag(sta, WLAN_STA_RATE_CONTROL);
+ out:
+	spin_unlock_bh(&sta->lock);
 }
 
 static inline void rate_control_rate_update(struct ieee80211_local *local,
@@ -66,13 +96,18 @@ static inline void rate_control_rate_update(struct ieee80211_local *local,
 				    struct sta_info *sta, u32 changed,
 				    enum nl80211_channel_type oper_chan_type)
 {
-	struct rate_control_ref *ref = local->rate_ctrl;
+	struct rate_control_ref *ref;
 	struct ieee80211_sta *ista = &sta->sta;
-	void *priv_sta = sta->rate_ctrl_priv;
 
+	if (!test_sta_flag(sta, WLAN_STA_RATE_CONTROL))
+		return;
+
+	smp_rmb();
+	ref = sta->rate_ctrl;
 	if (ref && ref->ops->rate_update)
 		ref->ops->rate_update(ref->priv, sband, ista,
-				      priv_sta, changed, oper_chan_type);
+				      sta->rate_ctrl_priv, changed,
+				      oper_chan_type);
 }
 
 static inline void *rate_control_alloc_sta(struct rate_control_ref *ref,
@@ -110,12 +145,96 @@ static inline void rate_control_remove_sta_debugfs(struct sta_info *sta)
 #endif
 }
 
+static inline size_t rate_control_get_rate_stats(struct sta_info *sta,
+						 void *buf, size_t len)
+{
+	struct rate_control_ref *ref = sta->rate_ctrl;
+
+	if (!ref || !ref->ops->get_rate_stats ||
+	    !test_sta_flag(sta, WLAN_STA_RATE_CONTROL))
+		return 0;
+
+	return ref->ops->get_rate_stats(ref->priv, sta->rate_ctrl_priv,
+					buf, len);
+}
+
+/* helpers for the rate control algorithms to fill in rate statistics */
+static inline struct nl80211_rate_stats_hdr *
+rate_control_stats_init(void *buf, size_t len, u8 algo)
+{
+	struct nl80211_rate_stats_hdr *hdr = buf;
+
+	if (len < sizeof(*hdr))
+		return NULL;
+
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->version = NL80211_RATE_STATS_VERSION;
+	hdr->algo = algo;
+	hdr->rate_len = sizeof(struct nl80211_rate_stats);
+	return hdr;
+}
+
+static inline struct nl80211_rate_stats *
+rate_control_stats_add(struct nl80211_rate_stats_hdr *hdr, size_t len)
+{
+	struct nl80211_rate_stats *rs;
+	size_t off = sizeof(*hdr) + hdr->n_rates * sizeof(*rs);
+
+	if (off + sizeof(*rs) > len) {
+		hdr->flags |= NL80211_RATE_STATS_TRUNCATED;
+		return NULL;
+	}
+
+	hdr->n_rates++;
+	rs = (void *)((u8 *)hdr + off);
+	memset(rs, 0, sizeof(*rs));
+	return rs;
+}
+
+static inline size_t
+rate_control_stats_len(struct nl80211_rate_stats_hdr *hdr)
+{
+	return sizeof(*hdr) + hdr->n_rates * sizeof(struct nl80211_rate_stats);
+}
+
+/* helpers for the rate control algorithms to read them back on migration */
+static inline const struct nl80211_rate_stats_hdr *
+rate_control_stats_parse(const void *buf, size_t len)
+{
+	const struct nl80211_rate_stats_hdr *hdr = buf;
+
+	if (!buf || len < sizeof(*hdr))
+		return NULL;
+
+	if (hdr->version != NL80211_RATE_STATS_VERSION ||
+	    hdr->rate_len < sizeof(struct nl80211_rate_stats) ||
+	    sizeof(*hdr) + (size_t)hdr->n_rates * hdr->rate_len > len)
+		return NULL;
+
+	return hdr;
+}
+
+static inline const struct nl80211_rate_stats *
+rate_control_stats_get(const struct nl80211_rate_stats_hdr *hdr, int i)
+{
+	return (const void *)((const u8 *)hdr + sizeof(*hdr) +
+			      i * hdr->rate_len);
+}
+
+void rate_control_event(struct ieee80211_hw *hw, struct ieee80211_sta *sta,
+			struct nl80211_rate_stats_event *ev, u8 algo);
+
 /* Get a reference to the rate control algorithm. If `name' is NULL, get the
  * first available algorithm. */
 int ieee80211_init_rate_ctrl_alg(struct ieee80211_local *local,
 				 const char *name);
 void rate_control_deinitialize(struct ieee80211_local *local);
 
+/* Runtime selection of the algorithm per interface and per station. */
+int rate_control_set_sdata(struct ieee80211_sub_if_data *sdata,
+			   const char *name);
+int rate_control_set_sta(struct sta_info *sta, const char *name);
+
 
 /* Rate control algorithms */
 #ifdef CONFIG_MAC80211_RC_PID
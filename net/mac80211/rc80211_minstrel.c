@@ -51,6 +51,7 @@
 #include <linux/random.h>
 #include <linux/ieee80211.h>
 #include <linux/slab.h>
+#include <linux/math64.h>
 #include <net/mac80211.h>
 #include "rate.h"
 #include "rc80211_minstrel.h"
@@ -149,6 +150,117 @@ minstrel_update_stats(struct minstrel_priv *mp, struct minstrel_sta_info *mi)
 	mi->max_prob_rate = index_max_prob;
 }
 
+static void
+minstrel_fill_rate_stats(struct minstrel_sta_info *mi, int i,
+			 struct nl80211_rate_stats *rs)
+{
+	struct minstrel_rate *mr = &mi->r[i];
+
+	if (i == mi->max_tp_rate)
+		rs->flags |= NL80211_RATE_STATS_MAX_TP;
+	if (i == mi->max_tp_rate2)
+		rs->flags |= NL80211_RATE_STATS_MAX_TP2;
+	if (i == mi->max_prob_rate)
+		rs->flags |= NL80211_RATE_STATS_MAX_PROB;
+	rs->idx = mr->rix;
+	rs->retry_count = mr->adjusted_retry_count;
+
+	/* probabilities scale to 18000, see minstrel_update_stats() */
+	rs->throughput = div_u64((u64)mr->cur_tp * 100, (18000 << 10) / 96);
+	rs->prob = (mr->probability << 16) / 18000;
+	rs->cur_prob = (mr->cur_prob << 16) / 18000;
+	rs->attempts = mr->last_attempts;
+	rs->success = mr->last_success;
+	rs->att_hist = mr->att_hist;
+	rs->succ_hist = mr->succ_hist;
+}
+
+static size_t
+minstrel_get_rate_stats(void *priv, void *priv_sta, void *buf, size_t len)
+{
+	struct minstrel_sta_info *mi = priv_sta;
+	struct nl80211_rate_stats_hdr *hdr;
+	struct nl80211_rate_stats *rs;
+	int i;
+
+	hdr = rate_control_stats_init(buf, len,
+				      NL80211_RATE_STATS_ALGO_MINSTREL);
+	if (!hdr)
+		return 0;
+
+	for (i = 0; i < mi->n_rates; i++) {
+		if (!mi->r[i].att_hist && i != mi->max_tp_rate &&
+		    i != mi->max_tp_rate2 && i != mi->max_prob_rate)
+			continue;
+
+		rs = rate_control_stats_add(hdr, len);
+		if (!rs)
+			break;
+		minstrel_fill_rate_stats(mi, i, rs);
+	}
+
+	return rate_control_stats_len(hdr);
+}
+
+static void
+minstrel_migrate_sta(void *priv, void *priv_sta, struct ieee80211_sta *sta,
+		     const void *stats, size_t len)
+{
+	const struct nl80211_rate_stats_hdr *hdr;
+	const struct nl80211_rate_stats *rs;
+	struct minstrel_sta_info *mi = priv_sta;
+	struct minstrel_rate *mr;
+	unsigned int usecs;
+	int i, ndx;
+
+	hdr = rate_control_stats_parse(stats, len);
+	if (!hdr)
+		return;
+
+	for (i = 0; i < hdr->n_rates; i++) {
+		rs = rate_control_stats_get(hdr, i);
+		if (rs->flags & NL80211_RATE_STATS_MCS)
+			continue;
+
+		for (ndx = 0; ndx < mi->n_rates; ndx++)
+			if (mi->r[ndx].rix == rs->idx)
+				break;
+		if (ndx == mi->n_rates)
+			continue;
+
+		mr = &mi->r[ndx];
+		mr->probability = (rs->prob * 18000) >> 16;
+		mr->cur_prob = (rs->cur_prob * 18000) >> 16;
+		mr->att_hist = rs->att_hist;
+		mr->succ_hist = rs->succ_hist;
+
+		usecs = mr->perfect_tx_time;
+		if (!usecs)
+			usecs = 1000000;
+		mr->cur_tp = mr->probability * (1000000 / usecs);
+
+		if (rs->flags & NL80211_RATE_STATS_MAX_TP)
+			mi->max_tp_rate = ndx;
+		if (rs->flags & NL80211_RATE_STATS_MAX_TP2)
+			mi->max_tp_rate2 = ndx;
+		if (rs->flags & NL80211_RATE_STATS_MAX_PROB)
+			mi->max_prob_rate = ndx;
+	}
+}
+
+static void
+minstrel_report_rates(struct minstrel_priv *mp, struct ieee80211_sta *sta,
+		      struct minstrel_sta_info *mi)
+{
+	struct nl80211_rate_stats_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	minstrel_fill_rate_stats(mi, mi->max_tp_rate, &ev.max_tp);
+	minstrel_fill_rate_stats(mi, mi->max_tp_rate2, &ev.max_tp2);
+	minstrel_fill_rate_stats(mi, mi->max_prob_rate, &ev.max_prob);
+	rate_control_event(mp->hw, sta, &ev, NL80211_RATE_STATS_ALGO_MINSTREL);
+}
+
 static void
 minstrel_tx_status(void *priv, struct ieee80211_supported_band *sband,
                    struct ieee80211_sta *sta, void *priv_sta,
@@ -236,8 +348,16 @@ minstrel_get_rate(void *priv, struct ieee80211_sta *sta,
 	mrr = mp->has_mrr && !txrc->rts && !txrc->bss_conf->use_cts_prot;
 
 	if (time_after(jiffies, mi->stats_update + (mp->update_interval *
-			HZ) / 1000))
+			HZ) / 1000)) {
+		unsigned int max_tp = mi->max_tp_rate;
+		unsigned int max_tp2 = mi->max_tp_rate2;
+		unsigned int max_prob = mi->max_prob_rate;
+
 		minstrel_update_stats(mp, mi);
+		if (max_tp != mi->max_tp_rate || max_tp2 != mi->max_tp_rate2 ||
+		    max_prob != mi->max_prob_rate)
+			minstrel_report_rates(mp, sta, mi);
+	}
 
 	ndx = mi->max_tp_rate;
 
@@ -562,6 +682,8 @@ struct rate_control_ops mac80211_minstrel = {
 	.add_sta_debugfs = minstrel_add_sta_debugfs,
 	.remove_sta_debugfs = minstrel_remove_sta_debugfs,
 #endif
+	.get_rate_stats = minstrel_get_rate_stats,
+	.migrate_sta = minstrel_migrate_sta,
 };
 
 int __init
@@ -308,28 +308,6 @@ minstrel_ht_txstat_valid(struct ieee80211_tx_rate *rate)
 	return !!(rate->flags & IEEE80211_TX_RC_MCS);
 }
 
-static void
-minstrel_next_sample_idx(struct minstrel_ht_sta *mi)
-{
-	struct minstrel_mcs_group_data *mg;
-
-	for (;;) {
-		mi->sample_group++;
-		mi->sample_group %= ARRAY_SIZE(minstrel_mcs_groups);
-		mg = &mi->groups[mi->sample_group];
-
-		if (!mg->supported)
-			continue;
-
-		if (++mg->index >= MCS_GROUP_RATES) {
-			mg->index = 0;
-			if (++mg->column >= ARRAY_SIZE(sample_table))
-				mg->column = 0;
-		}
-		break;
-	}
-}
-
 static void
 minstrel_downgrade_rate(struct minstrel_ht_sta *mi, unsigned int *idx,
 			bool primary)
@@ -356,26 +334,146 @@ minstrel_downgrade_rate(struct minstrel_ht_sta *mi, unsigned int *idx,
 }
 
 static void
-minstrel_aggr_check(struct ieee80211_sta *pubsta, struct sk_buff *skb)
+minstrel_ht_fill_rate_stats(struct minstrel_ht_sta *mi, int index,
+			    struct nl80211_rate_stats *rs)
 {
-	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
-	struct sta_info *sta = container_of(pubsta, struct sta_info, sta);
-	u16 tid;
+	const struct mcs_group *group = &minstrel_mcs_groups[index / MCS_GROUP_RATES];
+	struct minstrel_rate_stats *mr = minstrel_get_ratestats(mi, index);
+
+	rs->flags = NL80211_RATE_STATS_MCS;
+	if (group->flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
+		rs->flags |= NL80211_RATE_STATS_40_MHZ_WIDTH;
+	if (group->flags & IEEE80211_TX_RC_SHORT_GI)
+		rs->flags |= NL80211_RATE_STATS_SHORT_GI;
+	if (index == mi->max_tp_rate)
+		rs->flags |= NL80211_RATE_STATS_MAX_TP;
+	if (index == mi->max_tp_rate2)
+		rs->flags |= NL80211_RATE_STATS_MAX_TP2;
+	if (index == mi->max_prob_rate)
+		rs->flags |= NL80211_RATE_STATS_MAX_PROB;
+	rs->idx = (group->streams - 1) * MCS_GROUP_RATES +
+		  index % MCS_GROUP_RATES;
+	rs->retry_count = mr->retry_count;
+
+	/* cur_tp is in units of 10 kbit/s */
+	rs->throughput = mr->cur_tp * 10;
+	rs->prob = mr->probability;
+	rs->cur_prob = mr->cur_prob;
+	rs->attempts = mr->last_attempts;
+	rs->success = mr->last_success;
+	rs->att_hist = mr->att_hist;
+	rs->succ_hist = mr->succ_hist;
+}
 
-	if (unlikely(!ieee80211_is_data_qos(hdr->frame_control)))
-		return;
+static size_t
+minstrel_ht_get_rate_stats(void *priv, void *priv_sta, void *buf, size_t len)
+{
+	struct minstrel_ht_sta_priv *msp = priv_sta;
+	struct minstrel_ht_sta *mi = &msp->ht;
+	struct nl80211_rate_stats_hdr *hdr;
+	struct nl80211_rate_stats *rs;
+	int i, j, idx;
 
-	if (unlikely(skb->protocol == cpu_to_be16(ETH_P_PAE)))
-		return;
+	if (!msp->is_ht)
+		return mac80211_minstrel.get_rate_stats(priv, &msp->legacy,
+							buf, len);
 
-	tid = *ieee80211_get_qos_ctl(hdr) & IEEE80211_QOS_CTL_TID_MASK;
-	if (likely(sta->ampdu_mlme.tid_tx[tid]))
-		return;
+	hdr = rate_control_stats_init(buf, len,
+				      NL80211_RATE_STATS_ALGO_MINSTREL_HT);
+	if (!hdr)
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(mi->groups); i++) {
+		for (j = 0; j < MCS_GROUP_RATES; j++) {
+			idx = i * MCS_GROUP_RATES + j;
+
+			if (!(mi->groups[i].supported & BIT(j)))
+				continue;
+
+			if (!mi->groups[i].rates[j].att_hist &&
+			    idx != mi->max_tp_rate &&
+			    idx != mi->max_tp_rate2 &&
+			    idx != mi->max_prob_rate)
+				continue;
+
+			rs = rate_control_stats_add(hdr, len);
+			if (!rs)
+				goto out;
+			minstrel_ht_fill_rate_stats(mi, idx, rs);
+		}
+	}
+
+out:
+	return rate_control_stats_len(hdr);
+}
+
+static void
+minstrel_ht_migrate_sta(void *priv, void *priv_sta, struct ieee80211_sta *sta,
+			const void *stats, size_t len)
+{
+	struct minstrel_ht_sta_priv *msp = priv_sta;
+	struct minstrel_ht_sta *mi = &msp->ht;
+	const struct nl80211_rate_stats_hdr *hdr;
+	const struct nl80211_rate_stats *rs;
+	struct minstrel_rate_stats *mr;
+	struct ieee80211_tx_rate rate;
+	int i, group, index;
 
-	if (skb_get_queue_mapping(skb) == IEEE80211_AC_VO)
+	if (!msp->is_ht)
+		return mac80211_minstrel.migrate_sta(priv, &msp->legacy, sta,
+						     stats, len);
+
+	hdr = rate_control_stats_parse(stats, len);
+	if (!hdr)
 		return;
 
-	ieee80211_start_tx_ba_session(pubsta, tid, 5000);
+	for (i = 0; i < hdr->n_rates; i++) {
+		rs = rate_control_stats_get(hdr, i);
+		if (!(rs->flags & NL80211_RATE_STATS_MCS) ||
+		    rs->idx >= MINSTREL_MAX_STREAMS * MCS_GROUP_RATES)
+			continue;
+
+		rate.idx = rs->idx;
+		rate.flags = 0;
+		if (rs->flags & NL80211_RATE_STATS_SHORT_GI)
+			rate.flags |= IEEE80211_TX_RC_SHORT_GI;
+		if (rs->flags & NL80211_RATE_STATS_40_MHZ_WIDTH)
+			rate.flags |= IEEE80211_TX_RC_40_MHZ_WIDTH;
+		group = minstrel_ht_get_group_idx(&rate);
+
+		if (!(mi->groups[group].supported &
+		      BIT(rs->idx % MCS_GROUP_RATES)))
+			continue;
+
+		index = group * MCS_GROUP_RATES + rs->idx % MCS_GROUP_RATES;
+		mr = minstrel_get_ratestats(mi, index);
+		mr->probability = rs->prob;
+		mr->cur_prob = rs->cur_prob;
+		mr->att_hist = rs->att_hist;
+		mr->succ_hist = rs->succ_hist;
+		minstrel_ht_calc_tp(mi, group, rs->idx % MCS_GROUP_RATES);
+
+		if (rs->flags & NL80211_RATE_STATS_MAX_TP)
+			mi->max_tp_rate = index;
+		if (rs->flags & NL80211_RATE_STATS_MAX_TP2)
+			mi->max_tp_rate2 = index;
+		if (rs->flags & NL80211_RATE_STATS_MAX_PROB)
+			mi->max_prob_rate = index;
+	}
+}
+
+static void
+minstrel_ht_report_rates(struct minstrel_priv *mp, struct ieee80211_sta *sta,
+			 struct minstrel_ht_sta *mi)
+{
+	struct nl80211_rate_stats_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	minstrel_ht_fill_rate_stats(mi, mi->max_tp_rate, &ev.max_tp);
+	minstrel_ht_fill_rate_stats(mi, mi->max_tp_rate2, &ev.max_tp2);
+	minstrel_ht_fill_rate_stats(mi, mi->max_prob_rate, &ev.max_prob);
+	rate_control_event(mp->hw, sta, &ev,
+			   NL80211_RATE_STATS_ALGO_MINSTREL_HT);
 }
 
 static void
@@ -389,6 +487,7 @@ minstrel_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 	struct ieee80211_tx_rate *ar = info->status.rates;
 	struct minstrel_rate_stats *rate, *rate2;
 	struct minstrel_priv *mp = priv;
+	unsigned int max_tp, max_tp2, max_prob;
 	bool last = false;
 	int group;
 	int i = 0;
@@ -396,6 +495,10 @@ minstrel_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 	if (!msp->is_ht)
 		return mac80211_minstrel.tx_status(priv, sband, sta, &msp->legacy, skb);
 
+	max_tp = mi->max_tp_rate;
+	max_tp2 = mi->max_tp_rate2;
+	max_prob = mi->max_prob_rate;
+
 	/* This packet was aggregated but doesn't carry status info */
 	if ((info->flags & IEEE80211_TX_CTL_AMPDU) &&
 	    !(info->flags & IEEE80211_TX_STAT_AMPDU))
@@ -451,11 +554,12 @@ minstrel_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 	    MINSTREL_FRAC(20, 100))
 		minstrel_downgrade_rate(mi, &mi->max_tp_rate2, false);
 
-	if (time_after(jiffies, mi->stats_update + (mp->update_interval / 2 * HZ) / 1000)) {
+	if (time_after(jiffies, mi->stats_update + (mp->update_interval / 2 * HZ) / 1000))
 		minstrel_ht_update_stats(mp, mi);
-		if (!(info->flags & IEEE80211_TX_CTL_AMPDU))
-			minstrel_aggr_check(sta, skb);
-	}
+
+	if (max_tp != mi->max_tp_rate || max_tp2 != mi->max_tp_rate2 ||
+	    max_prob != mi->max_prob_rate)
+		minstrel_ht_report_rates(mp, sta, mi);
 }
 
 static void
@@ -546,11 +650,11 @@ minstrel_get_duration(int index)
 }
 
 static int
-minstrel_get_sample_rate(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
+minstrel_get_sample_rate(struct minstrel_priv *mp, struct minstrel_ht_sta_priv *msp)
 {
+	struct minstrel_ht_sta *mi = &msp->ht;
 	struct minstrel_rate_stats *mr;
-	struct minstrel_mcs_group_data *mg;
-	int sample_idx = 0;
+	int sample_idx;
 
 	if (mi->sample_wait > 0) {
 		mi->sample_wait--;
@@ -561,11 +665,10 @@ minstrel_get_sample_rate(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 		return -1;
 
 	mi->sample_tries--;
-	mg = &mi->groups[mi->sample_group];
-	sample_idx = sample_table[mg->column][mg->index];
-	mr = &mg->rates[sample_idx];
-	sample_idx += mi->sample_group * MCS_GROUP_RATES;
-	minstrel_next_sample_idx(mi);
+	sample_idx = msp->sample_sched[mi->sample_sched_pos];
+	if (++mi->sample_sched_pos >= mi->sample_sched_len)
+		mi->sample_sched_pos = 0;
+	mr = minstrel_get_ratestats(mi, sample_idx);
 
 	/*
 	 * Sampling might add some overhead (RTS, no aggregation)
@@ -622,7 +725,7 @@ minstrel_ht_get_rate(void *priv, struct ieee80211_sta *sta, void *priv_sta,
 	    txrc->skb->protocol == cpu_to_be16(ETH_P_PAE))
 		sample_idx = -1;
 	else
-		sample_idx = minstrel_get_sample_rate(mp, mi);
+		sample_idx = minstrel_get_sample_rate(mp, msp);
 
 #ifdef CONFIG_MAC80211_DEBUGFS
 	/* use fixed index if set */
@@ -684,6 +787,36 @@ minstrel_ht_get_rate(void *priv, struct ieee80211_sta *sta, void *priv_sta,
 	}
 }
 
+/*
+ * Lay out the sampling order for a station: groups are interleaved and
+ * each group walks through the columns of the global sample table, as
+ * before, but rates the station doesn't support are left out up front
+ * so that picking the next sample rate is a single lookup.
+ */
+static void
+minstrel_ht_build_sample_sched(struct minstrel_ht_sta_priv *msp)
+{
+	struct minstrel_ht_sta *mi = &msp->ht;
+	unsigned int n = 0;
+	int col, i, group, rate;
+
+	for (col = 0; col < SAMPLE_COLUMNS; col++) {
+		for (i = 0; i < MCS_GROUP_RATES; i++) {
+			for (group = 0; group < ARRAY_SIZE(mi->groups); group++) {
+				rate = sample_table[col][i];
+				if (!(mi->groups[group].supported & BIT(rate)))
+					continue;
+
+				msp->sample_sched[n++] =
+					group * MCS_GROUP_RATES + rate;
+			}
+		}
+	}
+
+	mi->sample_sched_len = n;
+	mi->sample_sched_pos = 0;
+}
+
 static void
 minstrel_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
                         struct ieee80211_sta *sta, void *priv_sta,
@@ -774,6 +907,7 @@ minstrel_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
 	if (!n_supported)
 		goto use_legacy;
 
+	minstrel_ht_build_sample_sched(msp);
 	return;
 
 use_legacy:
@@ -817,7 +951,7 @@ minstrel_ht_alloc_sta(void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 			max_rates = sband->n_bitrates;
 	}
 
-	msp = kzalloc(sizeof(struct minstrel_ht_sta), gfp);
+	msp = kzalloc(sizeof(struct minstrel_ht_sta_priv), gfp);
 	if (!msp)
 		return NULL;
 
@@ -829,8 +963,14 @@ minstrel_ht_alloc_sta(void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 	if (!msp->sample_table)
 		goto error1;
 
+	msp->sample_sched = kmalloc(SAMPLE_COLUMNS * MINSTREL_HT_RATES, gfp);
+	if (!msp->sample_sched)
+		goto error2;
+
 	return msp;
 
+error2:
+	kfree(msp->sample_table);
 error1:
 	kfree(msp->ratelist);
 error:
@@ -843,6 +983,7 @@ minstrel_ht_free_sta(void *priv, struct ieee80211_sta *sta, void *priv_sta)
 {
 	struct minstrel_ht_sta_priv *msp = priv_sta;
 
+	kfree(msp->sample_sched);
 	kfree(msp->sample_table);
 	kfree(msp->ratelist);
 	kfree(msp);
@@ -874,6 +1015,8 @@ static struct rate_control_ops mac80211_minstrel_ht = {
 	.add_sta_debugfs = minstrel_ht_add_sta_debugfs,
 	.remove_sta_debugfs = minstrel_ht_remove_sta_debugfs,
 #endif
+	.get_rate_stats = minstrel_ht_get_rate_stats,
+	.migrate_sta = minstrel_ht_migrate_sta,
 };
 
 
@@ -22,6 +22,8 @@
 #define MINSTREL_TRUNC(val) ((val) >> MINSTREL_SCALE)
 
 #define MCS_GROUP_RATES	8
+#define MINSTREL_HT_RATES \
+	(MINSTREL_MAX_STREAMS * MINSTREL_STREAM_GROUPS * MCS_GROUP_RATES)
 
 struct mcs_group {
 	u32 flags;
@@ -54,9 +56,6 @@ struct minstrel_rate_stats {
 };
 
 struct minstrel_mcs_group_data {
-	u8 index;
-	u8 column;
-
 	/* bitfield of supported MCS rates of this group */
 	u8 supported;
 
@@ -104,8 +103,13 @@ struct minstrel_ht_sta {
 	u8 sample_count;
 	u8 sample_slow;
 
-	/* current MCS group to be sampled */
-	u8 sample_group;
+	/*
+	 * Sample schedule: the supported rates of this station, in the
+	 * order in which they get sampled. Built when the capabilities
+	 * change, the schedule itself lives in minstrel_ht_sta_priv.
+	 */
+	unsigned int sample_sched_len;
+	unsigned int sample_sched_pos;
 
 	/* MCS rate group info and statistics */
 	struct minstrel_mcs_group_data groups[MINSTREL_MAX_STREAMS * MINSTREL_STREAM_GROUPS];
@@ -121,6 +125,7 @@ struct minstrel_ht_sta_priv {
 #endif
 	void *ratelist;
 	void *sample_table;
+	u8 *sample_sched;
 	bool is_ht;
 };
 
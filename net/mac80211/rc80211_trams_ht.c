@@ -50,6 +50,7 @@
 #define MCS_GROUP(_streams, _sgi, _ht40) {				\
 	.streams = _streams,						\
 	.flags =							\
+		IEEE80211_TX_RC_MCS |					\
 		(_sgi ? IEEE80211_TX_RC_SHORT_GI : 0) |			\
 		(_ht40 ? IEEE80211_TX_RC_40_MHZ_WIDTH : 0),		\
 	.sgi = _sgi ? IEEE80211_TX_RC_SHORT_GI : 0,			\
@@ -66,6 +67,35 @@
 	}								\
 }
 
+/* Transmit duration of an average sized packet at a CCK rate (100 kbps) */
+#define CCK_DURATION(_bitrate) (192 + (MCS_NBITS * 10) / (_bitrate))
+
+#define CCK_GROUP {							\
+	.streams = 1,							\
+	.bitrate = { 10, 20, 55, 110 },					\
+	.duration = {							\
+		CCK_DURATION(10),					\
+		CCK_DURATION(20),					\
+		CCK_DURATION(55),					\
+		CCK_DURATION(110)					\
+	}								\
+}
+
+#define OFDM_GROUP {							\
+	.streams = 1,							\
+	.bitrate = { 60, 90, 120, 180, 240, 360, 480, 540 },		\
+	.duration = {							\
+		MCS_DURATION(1, 0, 24),					\
+		MCS_DURATION(1, 0, 36),					\
+		MCS_DURATION(1, 0, 48),					\
+		MCS_DURATION(1, 0, 72),					\
+		MCS_DURATION(1, 0, 96),					\
+		MCS_DURATION(1, 0, 144),				\
+		MCS_DURATION(1, 0, 192),				\
+		MCS_DURATION(1, 0, 216)					\
+	}								\
+}
+
 const struct mcs_group trams_mcs_groups[] = {
         MCS_GROUP(1, 0, 0),
         MCS_GROUP(1, 1, 0), 
@@ -81,8 +111,22 @@ const struct mcs_group trams_mcs_groups[] = {
         MCS_GROUP(3, 0, 1),
         MCS_GROUP(3, 1, 1),
 #endif
+	[TRAMS_CCK_GROUP] = CCK_GROUP,
+	[TRAMS_OFDM_GROUP] = OFDM_GROUP,
 };
 
+/* highest supported rate of a group at or below ridx, else its lowest */
+static int
+trams_supported_ridx(struct trams_ht_sta *mi, int group, int ridx)
+{
+	unsigned int supported = mi->groups[group].supported;
+
+	if (supported & (BIT(ridx + 1) - 1))
+		return fls(supported & (BIT(ridx + 1) - 1)) - 1;
+
+	return ffs(supported) - 1;
+}
+
 //ddn
 static int 
 trams_upgrade_stream(struct trams_ht_sta *mi)
@@ -111,6 +155,8 @@ trams_upgrade_stream(struct trams_ht_sta *mi)
         //	printk(KERN_DEBUG "upgrade stream to %2d \n", group);
                 mi->trams_curgroup = group;
 		mi->trams_cur_streams = trams_mcs_groups[group].streams;
+		mi->trams_cur_ridx = trams_supported_ridx(mi, group,
+							  mi->trams_cur_ridx);
 
                 break;
         }
@@ -136,6 +182,8 @@ trams_upgrade_group(struct trams_ht_sta *mi)
         //	printk(KERN_DEBUG "upgrade stream to %2d \n", group);
                 mi->trams_curgroup = group;
 		mi->trams_cur_streams = trams_mcs_groups[group].streams;
+		mi->trams_cur_ridx = trams_supported_ridx(mi, group,
+							  mi->trams_cur_ridx);
 
                 break;
         }
@@ -171,6 +219,8 @@ trams_downgrade_stream(struct trams_ht_sta *mi)
 		//printk(KERN_DEBUG "downgrade stream to %2d \n", group);
                 mi->trams_curgroup = group;
 		mi->trams_cur_streams = trams_mcs_groups[group].streams;
+		mi->trams_cur_ridx = trams_supported_ridx(mi, group,
+							  mi->trams_cur_ridx);
 
                 break;
         }
@@ -196,6 +246,8 @@ trams_downgrade_group(struct trams_ht_sta *mi)
 		//printk(KERN_DEBUG "downgrade stream to %2d \n", group);
                 mi->trams_curgroup = group;
 		mi->trams_cur_streams = trams_mcs_groups[group].streams;
+		mi->trams_cur_ridx = trams_supported_ridx(mi, group,
+							  mi->trams_cur_ridx);
 
                 break;
         }
@@ -217,7 +269,7 @@ trams_check_modulation_index(struct trams_ht_sta *mi)
 {
 	int rate, streams, edx, sgi, ht40;
 	int lrate, lstreams, ledx, lsgi, lht40;
-	int cgroup, lgroup;
+	int cgroup, lgroup, max_ridx;
 	struct trams_rate_stats *cr;
 	struct trams_rate_stats *lr;
 	int enough;
@@ -242,6 +294,7 @@ trams_check_modulation_index(struct trams_ht_sta *mi)
 
 	cgroup = mi->trams_curgroup;
 	lgroup = mi->trams_curgroup;
+	max_ridx = fls(mi->groups[cgroup].supported) - 1;
 
 	cr = &mi->groups[cgroup].rates[rate];
 	
@@ -264,7 +317,8 @@ trams_check_modulation_index(struct trams_ht_sta *mi)
 			mi->trams_consecutive = 0;
 
 
-			rate =  mi->trams_last_ridx;
+			rate = trams_supported_ridx(mi, cgroup,
+						    mi->trams_last_ridx);
 			streams = mi->trams_last_streams;
 			edx = mi->trams_last_edx;
 			sgi = mi->trams_last_sgi;
@@ -314,15 +368,15 @@ trams_check_modulation_index(struct trams_ht_sta *mi)
 
 	if (cr->cur_tp >= mi->trams_avg_tp) {
 		mi->trams_successive = 0;
-               	if (rate + 1 <  MCS_GROUP_RATES && !mi->isMultiplicative && !mi->trams_ossilate ) {
+               	if (rate < max_ridx && !mi->isMultiplicative && !mi->trams_ossilate ) {
                        	rate++;
 			printk(KERN_DEBUG "increase additively rate to%2d \n", rate);
 			mi->isProbingMod = true;
-               	} else if (rate + 1 <  MCS_GROUP_RATES && mi->isMultiplicative && !mi->trams_ossilate ) {
-			if (rate + rate < MCS_GROUP_RATES)
+               	} else if (rate < max_ridx && mi->isMultiplicative && !mi->trams_ossilate ) {
+			if (rate + rate <= max_ridx)
 				rate = rate + rate;
 			else
-				rate = MCS_GROUP_RATES - 1;
+				rate = max_ridx;
 			printk(KERN_DEBUG "increase multiplicatively rate to%2d \n", rate);
 			mi->isProbingMod = true;
 		}
@@ -347,6 +401,9 @@ trams_check_modulation_index(struct trams_ht_sta *mi)
 	}
 
 
+	/* skip rates the station does not support */
+	rate = trams_supported_ridx(mi, cgroup, rate);
+
 	last_tp = mi->trams_last_tp;
 	mi->trams_last_tp = cr->cur_tp;
 	mi->trams_last_ridx = mi->trams_cur_ridx; 
@@ -367,26 +424,28 @@ trams_check_modulation_index(struct trams_ht_sta *mi)
 
 
 /*
- * Look up an MCS group index based on mac80211 rate information
+ * Look up the rate table index of mac80211 rate information, -1 if the
+ * station does not support that rate
  */
 static int
-trams_ht_get_group_idx(struct ieee80211_tx_rate *rate)
+trams_ht_get_rate_idx(struct trams_ht_sta *mi, struct ieee80211_tx_rate *rate)
 {
-	int streams = (rate->idx / MCS_GROUP_RATES) + 1;
-	u32 flags = IEEE80211_TX_RC_SHORT_GI | IEEE80211_TX_RC_40_MHZ_WIDTH;
-	int i;
+	u32 flags = IEEE80211_TX_RC_MCS | IEEE80211_TX_RC_SHORT_GI |
+		    IEEE80211_TX_RC_40_MHZ_WIDTH;
+	int group, i;
 
-	for (i = 0; i < ARRAY_SIZE(trams_mcs_groups); i++) {
-		if (trams_mcs_groups[i].streams != streams)
-			continue;
-		if (trams_mcs_groups[i].flags != (rate->flags & flags))
+	for (group = 0; group < ARRAY_SIZE(trams_mcs_groups); group++) {
+		if (trams_mcs_groups[group].flags != (rate->flags & flags))
 			continue;
 
-		return i;
+		for (i = 0; i < MCS_GROUP_RATES; i++) {
+			if ((mi->groups[group].supported & BIT(i)) &&
+			    mi->groups[group].rix[i] == rate->idx)
+				return group * MCS_GROUP_RATES + i;
+		}
 	}
 
-	WARN_ON(1);
-	return 0;
+	return -1;
 }
 
 
@@ -447,6 +506,111 @@ trams_ht_calc_tp(struct minstrel_priv *mp, struct trams_ht_sta *mi,
 	mr->cur_tp = TRAMS_TRUNC((1000000 / usecs) * mr->probability);
 }
 
+/* the rate TRAMS transmits at and the first fallback after it */
+static inline int
+trams_ht_cur_rate(struct trams_ht_sta *mi)
+{
+	return mi->trams_curgroup * MCS_GROUP_RATES + mi->trams_cur_ridx;
+}
+
+static inline int
+trams_ht_fallback_rate(struct trams_ht_sta *mi)
+{
+	return mi->chain_len > 1 ? mi->chain[1] : trams_ht_cur_rate(mi);
+}
+
+/* false if the station shares no rate with us, nothing to adapt then */
+static inline bool
+trams_ht_has_rates(struct trams_ht_sta *mi)
+{
+	return mi->groups[mi->trams_curgroup].supported;
+}
+
+/* airtime of a single attempt at a rate, including the per-frame overhead */
+static unsigned int
+trams_ht_attempt_time(struct trams_ht_sta *mi, int index)
+{
+	const struct mcs_group *group = &trams_mcs_groups[index / MCS_GROUP_RATES];
+	unsigned int ampdu_len = max(TRAMS_TRUNC(mi->avg_ampdu_len), 1U);
+
+	return mi->overhead / ampdu_len + group->duration[index % MCS_GROUP_RATES];
+}
+
+/*
+ * Build the multi-rate retry chain. The first entry is the rate the
+ * TRAMS probing settled on. Every following entry is the rate that needs
+ * the least expected airtime per delivered frame, that is attempt time
+ * divided by delivery probability, among the measured rates slower than
+ * the previous entry, regardless of stream count, guard interval or
+ * channel width. Rates that were never tried or deliver less than 10% of
+ * the frames are not considered; if no such rate is left, the chain ends
+ * with the slowest supported rate.
+ */
+static void
+trams_ht_update_chain(struct minstrel_priv *mp, struct trams_ht_sta *mi)
+{
+	struct trams_rate_stats *mr;
+	unsigned int prev_time, time, best_time, robust_time = 0;
+	unsigned int max_len = min_t(unsigned int, TRAMS_CHAIN_LEN,
+				     max_t(int, mp->hw->max_rates, 1));
+	int group, i, index, best, robust = -1;
+
+	for (group = 0; group < ARRAY_SIZE(trams_mcs_groups); group++) {
+		for (i = 0; i < MCS_GROUP_RATES; i++) {
+			if (!(mi->groups[group].supported & BIT(i)))
+				continue;
+
+			index = group * MCS_GROUP_RATES + i;
+			time = trams_ht_attempt_time(mi, index);
+			if (time > robust_time) {
+				robust = index;
+				robust_time = time;
+			}
+		}
+	}
+
+	mi->chain[0] = trams_ht_cur_rate(mi);
+	mi->chain_len = 1;
+	prev_time = trams_ht_attempt_time(mi, mi->chain[0]);
+
+	while (mi->chain_len < max_len) {
+		best = -1;
+		best_time = UINT_MAX;
+
+		for (group = 0; group < ARRAY_SIZE(trams_mcs_groups); group++) {
+			for (i = 0; i < MCS_GROUP_RATES; i++) {
+				if (!(mi->groups[group].supported & BIT(i)))
+					continue;
+
+				index = group * MCS_GROUP_RATES + i;
+				time = trams_ht_attempt_time(mi, index);
+				if (time <= prev_time)
+					continue;
+
+				mr = &mi->groups[group].rates[i];
+				if (!mr->att_hist ||
+				    mr->probability < TRAMS_FRAC(1, 10))
+					continue;
+
+				time = TRAMS_FRAC(time, mr->probability);
+				if (time < best_time) {
+					best = index;
+					best_time = time;
+				}
+			}
+		}
+
+		if (best < 0) {
+			if (robust < 0 || robust_time <= prev_time)
+				break;
+			best = robust;
+		}
+
+		mi->chain[mi->chain_len++] = best;
+		prev_time = trams_ht_attempt_time(mi, best);
+	}
+}
+
 /*
  * Update rate statistics and select new primary rates
  *
@@ -567,6 +731,7 @@ trams_ht_update_stats(struct minstrel_priv *mp, struct trams_ht_sta *mi)
 	
 
 	trams_check_modulation_index(mi);
+	trams_ht_update_chain(mp, mi);
 	mi->stats_update = jiffies;
 	mi->stats_update_adaptive = jiffies;
 }
@@ -577,36 +742,10 @@ trams_ht_txstat_valid(struct ieee80211_tx_rate *rate)
 	if (!rate->count)
 		return false;
 
-	if (rate->idx < 0)
-		return false;
-
-	return !!(rate->flags & IEEE80211_TX_RC_MCS);
+	return rate->idx >= 0;
 }
 
 
-static void
-trams_aggr_check(struct minstrel_priv *mp, struct ieee80211_sta *pubsta, struct sk_buff *skb)
-{
-	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
-	struct sta_info *sta = container_of(pubsta, struct sta_info, sta);
-	u16 tid;
-
-	if (unlikely(!ieee80211_is_data_qos(hdr->frame_control)))
-		return;
-
-	if (unlikely(skb->protocol == cpu_to_be16(ETH_P_PAE)))
-		return;
-
-	tid = *ieee80211_get_qos_ctl(hdr) & IEEE80211_QOS_CTL_TID_MASK;
-	if (likely(sta->ampdu_mlme.tid_tx[tid]))
-		return;
-
-	if (skb_get_queue_mapping(skb) == IEEE80211_AC_VO)
-		return;
-
-	ieee80211_start_tx_ba_session(pubsta, tid, 5000);
-}
-
 //ddn
 static void
 trams_check_enhancement_index(struct trams_ht_sta *mi, struct ieee80211_tx_info *info, struct ieee80211_tx_rate *ar)
@@ -735,6 +874,170 @@ trams_check_enhancement_index(struct trams_ht_sta *mi, struct ieee80211_tx_info
 }
 
 
+static void
+trams_ht_fill_rate_stats(struct trams_ht_sta *mi, int index,
+			 struct nl80211_rate_stats *rs)
+{
+	const struct mcs_group *group = &trams_mcs_groups[index / MCS_GROUP_RATES];
+	struct trams_rate_stats *mr = trams_get_ratestats(mi, index);
+
+	rs->flags = 0;
+	if (group->flags & IEEE80211_TX_RC_MCS)
+		rs->flags |= NL80211_RATE_STATS_MCS;
+	if (group->flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
+		rs->flags |= NL80211_RATE_STATS_40_MHZ_WIDTH;
+	if (group->flags & IEEE80211_TX_RC_SHORT_GI)
+		rs->flags |= NL80211_RATE_STATS_SHORT_GI;
+	if (index == trams_ht_cur_rate(mi))
+		rs->flags |= NL80211_RATE_STATS_MAX_TP;
+	if (index == trams_ht_fallback_rate(mi))
+		rs->flags |= NL80211_RATE_STATS_MAX_TP2;
+	if (index == mi->max_prob_rate)
+		rs->flags |= NL80211_RATE_STATS_MAX_PROB;
+	rs->idx = mi->groups[index / MCS_GROUP_RATES].rix[index % MCS_GROUP_RATES];
+	rs->retry_count = mr->retry_count;
+
+	/* cur_tp is in units of 10 kbit/s */
+	rs->throughput = mr->cur_tp * 10;
+	rs->prob = mr->probability;
+	rs->cur_prob = mr->cur_prob;
+	rs->attempts = mr->last_attempts;
+	rs->success = mr->last_success;
+	rs->att_hist = mr->att_hist;
+	rs->succ_hist = mr->succ_hist;
+}
+
+static void
+trams_ht_update_rates(struct minstrel_priv *mp, struct trams_ht_sta_priv *msp);
+
+static size_t
+__trams_ht_get_rate_stats(void *priv, void *priv_sta, void *buf, size_t len)
+{
+	struct trams_ht_sta_priv *msp = priv_sta;
+	struct trams_ht_sta *mi = &msp->ht;
+	struct nl80211_rate_stats_hdr *hdr;
+	struct nl80211_rate_stats *rs;
+	int i, j, idx;
+
+	hdr = rate_control_stats_init(buf, len,
+				      NL80211_RATE_STATS_ALGO_TRAMS_HT);
+	if (!hdr)
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(mi->groups); i++) {
+		for (j = 0; j < MCS_GROUP_RATES; j++) {
+			idx = i * MCS_GROUP_RATES + j;
+
+			if (!(mi->groups[i].supported & BIT(j)))
+				continue;
+
+			if (!mi->groups[i].rates[j].att_hist &&
+			    idx != trams_ht_cur_rate(mi) &&
+			    idx != trams_ht_fallback_rate(mi) &&
+			    idx != mi->max_prob_rate)
+				continue;
+
+			rs = rate_control_stats_add(hdr, len);
+			if (!rs)
+				goto out;
+			trams_ht_fill_rate_stats(mi, idx, rs);
+		}
+	}
+
+out:
+	return rate_control_stats_len(hdr);
+}
+
+static size_t
+trams_ht_get_rate_stats(void *priv, void *priv_sta, void *buf, size_t len)
+{
+	struct trams_ht_sta_priv *msp = priv_sta;
+
+	spin_lock_bh(&msp->lock);
+	len = __trams_ht_get_rate_stats(priv, priv_sta, buf, len);
+	spin_unlock_bh(&msp->lock);
+
+	return len;
+}
+
+static void
+trams_ht_migrate_sta(void *priv, void *priv_sta, struct ieee80211_sta *sta,
+		     const void *stats, size_t len)
+{
+	struct trams_ht_sta_priv *msp = priv_sta;
+	struct trams_ht_sta *mi = &msp->ht;
+	struct minstrel_priv *mp = priv;
+	const struct nl80211_rate_stats_hdr *hdr;
+	const struct nl80211_rate_stats *rs;
+	struct trams_rate_stats *mr;
+	struct ieee80211_tx_rate rate;
+	int i, index, group, ridx;
+
+	hdr = rate_control_stats_parse(stats, len);
+	if (!hdr)
+		return;
+
+	spin_lock_bh(&msp->lock);
+
+	if (!trams_ht_has_rates(mi))
+		goto out;
+
+	for (i = 0; i < hdr->n_rates; i++) {
+		rs = rate_control_stats_get(hdr, i);
+
+		rate.idx = rs->idx;
+		rate.flags = 0;
+		if (rs->flags & NL80211_RATE_STATS_MCS)
+			rate.flags |= IEEE80211_TX_RC_MCS;
+		if (rs->flags & NL80211_RATE_STATS_SHORT_GI)
+			rate.flags |= IEEE80211_TX_RC_SHORT_GI;
+		if (rs->flags & NL80211_RATE_STATS_40_MHZ_WIDTH)
+			rate.flags |= IEEE80211_TX_RC_40_MHZ_WIDTH;
+
+		index = trams_ht_get_rate_idx(mi, &rate);
+		if (index < 0)
+			continue;
+
+		group = index / MCS_GROUP_RATES;
+		ridx = index % MCS_GROUP_RATES;
+		mr = &mi->groups[group].rates[ridx];
+		mr->probability = rs->prob;
+		mr->cur_prob = rs->cur_prob;
+		mr->att_hist = rs->att_hist;
+		mr->succ_hist = rs->succ_hist;
+		trams_ht_calc_tp(mp, mi, group, ridx);
+
+		/* continue from the rate the previous algorithm settled on */
+		if (rs->flags & NL80211_RATE_STATS_MAX_TP) {
+			mi->trams_curgroup = mi->trams_lastgroup = group;
+			mi->trams_cur_ridx = mi->trams_last_ridx = ridx;
+			mi->trams_cur_streams = trams_mcs_groups[group].streams;
+			mi->trams_cur_sgi = trams_mcs_groups[group].sgi;
+			mi->trams_cur_ht40 = trams_mcs_groups[group].ht40;
+		}
+		if (rs->flags & NL80211_RATE_STATS_MAX_PROB)
+			mi->max_prob_rate = index;
+	}
+
+	trams_ht_update_chain(mp, mi);
+	trams_ht_update_rates(mp, msp);
+out:
+	spin_unlock_bh(&msp->lock);
+}
+
+static void
+trams_ht_report_rates(struct minstrel_priv *mp, struct ieee80211_sta *sta,
+		      struct trams_ht_sta *mi)
+{
+	struct nl80211_rate_stats_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	trams_ht_fill_rate_stats(mi, trams_ht_cur_rate(mi), &ev.max_tp);
+	trams_ht_fill_rate_stats(mi, trams_ht_fallback_rate(mi), &ev.max_tp2);
+	trams_ht_fill_rate_stats(mi, mi->max_prob_rate, &ev.max_prob);
+	rate_control_event(mp->hw, sta, &ev, NL80211_RATE_STATS_ALGO_TRAMS_HT);
+}
+
 static void
 trams_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
                       struct ieee80211_sta *sta, void *priv_sta,
@@ -746,20 +1049,25 @@ trams_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 	struct ieee80211_tx_rate *ar = info->status.rates;
 	struct trams_rate_stats *rate;
 	struct minstrel_priv *mp = priv;
-	bool last = false;
-	int group;
+	unsigned int cur_rate, max_prob;
+	bool last = false, update = false;
+	int index;
 	int i = 0;
-	
-
-
-	if (!msp->is_ht)
-		return mac80211_minstrel.tx_status(priv, sband, sta, &msp->legacy, skb);
 
 	/* This packet was aggregated but doesn't carry status info */
 	if ((info->flags & IEEE80211_TX_CTL_AMPDU) &&
 	    !(info->flags & IEEE80211_TX_STAT_AMPDU))
 		return;
 
+	/* status may be reported on several CPUs at once */
+	spin_lock_bh(&msp->lock);
+
+	if (!trams_ht_has_rates(mi))
+		goto out;
+
+	cur_rate = trams_ht_cur_rate(mi);
+	max_prob = mi->max_prob_rate;
+
 	if (!(info->flags & IEEE80211_TX_STAT_AMPDU)) {
 		info->status.ampdu_ack_len =
 			(info->flags & IEEE80211_TX_STAT_ACK ? 1 : 0);
@@ -778,6 +1086,14 @@ trams_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 	if (info->flags & IEEE80211_TX_CTL_RATE_CTRL_PROBE)
 		mi->sample_packets += info->status.ampdu_len;
 
+	mi->total_packets += info->status.ampdu_len;
+
+	/* wraparound */
+	if (mi->total_packets >= ~0U >> 1) {
+		mi->total_packets = 0;
+		mi->sample_packets = 0;
+	}
+
 	for (i = 0; !last; i++) {
 		last = (i == IEEE80211_TX_MAX_RATES - 1) ||
 		       !trams_ht_txstat_valid(&ar[i + 1]);
@@ -785,15 +1101,24 @@ trams_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 		if (!trams_ht_txstat_valid(&ar[i]))
 			break;
 
-		group = trams_ht_get_group_idx(&ar[i]);
-		rate = &mi->groups[group].rates[ar[i].idx % 8];
+		/* e.g. management frames sent at a basic rate */
+		index = trams_ht_get_rate_idx(mi, &ar[i]);
+		if (index < 0)
+			break;
 
-		if (last)
+		rate = trams_get_ratestats(mi, index);
+
+		if (last) {
 			rate->success += info->status.ampdu_ack_len;
+			if (i < TRAMS_CHAIN_LEN)
+				mi->chain_delivered[i] +=
+					info->status.ampdu_ack_len;
+		}
 
 		rate->attempts += ar[i].count * info->status.ampdu_len;
 		rate->ampdu_len = info->status.ampdu_len;
 	}
+	mi->chain_lost += info->status.ampdu_len - info->status.ampdu_ack_len;
 
 
 
@@ -813,7 +1138,7 @@ trams_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 	//these function will be called every 100ms
 	if (time_after(jiffies, mi->stats_update + (UPDATE_INTERVAL / 2 * HZ) / 1000)) {
 		trams_ht_update_stats(mp, mi);
-		trams_aggr_check(mp, sta, skb);
+		update = true;
 	}
 	
 	if (time_after(jiffies, mi->stats_update_reset + (UPDATE_INTERVAL_RESET / 2 * HZ) / 1000)) {
@@ -830,6 +1155,20 @@ trams_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 
 		mi->stats_update_adaptive = jiffies;
 	}
+
+	if (cur_rate != trams_ht_cur_rate(mi)) {
+		trams_ht_update_chain(mp, mi);
+		update = true;
+	}
+
+	if (update)
+		trams_ht_update_rates(mp, msp);
+
+	if (cur_rate != trams_ht_cur_rate(mi) || max_prob != mi->max_prob_rate)
+		trams_ht_report_rates(mp, sta, mi);
+
+out:
+	spin_unlock_bh(&msp->lock);
 }
 
 static void
@@ -887,9 +1226,7 @@ trams_calc_retransmit(struct minstrel_priv *mp, struct trams_ht_sta *mi,
 
 static void
 trams_ht_set_rate(struct minstrel_priv *mp, struct trams_ht_sta *mi,
-                     struct ieee80211_tx_rate *rate, int index,
-                     struct ieee80211_tx_rate_control *txrc,
-                     bool sample, bool rtscts)
+                     struct ieee80211_tx_rate *rate, int index, bool rtscts)
 {
 	const struct mcs_group *group = &trams_mcs_groups[index / MCS_GROUP_RATES];
 	struct trams_rate_stats *mr;
@@ -898,19 +1235,17 @@ trams_ht_set_rate(struct minstrel_priv *mp, struct trams_ht_sta *mi,
 	if (!mr->retry_updated)
 		trams_calc_retransmit(mp, mi, index);
 
-	if (sample)
-		rate->count = 1;
-	else if (mr->probability < TRAMS_FRAC(20, 100))
+	if (mr->probability < TRAMS_FRAC(20, 100))
 		rate->count = 2;
 	else if (rtscts)
 		rate->count = mr->retry_count_rtscts;
 	else
 		rate->count = mr->retry_count;
 
-	rate->flags = IEEE80211_TX_RC_MCS | group->flags;
+	rate->flags = group->flags;
 	if (rtscts)
 		rate->flags |= IEEE80211_TX_RC_USE_RTS_CTS;
-	rate->idx = index % MCS_GROUP_RATES + (group->streams - 1) * MCS_GROUP_RATES;
+	rate->idx = mi->groups[index / MCS_GROUP_RATES].rix[index % MCS_GROUP_RATES];
 }
 
 static inline int
@@ -921,6 +1256,50 @@ trams_get_duration(int index)
 }
 
 
+/*
+ * Publish the retry chain for the TX path. Called with msp->lock held
+ * whenever the chain or the statistics behind the retry counts changed;
+ * readers see either the old or the new set, never a mix of both.
+ */
+static void
+trams_ht_update_rates(struct minstrel_priv *mp, struct trams_ht_sta_priv *msp)
+{
+	struct trams_ht_sta *mi = &msp->ht;
+	struct trams_ht_rates new, *old, *rates = NULL;
+	int i;
+
+	old = rcu_dereference_protected(msp->rates,
+					lockdep_is_held(&msp->lock));
+
+	if (mi->chain_len) {
+		memset(&new, 0, sizeof(new));
+		new.tx_flags = mi->tx_flags;
+		new.n_rates = mi->chain_len;
+		/* fallbacks go out with RTS/CTS, see trams_ht_update_chain() */
+		for (i = 0; i < mi->chain_len; i++)
+			trams_ht_set_rate(mp, mi, &new.rate[i], mi->chain[i],
+					  i > 0);
+
+		if (old && old->tx_flags == new.tx_flags &&
+		    old->n_rates == new.n_rates &&
+		    !memcmp(old->rate, new.rate, sizeof(new.rate)))
+			return;
+
+		/* on failure the TX path keeps using the old rates */
+		rates = kmemdup(&new, sizeof(new), GFP_ATOMIC);
+		if (!rates)
+			return;
+	}
+
+	rcu_assign_pointer(msp->rates, rates);
+	if (old)
+		kfree_rcu(old, rcu_head);
+}
+
+/*
+ * Runs concurrently with the status path and must not write to the
+ * station, it only copies out the rates published last.
+ */
 static void
 trams_ht_get_rate(void *priv, struct ieee80211_sta *sta, void *priv_sta,
                      struct ieee80211_tx_rate_control *txrc)
@@ -928,54 +1307,127 @@ trams_ht_get_rate(void *priv, struct ieee80211_sta *sta, void *priv_sta,
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(txrc->skb);
 	struct ieee80211_tx_rate *ar = info->status.rates;
 	struct trams_ht_sta_priv *msp = priv_sta;
-	struct trams_ht_sta *mi = &msp->ht;
-	struct minstrel_priv *mp = priv;
-	int rateidx = 0;
+	struct trams_ht_rates *rates;
+	int i;
 
 	if (rate_control_send_low(sta, priv_sta, txrc))
 		return;
 
-	if (!msp->is_ht)
-		return mac80211_minstrel.get_rate(priv, sta, &msp->legacy, txrc);
+	rcu_read_lock();
+	rates = rcu_dereference(msp->rates);
+	if (rates) {
+		info->flags |= rates->tx_flags;
+		for (i = 0; i < rates->n_rates; i++)
+			ar[i] = rates->rate[i];
 
-	info->flags |= mi->tx_flags;
+		if (i < IEEE80211_TX_MAX_RATES) {
+			ar[i].count = 0;
+			ar[i].idx = -1;
+		}
+	}
+	rcu_read_unlock();
 
-	rateidx = mi->trams_cur_ridx + mi->trams_curgroup * MCS_GROUP_RATES;
-	trams_ht_set_rate (mp, mi, &ar[0], rateidx >= 0 ? rateidx : -1, txrc, false, false);
+	if (rates)
+		return;
 
-	// At least 3 tx rates supported
-	if (mp->hw->max_rates >= 3) {
+	/* no rates published yet */
+	ar[0].idx = rate_lowest_index(txrc->sband, sta);
+	ar[0].count = txrc->hw->max_rate_tries;
+	ar[1].count = 0;
+	ar[1].idx = -1;
+}
 
-		rateidx = (mi->trams_cur_ridx - 1 > 0 ? mi->trams_cur_ridx - 1 : 0) + mi->trams_curgroup * MCS_GROUP_RATES;
-		trams_ht_set_rate (mp, mi, &ar[1], rateidx >= 0 ? rateidx : -1, txrc, false, true);
+static int 
+trams_highest_group (struct trams_ht_sta *mi)
+{
+	int group, ridx;
+	group = ARRAY_SIZE(trams_mcs_groups);
+	while (group > 0 ) {
+		group--;
+		if (!mi->groups[group].supported)
+			continue;
 
-		//duy: this one is borrowed from minstrel since your rate does not include multirate retry
-		trams_ht_set_rate(mp, mi, &ar[2], mi->max_prob_rate,
-                                     txrc, false, true);
+		ridx = fls(mi->groups[group].supported) - 1;
+    		mi->trams_cur_ridx = ridx;
+        	mi->trams_cur_streams = trams_mcs_groups[group].streams;
+        	mi->trams_cur_edx = 1;
+        	mi->trams_cur_sgi = trams_mcs_groups[group].sgi;
+        	mi->trams_cur_ht40 = trams_mcs_groups[group].ht40;
 
-		ar[3].count = 0;
-		ar[3].idx = -1;
-	// 2 tx rates supported
-	} else if (mp->hw->max_rates == 2) {
+		mi->trams_last_ridx = ridx;
+		mi->trams_last_streams = trams_mcs_groups[group].streams;
+		mi->trams_last_edx = 1;
+		mi->trams_last_sgi = trams_mcs_groups[group].sgi;
+		mi->trams_last_ht40 = trams_mcs_groups[group].ht40;
 
-		rateidx = (mi->trams_cur_ridx - 1 > 0 ? mi->trams_cur_ridx - 1 : 0) + mi->trams_curgroup * MCS_GROUP_RATES;
-		trams_ht_set_rate (mp, mi, &ar[1], rateidx >= 0 ? rateidx : -1, txrc, false, true);
 
-		ar[2].count = 0;
-		ar[2].idx = -1;
-	} else {
-		/* Not using MRR, only use the first rate */
-		ar[1].count = 0;
-		ar[1].idx = -1;
+		return group;	
 	}
+	return 0;
+}
+
+/* start probing from the highest rate of the fastest supported group */
+static void
+trams_ht_init_probing(struct trams_ht_sta *mi)
+{
+	mi->trams_lastgroup = mi->trams_curgroup = trams_highest_group(mi); 
+	mi->trams_skip20 = true;
+	mi->isProbingEn = false;
+	mi->isProbingMod = false;
+        mi->trams_last_tp = 0; 
+        mi->trams_elast_tp = 0; 
+        mi->trams_avg_tp = 0; 
+	mi->trams_eup_bad = 0;
+	mi->trams_edown_bad = 0;
+	mi->trams_ticks = 0;
+	mi->trams_time_interval = 1000;
+	mi->trams_consecutive = 0;
+	mi->isMultiplicative = false;
+	mi->trams_ossilate = 0;
+	mi->trams_successive = 0;
 
-	mi->total_packets++;
+	mi->trams_tx_ok = mi->trams_tx_err = mi->trams_tx_retr = mi->trams_tx_credit = 0;
+	mi->trams_stream_failure = mi->trams_stream_success = 0;
+}
 
-	/* wraparound */
-	if (mi->total_packets == ~0) {
-		mi->total_packets = 0;
-		mi->sample_packets = 0;
+/*
+ * Map the legacy groups onto the band's bitrates. Rates missing from the
+ * band (CCK on 5 GHz) or not supported by the station are left out.
+ */
+static int
+trams_ht_init_legacy(struct trams_ht_sta *mi,
+		     struct ieee80211_supported_band *sband,
+		     struct ieee80211_sta *sta)
+{
+	struct trams_mcs_group_data *mg;
+	int n_supported = 0;
+	int group, i, j;
+
+	for (group = TRAMS_CCK_GROUP; group < TRAMS_GROUPS; group++) {
+		mg = &mi->groups[group];
+
+		for (i = 0; i < MCS_GROUP_RATES; i++) {
+			if (!trams_mcs_groups[group].bitrate[i])
+				continue;
+
+			for (j = 0; j < sband->n_bitrates; j++) {
+				if (sband->bitrates[j].bitrate !=
+				    trams_mcs_groups[group].bitrate[i])
+					continue;
+
+				if (rate_supported(sta, sband->band, j)) {
+					mg->supported |= BIT(i);
+					mg->rix[i] = j;
+				}
+				break;
+			}
+		}
+
+		if (mg->supported)
+			n_supported++;
 	}
+
+	return n_supported;
 }
 
 static void
@@ -992,16 +1444,10 @@ trams_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
 	int n_supported = 0;
 	int ack_dur;
 	int stbc;
-	int i;
+	int i, j;
 
-	/* fall back to the old minstrel for legacy stations */
-	if (!sta->ht_cap.ht_supported)
-		goto use_legacy;
+	BUILD_BUG_ON(ARRAY_SIZE(trams_mcs_groups) != TRAMS_GROUPS);
 
-	BUILD_BUG_ON(ARRAY_SIZE(trams_mcs_groups) !=
-		TRAMS_MAX_STREAMS * TRAMS_STREAM_GROUPS);
-
-	msp->is_ht = true;
 	memset(mi, 0, sizeof(*mi));
 	mi->stats_update = jiffies;
 	mi->stats_update_adaptive = jiffies;
@@ -1022,18 +1468,14 @@ trams_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
 	}
 	mi->sample_tries = 4;
 
-	stbc = (sta_cap & IEEE80211_HT_CAP_RX_STBC) >>
-		IEEE80211_HT_CAP_RX_STBC_SHIFT;
-	mi->tx_flags |= stbc << IEEE80211_TX_CTL_STBC_SHIFT;
-
-	if (sta_cap & IEEE80211_HT_CAP_LDPC_CODING)
-		mi->tx_flags |= IEEE80211_TX_CTL_LDPC;
+	if (!sta->ht_cap.ht_supported)
+		goto legacy;
 
 	if (oper_chan_type != NL80211_CHAN_HT40MINUS &&
 	    oper_chan_type != NL80211_CHAN_HT40PLUS)
 		sta_cap &= ~IEEE80211_HT_CAP_SUP_WIDTH_20_40;
 
-	for (i = 0; i < ARRAY_SIZE(mi->groups); i++) {
+	for (i = 0; i < TRAMS_CCK_GROUP; i++) {
 		u16 req = 0;
 
 		mi->groups[i].supported = 0;
@@ -1053,49 +1495,36 @@ trams_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
 		mi->groups[i].supported =
 			mcs->rx_mask[trams_mcs_groups[i].streams - 1];
 
+		for (j = 0; j < MCS_GROUP_RATES; j++)
+			mi->groups[i].rix[j] =
+				(trams_mcs_groups[i].streams - 1) *
+				MCS_GROUP_RATES + j;
+
 		if (mi->groups[i].supported)
 			n_supported++;
 	}
 
-	if (!n_supported)
-		goto use_legacy;
-
-	return;
-
-use_legacy:
-	msp->is_ht = false;
-	memset(&msp->legacy, 0, sizeof(msp->legacy));
-	msp->legacy.r = msp->ratelist;
-	return mac80211_minstrel.rate_init(priv, sband, sta, &msp->legacy);
-}
-
-static int 
-trams_highest_group (struct trams_ht_sta *mi)
-{
-	int group;
-	group = ARRAY_SIZE(trams_mcs_groups);
-	while (group > 0 ) {
-		group--;
-		if (!mi->groups[group].supported)
-			continue;
+	if (n_supported) {
+		stbc = (sta_cap & IEEE80211_HT_CAP_RX_STBC) >>
+			IEEE80211_HT_CAP_RX_STBC_SHIFT;
+		mi->tx_flags |= stbc << IEEE80211_TX_CTL_STBC_SHIFT;
 
-		//perhpas check if these rates are supported
-    		mi->trams_cur_ridx = MCS_GROUP_RATES -1;
-        	mi->trams_cur_streams = trams_mcs_groups[group].streams;
-        	mi->trams_cur_edx = 1;
-        	mi->trams_cur_sgi = trams_mcs_groups[group].sgi;
-        	mi->trams_cur_ht40 = trams_mcs_groups[group].ht40;
+		if (sta_cap & IEEE80211_HT_CAP_LDPC_CODING)
+			mi->tx_flags |= IEEE80211_TX_CTL_LDPC;
 
-		mi->trams_last_ridx = MCS_GROUP_RATES -1;
-		mi->trams_last_streams = trams_mcs_groups[group].streams;
-		mi->trams_last_edx = 1;
-		mi->trams_last_sgi = trams_mcs_groups[group].sgi;
-		mi->trams_last_ht40 = trams_mcs_groups[group].ht40;
+		goto out;
+	}
 
+legacy:
+	/* legacy rates are only used for stations without any HT rate */
+	n_supported = trams_ht_init_legacy(mi, sband, sta);
 
-		return group;	
+out:
+	if (n_supported) {
+		trams_ht_init_probing(mi);
+		trams_ht_update_chain(mp, mi);
 	}
-	return 0;
+	trams_ht_update_rates(mp, msp);
 }
 
 static void
@@ -1103,34 +1532,11 @@ trams_ht_rate_init(void *priv, struct ieee80211_supported_band *sband,
                       struct ieee80211_sta *sta, void *priv_sta)
 {
 	struct minstrel_priv *mp = priv;
-
-	//ddn	
 	struct trams_ht_sta_priv *msp = priv_sta;
-	struct trams_ht_sta *mi = &msp->ht;
-
-	mi->trams_lastgroup = mi->trams_curgroup = trams_highest_group(mi); 
-	mi->trams_skip20 = true;
-	mi->isProbingEn = false;
-	mi->isProbingMod = false;
-        mi->trams_last_tp = 0; 
-        mi->trams_elast_tp = 0; 
-        mi->trams_avg_tp = 0; 
-	mi->trams_eup_bad = 0;
-	mi->trams_edown_bad = 0;
-	mi->trams_ticks = 0;
-	mi->trams_time_interval = 1000;
-	mi->trams_consecutive = 0;
-	mi->isMultiplicative = false;
-	mi->trams_ossilate = 0;
-	mi->trams_successive = 0;
-
-	//TODO: check to see if it's supported?
-	mi->trams_cur_ridx = MCS_GROUP_RATES - 1;
-	mi->trams_tx_ok = mi->trams_tx_err = mi->trams_tx_retr = mi->trams_tx_credit = 0;
-	mi->trams_stream_failure = mi->trams_stream_success = 0;
-
 
+	spin_lock_bh(&msp->lock);
 	trams_ht_update_caps(priv, sband, sta, priv_sta, mp->hw->conf.channel_type);
+	spin_unlock_bh(&msp->lock);
 }
 
 static void
@@ -1138,40 +1544,25 @@ trams_ht_rate_update(void *priv, struct ieee80211_supported_band *sband,
                         struct ieee80211_sta *sta, void *priv_sta,
                         u32 changed, enum nl80211_channel_type oper_chan_type)
 {
+	struct trams_ht_sta_priv *msp = priv_sta;
 
-
+	spin_lock_bh(&msp->lock);
 	trams_ht_update_caps(priv, sband, sta, priv_sta, oper_chan_type);
+	spin_unlock_bh(&msp->lock);
 }
 
 static void *
 trams_ht_alloc_sta(void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 {
-	struct ieee80211_supported_band *sband;
 	struct trams_ht_sta_priv *msp;
-	struct minstrel_priv *mp = priv;
-	struct ieee80211_hw *hw = mp->hw;
-	int max_rates = 0;
-	int i;
 
-	for (i = 0; i < IEEE80211_NUM_BANDS; i++) {
-		sband = hw->wiphy->bands[i];
-		if (sband && sband->n_bitrates > max_rates)
-			max_rates = sband->n_bitrates;
-	}
-
-	msp = kzalloc(sizeof(struct trams_ht_sta), gfp);
+	msp = kzalloc(sizeof(struct trams_ht_sta_priv), gfp);
 	if (!msp)
 		return NULL;
 
-	msp->ratelist = kzalloc(sizeof(struct minstrel_rate) * max_rates, gfp);
-	if (!msp->ratelist)
-		goto error;
+	spin_lock_init(&msp->lock);
 
 	return msp;
-
-error:
-	kfree(msp);
-	return NULL;
 }
 
 static void
@@ -1179,7 +1570,8 @@ trams_ht_free_sta(void *priv, struct ieee80211_sta *sta, void *priv_sta)
 {
 	struct trams_ht_sta_priv *msp = priv_sta;
 
-	kfree(msp->ratelist);
+	/* the station is gone, no TX path can still be looking */
+	kfree(rcu_dereference_protected(msp->rates, 1));
 	kfree(msp);
 }
 
@@ -1209,6 +1601,8 @@ static struct rate_control_ops mac80211_trams_ht = {
 	.add_sta_debugfs = trams_ht_add_sta_debugfs,
 	.remove_sta_debugfs = trams_ht_remove_sta_debugfs,
 #endif
+	.get_rate_stats = trams_ht_get_rate_stats,
+	.migrate_sta = trams_ht_migrate_sta,
 };
 
 int __init
@@ -23,12 +23,27 @@
 #define MCS_GROUP_RATES	8
 #define TRAMS_MAX_STREAMS 3
 
+/*
+ * Legacy rates are kept in two groups after the HT ones, so that HT and
+ * non-HT stations share one rate table and one probing algorithm.
+ */
+#define TRAMS_CCK_GROUP		(TRAMS_MAX_STREAMS * TRAMS_STREAM_GROUPS)
+#define TRAMS_OFDM_GROUP	(TRAMS_CCK_GROUP + 1)
+#define TRAMS_GROUPS		(TRAMS_OFDM_GROUP + 1)
+
+/* maximum number of entries in the multi-rate retry chain */
+#define TRAMS_CHAIN_LEN	4
+
 struct mcs_group {
+	/* TX rate flags, IEEE80211_TX_RC_MCS is only set for HT groups */
 	u32 flags;
 	unsigned int sgi;
 	unsigned int ht40;
 	unsigned int streams;
 	unsigned int duration[MCS_GROUP_RATES];
+
+	/* legacy groups: bitrate of each rate in 100 kbps, 0 if unused */
+	u16 bitrate[MCS_GROUP_RATES];
 };
 
 extern const struct mcs_group trams_mcs_groups[];
@@ -67,6 +82,12 @@ struct trams_mcs_group_data {
 	/* bitfield of supported MCS rates of this group */
 	u8 supported;
 
+	/*
+	 * mac80211 rate index of each supported rate: the MCS index for HT
+	 * groups, the index into the band's bitrates for legacy groups
+	 */
+	u8 rix[MCS_GROUP_RATES];
+
 	/* selected primary rates */
 	unsigned int max_tp_rate;
 	unsigned int max_tp_rate2;
@@ -175,20 +196,46 @@ struct trams_ht_sta {
 	/* current MCS group to be sampled */
 	u8 sample_group;
 
+	/*
+	 * Multi-rate retry chain: the current TRAMS rate followed by
+	 * fallbacks picked from the measured statistics, rebuilt when
+	 * either changes.
+	 */
+	unsigned int chain[TRAMS_CHAIN_LEN];
+	unsigned int chain_len;
+
+	/* frames delivered by each chain entry, and lost after all of them */
+	unsigned int chain_delivered[TRAMS_CHAIN_LEN];
+	unsigned int chain_lost;
+
 	/* MCS rate group info and statistics */
-	struct trams_mcs_group_data groups[TRAMS_MAX_STREAMS * TRAMS_STREAM_GROUPS];
+	struct trams_mcs_group_data groups[TRAMS_GROUPS];
+};
+
+/*
+ * Rates for the TX path, built from the retry chain by the status path
+ * and never modified once published.
+ */
+struct trams_ht_rates {
+	struct rcu_head rcu_head;
+	u32 tx_flags;
+	unsigned int n_rates;
+	struct ieee80211_tx_rate rate[TRAMS_CHAIN_LEN];
 };
 
 struct trams_ht_sta_priv {
-	union {
-		struct trams_ht_sta ht;
-		struct minstrel_sta_info legacy;
-	};
+	/*
+	 * protects everything below except rates; taken by the status
+	 * path and by configuration changes, never by the TX path
+	 */
+	spinlock_t lock;
+	struct trams_ht_sta ht;
 #ifdef CONFIG_MAC80211_DEBUGFS
 	struct dentry *dbg_stats;
 #endif
-	void *ratelist;
-	bool is_ht;
+
+	/* current TX rates, NULL while the station has no usable rate */
+	struct trams_ht_rates __rcu *rates;
 };
 
 void trams_ht_add_sta_debugfs(void *priv, void *priv_sta, struct dentry *dir);
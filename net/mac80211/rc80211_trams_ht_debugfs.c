@@ -14,6 +14,33 @@
 #include "rc80211_minstrel.h"
 #include "rc80211_trams_ht.h"
 
+/*
+ * Room for one line of the statistics, with every number printed at
+ * its widest, and for the lines that aren't per rate or chain entry.
+ */
+#define TRAMS_HT_STATS_LINE	128
+#define TRAMS_HT_STATS_EXTRA	6
+
+/* group and rate of a rate table entry, with flags in front of the rate */
+static int
+trams_ht_rate_name(char *p, size_t size, int index, const char *flags)
+{
+	const struct mcs_group *mg = &trams_mcs_groups[index / MCS_GROUP_RATES];
+	int ridx = index % MCS_GROUP_RATES;
+
+	if (!(mg->flags & IEEE80211_TX_RC_MCS))
+		return scnprintf(p, size, "%-9s%s%2u.%uM",
+				 index / MCS_GROUP_RATES == TRAMS_CCK_GROUP ?
+				 "CCK" : "OFDM", flags,
+				 mg->bitrate[ridx] / 10,
+				 mg->bitrate[ridx] % 10);
+
+	return scnprintf(p, size, "HT%c0/%cGI %sMCS%-2u",
+			 (mg->flags & IEEE80211_TX_RC_40_MHZ_WIDTH) ? '4' : '2',
+			 (mg->flags & IEEE80211_TX_RC_SHORT_GI) ? 'S' : 'L',
+			 flags, (mg->streams - 1) * MCS_GROUP_RATES + ridx);
+}
+
 static int
 trams_ht_stats_open(struct inode *inode, struct file *file)
 {
@@ -21,38 +48,37 @@ trams_ht_stats_open(struct inode *inode, struct file *file)
 	struct trams_ht_sta *mi = &msp->ht;
 	struct minstrel_debugfs_info *ms;
 	unsigned int i, j, tp, prob;//, eprob;
-	char *p;
-	int ret;
-
-	if (!msp->is_ht) {
-		inode->i_private = &msp->legacy;
-		ret = minstrel_stats_open(inode, file);
-		inode->i_private = msp;
-		return ret;
-	}
+	unsigned int lines = TRAMS_HT_STATS_EXTRA + TRAMS_CHAIN_LEN;
+	size_t size;
+	char flags[4];
+	char *p, *end;
 
-	ms = kmalloc(sizeof(*ms) + 8192, GFP_KERNEL);
+	for (i = 0; i < TRAMS_GROUPS; i++)
+		lines += hweight8(mi->groups[i].supported);
+	size = lines * TRAMS_HT_STATS_LINE;
+
+	ms = kmalloc(sizeof(*ms) + size, GFP_KERNEL);
 	if (!ms)
 		return -ENOMEM;
 
 	file->private_data = ms;
 	p = ms->buf;
-	p += sprintf(p, "type        rate throughput  this prob  "
+	end = ms->buf + size;
+
+	/*
+	 * The supported rates may change until the lock is taken, so the
+	 * output is still bounded by the buffer rather than trusting the
+	 * count above.
+	 */
+	spin_lock_bh(&msp->lock);
+	p += scnprintf(p, end - p, "type        rate throughput  this prob  "
 			"this succ/attempt   success    attempts\n");
 	//p += sprintf(p, "type rate throughput  ewma prob   this prob  "
 	//		"this succ/attempt   success    attempts\n");
-	for (i = 0; i < TRAMS_MAX_STREAMS * TRAMS_STREAM_GROUPS; i++) {
-		char htmode = '2';
-		char gimode = 'L';
-
+	for (i = 0; i < TRAMS_GROUPS; i++) {
 		if (!mi->groups[i].supported)
 			continue;
 
-		if (trams_mcs_groups[i].flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
-			htmode = '4';
-		if (trams_mcs_groups[i].flags & IEEE80211_TX_RC_SHORT_GI)
-			gimode = 'S';
-
 		for (j = 0; j < MCS_GROUP_RATES; j++) {
 			struct trams_rate_stats *mr = &mi->groups[i].rates[j];
 			int idx = i * MCS_GROUP_RATES + j;
@@ -60,19 +86,18 @@ trams_ht_stats_open(struct inode *inode, struct file *file)
 			if (!(mi->groups[i].supported & BIT(j)))
 				continue;
 
-			p += sprintf(p, "HT%c0/%cGI ", htmode, gimode);
-
-			*(p++) = (idx == mi->max_tp_rate) ? 'T' : ' ';
-			*(p++) = (idx == mi->max_tp_rate2) ? 't' : ' ';
-			*(p++) = (idx == mi->max_prob_rate) ? 'P' : ' ';
-			p += sprintf(p, "MCS%-2u", (trams_mcs_groups[i].streams - 1) *
-					MCS_GROUP_RATES + j);
+			flags[0] = (idx == mi->max_tp_rate) ? 'T' : ' ';
+			flags[1] = (idx == mi->max_tp_rate2) ? 't' : ' ';
+			flags[2] = (idx == mi->max_prob_rate) ? 'P' : ' ';
+			flags[3] = 0;
+			p += trams_ht_rate_name(p, end - p, idx, flags);
 
 			tp = mr->cur_tp / 10;
 			prob = TRAMS_TRUNC(mr->cur_prob * 1000);
 			//eprob = MINSTREL_TRUNC(mr->probability * 1000);
 
-			p += sprintf(p, "  %6u.%1u   %6u.%1u           "
+			p += scnprintf(p, end - p,
+					"  %6u.%1u   %6u.%1u           "
 					"%3u(%3u)   %8llu    %8llu\n",
 					tp / 10, tp % 10,
 					//eprob / 10, eprob % 10,
@@ -87,12 +112,22 @@ trams_ht_stats_open(struct inode *inode, struct file *file)
 //			"lookaround %d\n",
 //			max(0, (int) mi->total_packets - (int) mi->sample_packets),
 //			mi->sample_packets);
-	p += sprintf(p, "\nTotal packet count::    ideal %d      ",
+	p += scnprintf(p, end - p, "\nTotal packet count::    ideal %d      ",
 			max(0, (int) mi->total_packets - (int) mi->sample_packets)
 			);
-	p += sprintf(p, "Average A-MPDU length: %d.%d\n",
+	p += scnprintf(p, end - p, "Average A-MPDU length: %d.%d\n",
 		TRAMS_TRUNC(mi->avg_ampdu_len),
 		TRAMS_TRUNC(mi->avg_ampdu_len * 10) % 10);
+
+	p += scnprintf(p, end - p, "\nRetry chain     delivered\n");
+	for (i = 0; i < mi->chain_len; i++) {
+		p += scnprintf(p, end - p, "%u: ", i);
+		p += trams_ht_rate_name(p, end - p, mi->chain[i], "");
+		p += scnprintf(p, end - p, " %10u\n", mi->chain_delivered[i]);
+	}
+	p += scnprintf(p, end - p, "lost %21u\n", mi->chain_lost);
+
+	spin_unlock_bh(&msp->lock);
 	ms->len = p - ms->buf;
 
 	return nonseekable_open(inode, file);
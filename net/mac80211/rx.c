@@ -10,6 +10,7 @@
  */
 
 #include <linux/jiffies.h>
+#include <linux/jhash.h>
 #include <linux/slab.h>
 #include <linux/kernel.h>
 #include <linux/skbuff.h>
@@ -54,6 +55,55 @@ static struct sk_buff *remove_monitor_info(struct ieee80211_local *local,
 	return skb;
 }
 
+/*
+ * The RX skb may share its data with the frames handed to monitor
+ * interfaces and to the other virtual interfaces the frame is for,
+ * see ieee80211_rx_monitor() and ieee80211_prepare_and_rx_handle().
+ * Handlers that modify the frame data must call this first to get
+ * a private copy.
+ */
+static int ieee80211_rx_make_writable(struct ieee80211_rx_data *rx)
+{
+	if (!skb_cloned(rx->skb))
+		return 0;
+
+	rx->local->rx_cow_copies++;
+	return pskb_expand_head(rx->skb, 0, 0, GFP_ATOMIC);
+}
+
+/*
+ * Build a monitor frame that shares the data of @origskb: the radiotap
+ * header goes into a small head of its own and a clone of the original
+ * frame is chained behind it, so nothing needs to be copied here.
+ */
+static struct sk_buff *
+ieee80211_rx_share_skb(struct ieee80211_local *local, struct sk_buff *origskb,
+		       int needed_headroom)
+{
+	struct sk_buff *skb, *data;
+
+	skb = dev_alloc_skb(needed_headroom);
+	if (!skb)
+		return NULL;
+
+	data = skb_clone(origskb, GFP_ATOMIC);
+	if (!data) {
+		dev_kfree_skb(skb);
+		return NULL;
+	}
+
+	skb_reserve(skb, needed_headroom);
+	memcpy(skb->cb, origskb->cb, sizeof(skb->cb));
+
+	skb_shinfo(skb)->frag_list = data;
+	skb->len += data->len;
+	skb->data_len += data->len;
+	skb->truesize += data->truesize;
+
+	local->rx_shared_skbs++;
+	return skb;
+}
+
 static inline int should_drop_frame(struct sk_buff *skb,
 				    int present_fcs_len)
 {
@@ -234,12 +284,14 @@ ieee80211_rx_monitor(struct ieee80211_local *local, struct sk_buff *origskb,
 	int present_fcs_len = 0;
 
 	/*
-	 * First, we may need to make a copy of the skb because
+	 * First, we may need a second skb because
 	 *  (1) we need to modify it for radiotap (if not present), and
 	 *  (2) the other RX handlers will modify the skb we got.
 	 *
-	 * We don't need to, of course, if we aren't going to return
-	 * the SKB because it has a bad FCS/PLCP checksum.
+	 * The data itself is shared, the RX handlers copy it only when
+	 * they actually modify it. We don't need a second skb at all,
+	 * of course, if we aren't going to return the SKB because it
+	 * has a bad FCS/PLCP checksum.
 	 */
 
 	/* room for the radiotap header based on driver features */
@@ -282,10 +334,10 @@ ieee80211_rx_monitor(struct ieee80211_local *local, struct sk_buff *origskb,
 		}
 	} else {
 		/*
-		 * Need to make a copy and possibly remove radiotap header
-		 * and FCS from the original.
+		 * Need to share the data and possibly remove radiotap
+		 * header and FCS from the original.
 		 */
-		skb = skb_copy_expand(origskb, needed_headroom, 0, GFP_ATOMIC);
+		skb = ieee80211_rx_share_skb(local, origskb, needed_headroom);
 
 		origskb = remove_monitor_info(local, origskb);
 
@@ -320,8 +372,7 @@ ieee80211_rx_monitor(struct ieee80211_local *local, struct sk_buff *origskb,
 		}
 
 		prev_dev = sdata->dev;
-		sdata->dev->stats.rx_packets++;
-		sdata->dev->stats.rx_bytes += skb->len;
+		ieee80211_sdata_rx_stats(sdata, skb->len);
 	}
 
 	if (prev_dev) {
@@ -1063,6 +1114,10 @@ ieee80211_rx_h_decrypt(struct ieee80211_rx_data *rx)
 		return RX_DROP_MONITOR;
 	}
 
+	/* all the decrypt handlers modify the frame in place */
+	if (ieee80211_rx_make_writable(rx))
+		return RX_DROP_UNUSABLE;
+
 	switch (rx->key->conf.cipher) {
 	case WLAN_CIPHER_SUITE_WEP40:
 	case WLAN_CIPHER_SUITE_WEP104:
@@ -1135,6 +1190,7 @@ static void ap_sta_ps_start(struct sta_info *sta)
 	set_sta_flag(sta, WLAN_STA_PS_STA);
 	if (!(local->hw.flags & IEEE80211_HW_AP_LINK_PS))
 		drv_sta_notify(local, sdata, STA_NOTIFY_SLEEP, &sta->sta);
+	ieee80211_sta_txq_ps_start(sta);
 #ifdef CONFIG_MAC80211_VERBOSE_PS_DEBUG
 	printk(KERN_DEBUG "%s: STA %pM aid %d enters power save mode\n",
 	       sdata->name, sta->sta.addr, sta->sta.aid);
@@ -1300,7 +1356,7 @@ ieee80211_rx_h_sta_process(struct ieee80211_rx_data *rx)
 		ieee80211_sta_rx_notify(rx->sdata, hdr);
 
 	sta->rx_fragments++;
-	sta->rx_bytes += rx->skb->len;
+	sta_stats_rx(sta, 0, rx->skb->len);
 	if (!(status->flag & RX_FLAG_NO_SIGNAL_VAL)) {
 		sta->last_signal = status->signal;
 		ewma_add(&sta->avg_signal, -status->signal);
@@ -1361,7 +1417,7 @@ ieee80211_rx_h_sta_process(struct ieee80211_rx_data *rx)
 		 * Update counter and free packet here to avoid
 		 * counting this as a dropped packed.
 		 */
-		sta->rx_packets++;
+		sta_stats_rx(sta, 1, 0);
 		dev_kfree_skb(rx->skb);
 		return RX_QUEUED;
 	}
@@ -1369,41 +1425,121 @@ ieee80211_rx_h_sta_process(struct ieee80211_rx_data *rx)
 	return RX_CONTINUE;
 } /* ieee80211_rx_h_sta_process */
 
+static inline struct hlist_head *
+ieee80211_fragment_bucket(struct ieee80211_sub_if_data *sdata,
+			  const u8 *addr, unsigned int rx_queue)
+{
+	u32 hash = jhash(addr, ETH_ALEN, rx_queue);
+
+	return &sdata->fragments[hash & (IEEE80211_FRAGMENT_HASH_SIZE - 1)];
+}
+
+static void ieee80211_fragment_free(struct ieee80211_sub_if_data *sdata,
+				    struct ieee80211_fragment_entry *entry)
+{
+	hlist_del(&entry->hash_node);
+	list_del(&entry->lru);
+	sdata->fragment_entries--;
+	sdata->fragment_mem -= entry->mem;
+	dev_kfree_skb(entry->skb);
+	kfree(entry);
+}
+
+static void ieee80211_fragment_evict(struct ieee80211_sub_if_data *sdata,
+				     struct ieee80211_fragment_entry *entry)
+{
+#ifdef CONFIG_MAC80211_VERBOSE_DEBUG
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) entry->skb->data;
+
+	printk(KERN_DEBUG "%s: RX reassembly removed fragment entry "
+	       "(age=%lu seq=%d last_frag=%d addr1=%pM addr2=%pM)\n",
+	       sdata->name, jiffies - entry->first_frag_time, entry->seq,
+	       entry->last_frag, hdr->addr1, hdr->addr2);
+#endif
+	sdata->fragment_evictions++;
+	ieee80211_fragment_free(sdata, entry);
+}
+
+/*
+ * Evict the oldest entries (other than @keep) until another @mem bytes
+ * fit into the budget and, if @keep is NULL, another entry fits as well.
+ */
+static void ieee80211_fragment_make_room(struct ieee80211_sub_if_data *sdata,
+					 struct ieee80211_fragment_entry *keep,
+					 unsigned int mem)
+{
+	struct ieee80211_fragment_entry *entry, *tmp;
+
+	list_for_each_entry_safe(entry, tmp, &sdata->fragment_lru, lru) {
+		if (sdata->fragment_mem + mem <= IEEE80211_FRAGMENT_MEM_BUDGET &&
+		    (keep || sdata->fragment_entries < IEEE80211_FRAGMENT_MAX))
+			break;
+		if (entry != keep)
+			ieee80211_fragment_evict(sdata, entry);
+	}
+}
+
+void ieee80211_fragment_purge(struct ieee80211_sub_if_data *sdata)
+{
+	struct ieee80211_fragment_entry *entry, *tmp;
+
+	list_for_each_entry_safe(entry, tmp, &sdata->fragment_lru, lru)
+		ieee80211_fragment_free(sdata, entry);
+}
+
+static struct ieee80211_fragment_entry *
+ieee80211_fragment_lookup(struct ieee80211_sub_if_data *sdata,
+			  const u8 *addr, unsigned int rx_queue)
+{
+	struct ieee80211_fragment_entry *entry;
+	struct hlist_node *node;
+
+	hlist_for_each_entry(entry, node,
+			     ieee80211_fragment_bucket(sdata, addr, rx_queue),
+			     hash_node) {
+		if (entry->rx_queue == rx_queue &&
+		    compare_ether_addr(entry->addr, addr) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
 static inline struct ieee80211_fragment_entry *
 ieee80211_reassemble_add(struct ieee80211_sub_if_data *sdata,
 			 unsigned int frag, unsigned int seq, int rx_queue,
 			 struct sk_buff **skb)
 {
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) (*skb)->data;
 	struct ieee80211_fragment_entry *entry;
-	int idx;
 
-	idx = sdata->fragment_next;
-	entry = &sdata->fragments[sdata->fragment_next++];
-	if (sdata->fragment_next >= IEEE80211_FRAGMENT_MAX)
-		sdata->fragment_next = 0;
+	/* a new first fragment supersedes the previous MSDU on this queue */
+	entry = ieee80211_fragment_lookup(sdata, hdr->addr2, rx_queue);
+	if (entry)
+		ieee80211_fragment_evict(sdata, entry);
 
-	if (!skb_queue_empty(&entry->skb_list)) {
-#ifdef CONFIG_MAC80211_VERBOSE_DEBUG
-		struct ieee80211_hdr *hdr =
-			(struct ieee80211_hdr *) entry->skb_list.next->data;
-		printk(KERN_DEBUG "%s: RX reassembly removed oldest "
-		       "fragment entry (idx=%d age=%lu seq=%d last_frag=%d "
-		       "addr1=%pM addr2=%pM\n",
-		       sdata->name, idx,
-		       jiffies - entry->first_frag_time, entry->seq,
-		       entry->last_frag, hdr->addr1, hdr->addr2);
-#endif
-		__skb_queue_purge(&entry->skb_list);
-	}
+	ieee80211_fragment_make_room(sdata, NULL, (*skb)->truesize);
+
+	entry = kzalloc(sizeof(*entry), GFP_ATOMIC);
+	if (!entry)
+		return NULL;
+
+	memcpy(entry->addr, hdr->addr2, ETH_ALEN);
+	hlist_add_head(&entry->hash_node,
+		       ieee80211_fragment_bucket(sdata, entry->addr, rx_queue));
+	list_add_tail(&entry->lru, &sdata->fragment_lru);
+	sdata->fragment_entries++;
 
-	__skb_queue_tail(&entry->skb_list, *skb); /* no need for locking */
+	entry->skb = *skb;
+	entry->tail = *skb;
+	entry->mem = (*skb)->truesize;
+	sdata->fragment_mem += entry->mem;
 	*skb = NULL;
 	entry->first_frag_time = jiffies;
 	entry->seq = seq;
 	entry->rx_queue = rx_queue;
 	entry->last_frag = frag;
 	entry->ccmp = 0;
-	entry->extra_len = 0;
 
 	return entry;
 }
@@ -1414,41 +1550,52 @@ ieee80211_reassemble_find(struct ieee80211_sub_if_data *sdata,
 			  int rx_queue, struct ieee80211_hdr *hdr)
 {
 	struct ieee80211_fragment_entry *entry;
-	int i, idx;
+	struct ieee80211_hdr *f_hdr;
 
-	idx = sdata->fragment_next;
-	for (i = 0; i < IEEE80211_FRAGMENT_MAX; i++) {
-		struct ieee80211_hdr *f_hdr;
+	entry = ieee80211_fragment_lookup(sdata, hdr->addr2, rx_queue);
+	if (!entry || entry->seq != seq || entry->last_frag + 1 != frag)
+		return NULL;
 
-		idx--;
-		if (idx < 0)
-			idx = IEEE80211_FRAGMENT_MAX - 1;
+	f_hdr = (struct ieee80211_hdr *)entry->skb->data;
 
-		entry = &sdata->fragments[idx];
-		if (skb_queue_empty(&entry->skb_list) || entry->seq != seq ||
-		    entry->rx_queue != rx_queue ||
-		    entry->last_frag + 1 != frag)
-			continue;
+	/*
+	 * Check ftype and addresses are equal, else check next fragment
+	 */
+	if (((hdr->frame_control ^ f_hdr->frame_control) &
+	     cpu_to_le16(IEEE80211_FCTL_FTYPE)) ||
+	    compare_ether_addr(hdr->addr1, f_hdr->addr1) != 0)
+		return NULL;
 
-		f_hdr = (struct ieee80211_hdr *)entry->skb_list.next->data;
+	if (time_after(jiffies, entry->first_frag_time + 2 * HZ)) {
+		ieee80211_fragment_evict(sdata, entry);
+		return NULL;
+	}
 
-		/*
-		 * Check ftype and addresses are equal, else check next fragment
-		 */
-		if (((hdr->frame_control ^ f_hdr->frame_control) &
-		     cpu_to_le16(IEEE80211_FCTL_FTYPE)) ||
-		    compare_ether_addr(hdr->addr1, f_hdr->addr1) != 0 ||
-		    compare_ether_addr(hdr->addr2, f_hdr->addr2) != 0)
-			continue;
+	return entry;
+}
 
-		if (time_after(jiffies, entry->first_frag_time + 2 * HZ)) {
-			__skb_queue_purge(&entry->skb_list);
-			continue;
-		}
-		return entry;
-	}
+/*
+ * Chain a (header-less) fragment behind the ones already held by @entry,
+ * the data isn't copied.
+ */
+static void ieee80211_reassemble_chain(struct ieee80211_sub_if_data *sdata,
+				       struct ieee80211_fragment_entry *entry,
+				       struct sk_buff *skb)
+{
+	struct sk_buff *head = entry->skb;
 
-	return NULL;
+	if (entry->tail == head)
+		skb_shinfo(head)->frag_list = skb;
+	else
+		entry->tail->next = skb;
+	entry->tail = skb;
+
+	head->len += skb->len;
+	head->data_len += skb->len;
+	head->truesize += skb->truesize;
+
+	entry->mem += skb->truesize;
+	sdata->fragment_mem += skb->truesize;
 }
 
 static ieee80211_rx_result debug_noinline
@@ -1459,7 +1606,6 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 	__le16 fc;
 	unsigned int frag, seq;
 	struct ieee80211_fragment_entry *entry;
-	struct sk_buff *skb;
 	struct ieee80211_rx_status *status;
 
 	hdr = (struct ieee80211_hdr *)rx->skb->data;
@@ -1475,7 +1621,7 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 	}
 	I802_DEBUG_INC(rx->local->rx_handlers_fragments);
 
-	if (skb_linearize(rx->skb))
+	if (ieee80211_rx_make_writable(rx) || skb_linearize(rx->skb))
 		return RX_DROP_UNUSABLE;
 
 	/*
@@ -1490,6 +1636,8 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 		/* This is the first fragment of a new frame. */
 		entry = ieee80211_reassemble_add(rx->sdata, frag, seq,
 						 rx->seqno_idx, &(rx->skb));
+		if (!entry)
+			return RX_DROP_UNUSABLE;
 		if (rx->key && rx->key->conf.cipher == WLAN_CIPHER_SUITE_CCMP &&
 		    ieee80211_has_protected(fc)) {
 			int queue = rx->security_idx;
@@ -1509,9 +1657,11 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 	entry = ieee80211_reassemble_find(rx->sdata, frag, seq,
 					  rx->seqno_idx, hdr);
 	if (!entry) {
+		rx->sdata->fragment_misses++;
 		I802_DEBUG_INC(rx->local->rx_handlers_drop_defrag);
 		return RX_DROP_MONITOR;
 	}
+	rx->sdata->fragment_hits++;
 
 	/* Verify that MPDUs within one MSDU have sequential PN values.
 	 * (IEEE 802.11i, 8.3.3.4.5) */
@@ -1535,28 +1685,17 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 	}
 
 	skb_pull(rx->skb, ieee80211_hdrlen(fc));
-	__skb_queue_tail(&entry->skb_list, rx->skb);
+	ieee80211_fragment_make_room(rx->sdata, entry, rx->skb->truesize);
+	ieee80211_reassemble_chain(rx->sdata, entry, rx->skb);
 	entry->last_frag = frag;
-	entry->extra_len += rx->skb->len;
 	if (ieee80211_has_morefrags(fc)) {
 		rx->skb = NULL;
 		return RX_QUEUED;
 	}
 
-	rx->skb = __skb_dequeue(&entry->skb_list);
-	if (skb_tailroom(rx->skb) < entry->extra_len) {
-		I802_DEBUG_INC(rx->local->rx_expand_skb_head2);
-		if (unlikely(pskb_expand_head(rx->skb, 0, entry->extra_len,
-					      GFP_ATOMIC))) {
-			I802_DEBUG_INC(rx->local->rx_handlers_drop_defrag);
-			__skb_queue_purge(&entry->skb_list);
-			return RX_DROP_UNUSABLE;
-		}
-	}
-	while ((skb = __skb_dequeue(&entry->skb_list))) {
-		memcpy(skb_put(rx->skb, skb->len), skb->data, skb->len);
-		dev_kfree_skb(skb);
-	}
+	rx->skb = entry->skb;
+	entry->skb = NULL;
+	ieee80211_fragment_free(rx->sdata, entry);
 
 	/* Complete frame has been reassembled - process it now */
 	status = IEEE80211_SKB_RXCB(rx->skb);
@@ -1564,7 +1703,7 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 
  out:
 	if (rx->sta)
-		rx->sta->rx_packets++;
+		sta_stats_rx(rx->sta, 1, 0);
 	if (is_multicast_ether_addr(hdr->addr1))
 		rx->local->dot11MulticastReceivedFrameCount++;
 	else
@@ -1686,6 +1825,9 @@ __ieee80211_data_to_8023(struct ieee80211_rx_data *rx, bool *port_control)
 	    sdata->vif.type == NL80211_IFTYPE_AP_VLAN && sdata->u.vlan.sta)
 		return -1;
 
+	if (ieee80211_rx_make_writable(rx))
+		return -1;
+
 	ret = ieee80211_data_to_8023(rx->skb, sdata->vif.addr, sdata->vif.type);
 	if (ret < 0)
 		return ret;
@@ -1848,12 +1990,12 @@ ieee80211_rx_h_amsdu(struct ieee80211_rx_data *rx)
 	      rx->sdata->u.mgd.use_4addr)))
 		return RX_DROP_UNUSABLE;
 
+	if (ieee80211_rx_make_writable(rx))
+		return RX_DROP_UNUSABLE;
+
 	skb->dev = dev;
 	__skb_queue_head_init(&frame_list);
 
-	if (skb_linearize(skb))
-		return RX_DROP_UNUSABLE;
-
 	ieee80211_amsdu_to_8023s(skb, &frame_list, dev->dev_addr,
 				 rx->sdata->vif.type,
 				 rx->local->hw.extra_tx_headroom, true);
@@ -1865,8 +2007,7 @@ ieee80211_rx_h_amsdu(struct ieee80211_rx_data *rx)
 			dev_kfree_skb(rx->skb);
 			continue;
 		}
-		dev->stats.rx_packets++;
-		dev->stats.rx_bytes += rx->skb->len;
+		ieee80211_sdata_rx_stats(rx->sdata, rx->skb->len);
 
 		ieee80211_deliver_skb(rx);
 	}
@@ -1946,6 +2087,13 @@ ieee80211_rx_h_mesh_fwding(struct ieee80211_rx_data *rx)
 	if (!(status->rx_flags & IEEE80211_RX_RA_MATCH))
 		goto out;
 
+	if (ieee80211_rx_make_writable(rx))
+		return RX_DROP_UNUSABLE;
+
+	/* the data may have moved */
+	hdr = (struct ieee80211_hdr *) skb->data;
+	mesh_hdr = (struct ieee80211s_hdr *) (skb->data + hdrlen);
+
 	if (!--mesh_hdr->ttl) {
 		IEEE80211_IFSTA_MESH_CTR_INC(ifmsh, dropped_frames_ttl);
 		return RX_DROP_MONITOR;
@@ -2040,8 +2188,7 @@ ieee80211_rx_h_data(struct ieee80211_rx_data *rx)
 
 	rx->skb->dev = dev;
 
-	dev->stats.rx_packets++;
-	dev->stats.rx_bytes += rx->skb->len;
+	ieee80211_sdata_rx_stats(rx->sdata, rx->skb->len);
 
 	if (local->ps_sdata && local->hw.conf.dynamic_ps_timeout > 0 &&
 	    !is_multicast_ether_addr(
@@ -2395,7 +2542,7 @@ ieee80211_rx_h_action(struct ieee80211_rx_data *rx)
 
  handled:
 	if (rx->sta)
-		rx->sta->rx_packets++;
+		sta_stats_rx(rx->sta, 1, 0);
 	dev_kfree_skb(rx->skb);
 	return RX_QUEUED;
 
@@ -2404,7 +2551,7 @@ ieee80211_rx_h_action(struct ieee80211_rx_data *rx)
 	skb_queue_tail(&sdata->skb_queue, rx->skb);
 	ieee80211_queue_work(&local->hw, &sdata->work);
 	if (rx->sta)
-		rx->sta->rx_packets++;
+		sta_stats_rx(rx->sta, 1, 0);
 	return RX_QUEUED;
 }
 
@@ -2432,7 +2579,7 @@ ieee80211_rx_h_userspace_mgmt(struct ieee80211_rx_data *rx)
 			     rx->skb->data, rx->skb->len,
 			     GFP_ATOMIC)) {
 		if (rx->sta)
-			rx->sta->rx_packets++;
+			sta_stats_rx(rx->sta, 1, 0);
 		dev_kfree_skb(rx->skb);
 		return RX_QUEUED;
 	}
@@ -2535,7 +2682,7 @@ ieee80211_rx_h_mgmt(struct ieee80211_rx_data *rx)
 	skb_queue_tail(&sdata->skb_queue, rx->skb);
 	ieee80211_queue_work(&rx->local->hw, &sdata->work);
 	if (rx->sta)
-		rx->sta->rx_packets++;
+		sta_stats_rx(rx->sta, 1, 0);
 
 	return RX_QUEUED;
 }
@@ -2566,8 +2713,8 @@ static void ieee80211_rx_cooked_monitor(struct ieee80211_rx_data *rx,
 	/* room for the radiotap header based on driver features */
 	needed_headroom = ieee80211_rx_radiotap_len(local, status);
 
-	if (skb_headroom(skb) < needed_headroom &&
-	    pskb_expand_head(skb, needed_headroom, 0, GFP_ATOMIC))
+	/* the headroom may be shared with other interfaces' frames */
+	if (skb_cow_head(skb, needed_headroom))
 		goto out_free_skb;
 
 	/* prepend radiotap information */
@@ -2595,8 +2742,7 @@ static void ieee80211_rx_cooked_monitor(struct ieee80211_rx_data *rx,
 		}
 
 		prev_dev = sdata->dev;
-		sdata->dev->stats.rx_packets++;
-		sdata->dev->stats.rx_bytes += skb->len;
+		ieee80211_sdata_rx_stats(sdata, skb->len);
 	}
 
 	if (prev_dev) {
@@ -2877,15 +3023,20 @@ static bool ieee80211_prepare_and_rx_handle(struct ieee80211_rx_data *rx,
 		return false;
 
 	if (!consume) {
-		skb = skb_copy(skb, GFP_ATOMIC);
+		/*
+		 * Share the data with the other interfaces, the handlers
+		 * copy it if they need to modify it.
+		 */
+		skb = skb_clone(skb, GFP_ATOMIC);
 		if (!skb) {
 			if (net_ratelimit())
 				wiphy_debug(local->hw.wiphy,
-					"failed to copy skb for %s\n",
+					"failed to clone skb for %s\n",
 					sdata->name);
 			return true;
 		}
 
+		local->rx_shared_skbs++;
 		rx->skb = skb;
 	}
 
@@ -2919,8 +3070,12 @@ static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
 		local->dot11ReceivedFragmentCount++;
 
 	if (unlikely(test_bit(SCAN_HW_SCANNING, &local->scanning) ||
-		     test_bit(SCAN_SW_SCANNING, &local->scanning)))
+		     test_bit(SCAN_SW_SCANNING, &local->scanning))) {
 		status->rx_flags |= IEEE80211_RX_IN_SCAN;
+		/* channel activity for the software scan dwell decision */
+		if (local->scan_channel)
+			local->scan_rx_frames++;
+	}
 
 	if (ieee80211_is_mgmt(fc))
 		err = skb_linearize(skb);
@@ -27,8 +27,46 @@
 
 #define IEEE80211_PROBE_DELAY (HZ / 33)
 #define IEEE80211_CHANNEL_TIME (HZ / 33)
+#define IEEE80211_CHANNEL_TIME_MIN (HZ / 100)
 #define IEEE80211_PASSIVE_CHANNEL_TIME (HZ / 8)
 
+/*
+ * While associated with frames waiting to go out, scan at most one
+ * channel at a time, and none at all past this many queued frames.
+ */
+#define IEEE80211_SCAN_TX_BACKLOG_MAX 32
+
+struct ieee80211_scan_chan_stats *
+ieee80211_scan_get_chan_stats(struct ieee80211_local *local,
+			      struct ieee80211_channel *chan)
+{
+	struct ieee80211_supported_band *sband;
+	enum ieee80211_band band;
+	int idx = 0;
+
+	for (band = 0; band < chan->band; band++) {
+		sband = local->hw.wiphy->bands[band];
+		if (sband)
+			idx += sband->n_channels;
+	}
+
+	sband = local->hw.wiphy->bands[chan->band];
+	return &local->scan_chan_stats[idx + (chan - sband->channels)];
+}
+
+/* account the time spent on the current scan channel */
+static void ieee80211_scan_channel_done(struct ieee80211_local *local)
+{
+	struct ieee80211_scan_chan_stats *stats;
+
+	if (!local->scan_channel)
+		return;
+
+	stats = ieee80211_scan_get_chan_stats(local, local->scan_channel);
+	stats->dwell += jiffies - local->scan_channel_time;
+	stats->rx_frames += local->scan_rx_frames;
+}
+
 struct ieee80211_bss *
 ieee80211_rx_bss_get(struct ieee80211_local *local, u8 *bssid, int freq,
 		     u8 *ssid, u8 ssid_len)
@@ -320,6 +358,7 @@ static void __ieee80211_scan_completed(struct ieee80211_hw *hw, bool aborted,
 	local->scan_req = NULL;
 	local->scan_sdata = NULL;
 
+	ieee80211_scan_channel_done(local);
 	local->scanning = 0;
 	local->scan_channel = NULL;
 
@@ -373,6 +412,7 @@ static int ieee80211_start_sw_scan(struct ieee80211_local *local)
 	local->leave_oper_channel_time = jiffies;
 	local->next_scan_state = SCAN_DECISION;
 	local->scan_channel_idx = 0;
+	local->scan_off_channel_count = 0;
 
 	ieee80211_offchannel_stop_vifs(local, true);
 
@@ -477,11 +517,27 @@ ieee80211_scan_get_channel_time(struct ieee80211_channel *chan)
 	return IEEE80211_PROBE_DELAY + IEEE80211_CHANNEL_TIME;
 }
 
+static unsigned int ieee80211_scan_tx_backlog(struct net_device *dev)
+{
+	unsigned int i, backlog = 0;
+	struct Qdisc *qdisc;
+
+	rcu_read_lock();
+	for (i = 0; i < dev->num_tx_queues; i++) {
+		qdisc = rcu_dereference(netdev_get_tx_queue(dev, i)->qdisc);
+		backlog += qdisc->q.qlen;
+	}
+	rcu_read_unlock();
+
+	return backlog;
+}
+
 static void ieee80211_scan_state_decision(struct ieee80211_local *local,
 					  unsigned long *next_delay)
 {
 	bool associated = false;
 	bool tx_empty = true;
+	unsigned int tx_backlog = 0;
 	bool bad_latency;
 	bool listen_int_exceeded;
 	unsigned long min_beacon_int = 0;
@@ -507,15 +563,21 @@ static void ieee80211_scan_state_decision(struct ieee80211_local *local,
 					min_beacon_int =
 						sdata->vif.bss_conf.beacon_int;
 
-				if (!qdisc_all_tx_empty(sdata->dev)) {
-					tx_empty = false;
-					break;
-				}
+				tx_backlog += ieee80211_scan_tx_backlog(sdata->dev);
 			}
 		}
 	}
 	mutex_unlock(&local->iflist_mtx);
 
+	/*
+	 * With only a few frames queued it's fine to visit a single
+	 * channel before going back, so interleave scanned channels
+	 * with the operating channel rather than stopping altogether.
+	 */
+	if (tx_backlog > IEEE80211_SCAN_TX_BACKLOG_MAX ||
+	    (tx_backlog && local->scan_off_channel_count))
+		tx_empty = false;
+
 	next_chan = local->scan_req->channels[local->scan_channel_idx];
 
 	/*
@@ -562,7 +624,10 @@ static void ieee80211_scan_state_set_channel(struct ieee80211_local *local,
 	skip = 0;
 	chan = local->scan_req->channels[local->scan_channel_idx];
 
+	ieee80211_scan_channel_done(local);
 	local->scan_channel = chan;
+	local->scan_channel_time = jiffies;
+	local->scan_rx_frames = 0;
 
 	if (ieee80211_hw_config(local, IEEE80211_CONF_CHANGE_CHANNEL))
 		skip = 1;
@@ -576,6 +641,9 @@ static void ieee80211_scan_state_set_channel(struct ieee80211_local *local,
 		return;
 	}
 
+	ieee80211_scan_get_chan_stats(local, chan)->visits++;
+	local->scan_off_channel_count++;
+
 	/*
 	 * Probe delay is used to update the NAV, cf. 11.1.3.2.2
 	 * (which unfortunately doesn't say _why_ step a) is done,
@@ -616,16 +684,34 @@ static void ieee80211_scan_state_send_probe(struct ieee80211_local *local,
 
 	/*
 	 * After sending probe requests, wait for probe responses
-	 * on the channel.
+	 * on the channel, but only for the full channel time if
+	 * there's any activity on it at all.
 	 */
-	*next_delay = IEEE80211_CHANNEL_TIME;
+	*next_delay = IEEE80211_CHANNEL_TIME_MIN;
+	local->next_scan_state = SCAN_CHECK_CHANNEL;
+}
+
+static void ieee80211_scan_state_check_channel(struct ieee80211_local *local,
+					       unsigned long *next_delay)
+{
 	local->next_scan_state = SCAN_DECISION;
+
+	if (!local->scan_rx_frames) {
+		/* nothing out there, move on right away */
+		ieee80211_scan_get_chan_stats(local,
+					      local->scan_channel)->idle++;
+		*next_delay = 0;
+		return;
+	}
+
+	*next_delay = IEEE80211_CHANNEL_TIME - IEEE80211_CHANNEL_TIME_MIN;
 }
 
 static void ieee80211_scan_state_suspend(struct ieee80211_local *local,
 					 unsigned long *next_delay)
 {
 	/* switch back to the operating channel */
+	ieee80211_scan_channel_done(local);
 	local->scan_channel = NULL;
 	ieee80211_hw_config(local, IEEE80211_CONF_CHANGE_CHANNEL);
 
@@ -655,6 +741,7 @@ static void ieee80211_scan_state_resume(struct ieee80211_local *local,
 
 	/* remember when we left the operating channel */
 	local->leave_oper_channel_time = jiffies;
+	local->scan_off_channel_count = 0;
 
 	/* advance to the next channel to be scanned */
 	local->next_scan_state = SCAN_SET_CHANNEL;
@@ -730,6 +817,9 @@ void ieee80211_scan_work(struct work_struct *work)
 		case SCAN_SEND_PROBE:
 			ieee80211_scan_state_send_probe(local, &next_delay);
 			break;
+		case SCAN_CHECK_CHANNEL:
+			ieee80211_scan_state_check_channel(local, &next_delay);
+			break;
 		case SCAN_SUSPEND:
 			ieee80211_scan_state_suspend(local, &next_delay);
 			break;
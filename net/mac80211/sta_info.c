@@ -173,9 +173,49 @@ void sta_info_free(struct ieee80211_local *local, struct sta_info *sta)
 	wiphy_debug(local->hw.wiphy, "Destroyed STA %pM\n", sta->sta.addr);
 #endif /* CONFIG_MAC80211_VERBOSE_DEBUG */
 
+	free_percpu(sta->pcpu_stats);
 	kfree(sta);
 }
 
+/**
+ * sta_info_get_stats - sum up the per-CPU traffic counters of a station
+ *
+ * @sta: the station to read the counters of
+ * @sum: filled with the totals; @sum->syncp is not used
+ */
+void sta_info_get_stats(struct sta_info *sta,
+			struct ieee80211_sta_pcpu_stats *sum)
+{
+	int cpu;
+
+	memset(sum, 0, sizeof(*sum));
+
+	if (!sta->pcpu_stats)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		const struct ieee80211_sta_pcpu_stats *stats;
+		u64 rx_packets, rx_bytes, tx_packets, tx_bytes, tx_fragments;
+		unsigned int start;
+
+		stats = per_cpu_ptr(sta->pcpu_stats, cpu);
+		do {
+			start = u64_stats_fetch_begin_bh(&stats->syncp);
+			rx_packets = stats->rx_packets;
+			rx_bytes = stats->rx_bytes;
+			tx_packets = stats->tx_packets;
+			tx_bytes = stats->tx_bytes;
+			tx_fragments = stats->tx_fragments;
+		} while (u64_stats_fetch_retry_bh(&stats->syncp, start));
+
+		sum->rx_packets += rx_packets;
+		sum->rx_bytes += rx_bytes;
+		sum->tx_packets += tx_packets;
+		sum->tx_bytes += tx_bytes;
+		sum->tx_fragments += tx_fragments;
+	}
+}
+
 /* Caller must hold local->sta_mtx */
 static void sta_info_hash_add(struct ieee80211_local *local,
 			      struct sta_info *sta)
@@ -220,7 +260,7 @@ static int sta_prepare_rate_control(struct ieee80211_local *local,
 	if (local->hw.flags & IEEE80211_HW_HAS_RATE_CONTROL)
 		return 0;
 
-	sta->rate_ctrl = local->rate_ctrl;
+	sta->rate_ctrl = rate_control_sdata_ref(sta->sdata);
 	sta->rate_ctrl_priv = rate_control_alloc_sta(sta->rate_ctrl,
 						     &sta->sta, gfp);
 	if (!sta->rate_ctrl_priv)
@@ -242,6 +282,10 @@ struct sta_info *sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 		return NULL;
 
 	spin_lock_init(&sta->lock);
+	spin_lock_init(&sta->amsdu_lock);
+	INIT_LIST_HEAD(&sta->amsdu_list);
+	INIT_LIST_HEAD(&sta->ps_list);
+	ewma_init(&sta->avg_txq_delay, 1, 8);
 	INIT_WORK(&sta->drv_unblock_wk, sta_unblock);
 	INIT_WORK(&sta->ampdu_mlme.work, ieee80211_ba_session_work);
 	mutex_init(&sta->ampdu_mlme.mtx);
@@ -273,7 +317,11 @@ struct sta_info *sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 	for (i = 0; i < IEEE80211_NUM_ACS; i++) {
 		skb_queue_head_init(&sta->ps_tx_buf[i]);
 		skb_queue_head_init(&sta->tx_filtered[i]);
+		INIT_LIST_HEAD(&sta->txq_list[i]);
+		sta->airtime_deficit[i] = IEEE80211_AIRTIME_QUANTUM;
 	}
+	for (i = 0; i < ARRAY_SIZE(sta->txq); i++)
+		__skb_queue_head_init(&sta->txq[i]);
 
 	for (i = 0; i < NUM_RX_DATA_QUEUES; i++)
 		sta->last_seq_ctrl[i] = cpu_to_le16(USHRT_MAX);
@@ -415,6 +463,18 @@ int sta_info_insert_rcu(struct sta_info *sta) __acquires(RCU)
 
 	might_sleep();
 
+	/*
+	 * Allocated here rather than in sta_info_alloc() as the latter
+	 * may be called in atomic context, which the per-CPU allocator
+	 * doesn't support.
+	 */
+	sta->pcpu_stats = alloc_percpu(struct ieee80211_sta_pcpu_stats);
+	if (!sta->pcpu_stats) {
+		err = -ENOMEM;
+		rcu_read_lock();
+		goto out_free;
+	}
+
 	err = sta_info_insert_check(sta);
 	if (err) {
 		rcu_read_lock();
@@ -445,20 +505,45 @@ int sta_info_insert(struct sta_info *sta)
 
 static inline void __bss_tim_set(struct ieee80211_if_ap *bss, u16 aid)
 {
+	u16 idx = aid / 8;
+	u8 bit = 1 << (aid % 8);
+
+	if (bss->tim[idx] & bit)
+		return;
+
+	/* keep track of the range of bytes with bits set */
+	if (!bss->tim_bits++) {
+		bss->tim_min = idx;
+		bss->tim_max = idx;
+	} else if (idx < bss->tim_min) {
+		bss->tim_min = idx;
+	} else if (idx > bss->tim_max) {
+		bss->tim_max = idx;
+	}
+
 	/*
 	 * This format has been mandated by the IEEE specifications,
 	 * so this line may not be changed to use the __set_bit() format.
 	 */
-	bss->tim[aid / 8] |= (1 << (aid % 8));
+	bss->tim[idx] |= bit;
 }
 
 static inline void __bss_tim_clear(struct ieee80211_if_ap *bss, u16 aid)
 {
+	u16 idx = aid / 8;
+	u8 bit = 1 << (aid % 8);
+
+	if (!(bss->tim[idx] & bit))
+		return;
+
+	/* the range is tightened when building the next beacon */
+	bss->tim_bits--;
+
 	/*
 	 * This format has been mandated by the IEEE specifications,
 	 * so this line may not be changed to use the __clear_bit() format.
 	 */
-	bss->tim[aid / 8] &= ~(1 << (aid % 8));
+	bss->tim[idx] &= ~bit;
 }
 
 static unsigned long ieee80211_tids_for_ac(int ac)
@@ -541,28 +626,147 @@ void sta_info_recalc_tim(struct sta_info *sta)
 	spin_unlock_irqrestore(&local->tim_lock, flags);
 }
 
+static unsigned long sta_info_buffer_timeout(struct sta_info *sta)
+{
+	unsigned long timeout;
+
+	/* Timeout: (2 * listen_interval * beacon_int * 1024 / 1000000) sec */
+	timeout = (sta->listen_interval *
+		   sta->sdata->vif.bss_conf.beacon_int *
+		   32 / 15625) * HZ;
+	if (timeout < STA_TX_BUFFER_EXPIRE)
+		timeout = STA_TX_BUFFER_EXPIRE;
+	return timeout;
+}
+
+/*
+ * Find the time at which the oldest frame buffered for the station
+ * expires, returns false if nothing is buffered.
+ */
+static bool sta_info_ps_deadline(struct sta_info *sta,
+				 unsigned long *deadline)
+{
+	struct sk_buff_head *queues[2];
+	struct sk_buff *skb;
+	unsigned long expires;
+	bool found = false;
+	int ac, i;
+
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
+		queues[0] = &sta->tx_filtered[ac];
+		queues[1] = &sta->ps_tx_buf[ac];
+
+		for (i = 0; i < ARRAY_SIZE(queues); i++) {
+			spin_lock(&queues[i]->lock);
+			skb = skb_peek(queues[i]);
+			if (skb)
+				expires = IEEE80211_SKB_CB(skb)->control.jiffies;
+			spin_unlock(&queues[i]->lock);
+
+			if (!skb)
+				continue;
+			if (!found || time_before(expires, *deadline))
+				*deadline = expires;
+			found = true;
+		}
+	}
+
+	/* sta_info_buffer_expired() checks for strictly after the timeout */
+	if (found)
+		*deadline += sta_info_buffer_timeout(sta) + 1;
+
+	return found;
+}
+
+/* Insert the station into the ps_sta_list, ordered by ps_deadline */
+static void __sta_info_ps_queue(struct ieee80211_local *local,
+				struct sta_info *sta)
+{
+	struct sta_info *pos;
+
+	lockdep_assert_held(&local->ps_sta_lock);
+
+	/* new deadlines are usually the latest, so search from the end */
+	list_for_each_entry_reverse(pos, &local->ps_sta_list, ps_list)
+		if (!time_before(sta->ps_deadline, pos->ps_deadline))
+			break;
+	list_add(&sta->ps_list, &pos->ps_list);
+}
+
+static void __sta_info_ps_arm_timer(struct ieee80211_local *local)
+{
+	struct sta_info *first;
+
+	if (local->quiescing || list_empty(&local->ps_sta_list))
+		return;
+
+	first = list_first_entry(&local->ps_sta_list, struct sta_info,
+				 ps_list);
+	mod_timer(&local->sta_cleanup, round_jiffies_up(first->ps_deadline));
+}
+
+/*
+ * Put the station on the list of stations with PS-buffered frames, must
+ * be called after queueing the frame. The station is taken off again
+ * lazily once its buffers are empty, see below.
+ */
+void sta_info_ps_buffered(struct sta_info *sta)
+{
+	struct ieee80211_local *local = sta->local;
+	unsigned long flags;
+
+	spin_lock_irqsave(&local->ps_sta_lock, flags);
+	if (list_empty(&sta->ps_list) &&
+	    sta_info_ps_deadline(sta, &sta->ps_deadline)) {
+		__sta_info_ps_queue(local, sta);
+		local->ps_sta_count++;
+		if (local->ps_sta_list.next == &sta->ps_list)
+			__sta_info_ps_arm_timer(local);
+	}
+	spin_unlock_irqrestore(&local->ps_sta_lock, flags);
+}
+
+/*
+ * Take the station off the list of stations with PS-buffered frames if
+ * it has nothing buffered any more, must be called with the local
+ * ps_sta_lock held. Returns whether the station was taken off.
+ */
+bool __sta_info_ps_prune(struct sta_info *sta)
+{
+	int ac;
+
+	lockdep_assert_held(&sta->local->ps_sta_lock);
+
+	if (list_empty(&sta->ps_list))
+		return false;
+
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
+		if (!skb_queue_empty(&sta->ps_tx_buf[ac]) ||
+		    !skb_queue_empty(&sta->tx_filtered[ac]))
+			return false;
+
+	list_del_init(&sta->ps_list);
+	sta->local->ps_sta_count--;
+	return true;
+}
+
 static bool sta_info_buffer_expired(struct sta_info *sta, struct sk_buff *skb)
 {
 	struct ieee80211_tx_info *info;
-	int timeout;
 
 	if (!skb)
 		return false;
 
 	info = IEEE80211_SKB_CB(skb);
 
-	/* Timeout: (2 * listen_interval * beacon_int * 1024 / 1000000) sec */
-	timeout = (sta->listen_interval *
-		   sta->sdata->vif.bss_conf.beacon_int *
-		   32 / 15625) * HZ;
-	if (timeout < STA_TX_BUFFER_EXPIRE)
-		timeout = STA_TX_BUFFER_EXPIRE;
-	return time_after(jiffies, info->control.jiffies + timeout);
+	return time_after(jiffies, info->control.jiffies +
+				   sta_info_buffer_timeout(sta));
 }
 
 
 static bool sta_info_cleanup_expire_buffered_ac(struct ieee80211_local *local,
-						struct sta_info *sta, int ac)
+						struct sta_info *sta, int ac,
+						struct sk_buff_head *expired)
 {
 	unsigned long flags;
 	struct sk_buff *skb;
@@ -591,7 +795,8 @@ static bool sta_info_cleanup_expire_buffered_ac(struct ieee80211_local *local,
 		 */
 		if (!skb)
 			break;
-		dev_kfree_skb(skb);
+		local->ps_expired++;
+		__skb_queue_tail(expired, skb);
 	}
 
 	/*
@@ -618,11 +823,12 @@ static bool sta_info_cleanup_expire_buffered_ac(struct ieee80211_local *local,
 			break;
 
 		local->total_ps_buffered--;
+		local->ps_expired++;
 #ifdef CONFIG_MAC80211_VERBOSE_PS_DEBUG
 		printk(KERN_DEBUG "Buffered frame expired (STA %pM)\n",
 		       sta->sta.addr);
 #endif
-		dev_kfree_skb(skb);
+		__skb_queue_tail(expired, skb);
 	}
 
 	/*
@@ -642,7 +848,8 @@ static bool sta_info_cleanup_expire_buffered_ac(struct ieee80211_local *local,
 }
 
 static bool sta_info_cleanup_expire_buffered(struct ieee80211_local *local,
-					     struct sta_info *sta)
+					     struct sta_info *sta,
+					     struct sk_buff_head *expired)
 {
 	bool have_buffered = false;
 	int ac;
@@ -653,17 +860,24 @@ static bool sta_info_cleanup_expire_buffered(struct ieee80211_local *local,
 
 	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
 		have_buffered |=
-			sta_info_cleanup_expire_buffered_ac(local, sta, ac);
+			sta_info_cleanup_expire_buffered_ac(local, sta, ac,
+							    expired);
 
 	return have_buffered;
 }
 
-int __must_check __sta_info_destroy(struct sta_info *sta)
+/*
+ * Station teardown is split in two halves around the RCU grace period
+ * so that callers removing many stations at once need to wait only for
+ * a single grace period: the first half unlinks the station so that it
+ * can no longer be found, the second half frees it once no RCU reader
+ * can still be using it.
+ */
+static int __must_check __sta_info_destroy_part1(struct sta_info *sta)
 {
 	struct ieee80211_local *local;
 	struct ieee80211_sub_if_data *sdata;
-	int ret, i, ac;
-	struct tid_ampdu_tx *tid_tx;
+	int ret;
 
 	might_sleep();
 
@@ -690,13 +904,6 @@ int __must_check __sta_info_destroy(struct sta_info *sta)
 
 	list_del(&sta->list);
 
-	mutex_lock(&local->key_mtx);
-	for (i = 0; i < NUM_DEFAULT_KEYS; i++)
-		__ieee80211_key_free(key_mtx_dereference(local, sta->gtk[i]));
-	if (sta->ptk)
-		__ieee80211_key_free(key_mtx_dereference(local, sta->ptk));
-	mutex_unlock(&local->key_mtx);
-
 	sta->dead = true;
 
 	local->num_sta--;
@@ -705,6 +912,37 @@ int __must_check __sta_info_destroy(struct sta_info *sta)
 	if (sdata->vif.type == NL80211_IFTYPE_AP_VLAN)
 		RCU_INIT_POINTER(sdata->u.vlan.sta, NULL);
 
+	/*
+	 * Close the port right away, the keys and the driver's station
+	 * are only removed after the grace period.
+	 */
+	if (sta->sta_state == IEEE80211_STA_AUTHORIZED) {
+		ret = sta_info_move_state(sta, IEEE80211_STA_ASSOC);
+		WARN_ON_ONCE(ret != 0);
+	}
+
+	return 0;
+}
+
+static void __sta_info_destroy_part2(struct sta_info *sta)
+{
+	struct ieee80211_local *local = sta->local;
+	struct ieee80211_sub_if_data *sdata = sta->sdata;
+	struct tid_ampdu_tx *tid_tx;
+	unsigned long flags;
+	int i, ac, ret;
+
+	lockdep_assert_held(&local->sta_mtx);
+
+	/*
+	 * The keys must be removed from the hardware before the station,
+	 * and only once the TX path can no longer be using them. Keys of
+	 * the station that were replaced or deleted earlier may still be
+	 * waiting for that, so wait for them as well.
+	 */
+	ieee80211_flush_freed_keys(local);
+	ieee80211_free_sta_keys(local, sta);
+
 	while (sta->sta_state > IEEE80211_STA_NONE) {
 		ret = sta_info_move_state(sta, sta->sta_state - 1);
 		if (ret) {
@@ -719,13 +957,8 @@ int __must_check __sta_info_destroy(struct sta_info *sta)
 		WARN_ON_ONCE(ret != 0);
 	}
 
-	/*
-	 * At this point, after we wait for an RCU grace period,
-	 * neither mac80211 nor the driver can reference this
-	 * sta struct any more except by still existing timers
-	 * associated with this station that we clean up below.
-	 */
-	synchronize_rcu();
+	ieee80211_sta_amsdu_purge(sta);
+	ieee80211_sta_txq_purge(sta);
 
 	if (test_sta_flag(sta, WLAN_STA_PS_STA)) {
 		BUG_ON(!sdata->bss);
@@ -736,6 +969,17 @@ int __must_check __sta_info_destroy(struct sta_info *sta)
 		sta_info_recalc_tim(sta);
 	}
 
+	/*
+	 * The cleanup timer and purge_old_ps_buffers() find the station
+	 * through this list rather than RCU, so take it off first.
+	 */
+	spin_lock_irqsave(&local->ps_sta_lock, flags);
+	if (!list_empty(&sta->ps_list)) {
+		list_del_init(&sta->ps_list);
+		local->ps_sta_count--;
+	}
+	spin_unlock_irqrestore(&local->ps_sta_lock, flags);
+
 	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
 		local->total_ps_buffered -= skb_queue_len(&sta->ps_tx_buf[ac]);
 		__skb_queue_purge(&sta->ps_tx_buf[ac]);
@@ -752,6 +996,12 @@ int __must_check __sta_info_destroy(struct sta_info *sta)
 #endif /* CONFIG_MAC80211_VERBOSE_DEBUG */
 	cancel_work_sync(&sta->drv_unblock_wk);
 
+	/*
+	 * The aggregation start work may have queued the BA session work
+	 * while it could still find the station during the grace period.
+	 */
+	cancel_work_sync(&sta->ampdu_mlme.work);
+
 	cfg80211_del_sta(sdata->dev, sta->sta.addr, GFP_KERNEL);
 
 	rate_control_remove_sta_debugfs(sta);
@@ -771,18 +1021,61 @@ int __must_check __sta_info_destroy(struct sta_info *sta)
 	 * directly by station destruction.
 	 */
 	for (i = 0; i < STA_TID_NUM; i++) {
+		/* a session the aggregation work never got to */
+		if (sta->ampdu_mlme.tid_start_tx[i]) {
+			atomic_dec(&local->agg_tx_sessions);
+			kfree(sta->ampdu_mlme.tid_start_tx[i]);
+		}
+
 		tid_tx = rcu_dereference_raw(sta->ampdu_mlme.tid_tx[i]);
 		if (!tid_tx)
 			continue;
 		__skb_queue_purge(&tid_tx->pending);
+		atomic_dec(&local->agg_tx_sessions);
 		kfree(tid_tx);
 	}
 
 	sta_info_free(local, sta);
+}
+
+int __must_check __sta_info_destroy(struct sta_info *sta)
+{
+	int ret;
+
+	ret = __sta_info_destroy_part1(sta);
+	if (ret)
+		return ret;
+
+	/*
+	 * At this point, after we wait for an RCU grace period,
+	 * neither mac80211 nor the driver can reference this
+	 * sta struct any more except by still existing timers
+	 * associated with this station that part2 cleans up.
+	 */
+	synchronize_rcu();
+
+	__sta_info_destroy_part2(sta);
 
 	return 0;
 }
 
+/*
+ * Free the stations unlinked by __sta_info_destroy_part1() onto
+ * @free_list after a single RCU grace period for all of them.
+ */
+static void sta_info_destroy_batch(struct list_head *free_list)
+{
+	struct sta_info *sta, *tmp;
+
+	if (list_empty(free_list))
+		return;
+
+	synchronize_rcu();
+
+	list_for_each_entry_safe(sta, tmp, free_list, free_list)
+		__sta_info_destroy_part2(sta);
+}
+
 int sta_info_destroy_addr(struct ieee80211_sub_if_data *sdata, const u8 *addr)
 {
 	struct sta_info *sta;
@@ -813,23 +1106,39 @@ int sta_info_destroy_addr_bss(struct ieee80211_sub_if_data *sdata,
 static void sta_info_cleanup(unsigned long data)
 {
 	struct ieee80211_local *local = (struct ieee80211_local *) data;
-	struct sta_info *sta;
-	bool timer_needed = false;
+	struct sta_info *sta, *tmp;
+	struct sk_buff_head frames;
+	unsigned long flags;
+	LIST_HEAD(expired);
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(sta, &local->sta_list, list)
-		if (sta_info_cleanup_expire_buffered(local, sta))
-			timer_needed = true;
-	rcu_read_unlock();
+	__skb_queue_head_init(&frames);
 
-	if (local->quiescing)
-		return;
+	/*
+	 * Only the stations at the front of the list, whose oldest
+	 * buffered frame has expired, need to be looked at.
+	 */
+	spin_lock_irqsave(&local->ps_sta_lock, flags);
+	list_for_each_entry_safe(sta, tmp, &local->ps_sta_list, ps_list) {
+		if (time_before(jiffies, sta->ps_deadline))
+			break;
+		list_move_tail(&sta->ps_list, &expired);
+	}
 
-	if (!timer_needed)
-		return;
+	list_for_each_entry_safe(sta, tmp, &expired, ps_list) {
+		list_del_init(&sta->ps_list);
+
+		if (sta_info_cleanup_expire_buffered(local, sta, &frames) &&
+		    sta_info_ps_deadline(sta, &sta->ps_deadline))
+			__sta_info_ps_queue(local, sta);
+		else
+			local->ps_sta_count--;
+	}
 
-	mod_timer(&local->sta_cleanup,
-		  round_jiffies(jiffies + STA_INFO_CLEANUP_INTERVAL));
+	__sta_info_ps_arm_timer(local);
+	spin_unlock_irqrestore(&local->ps_sta_lock, flags);
+
+	/* can't free the frames with interrupts disabled */
+	__skb_queue_purge(&frames);
 }
 
 void sta_info_init(struct ieee80211_local *local)
@@ -837,6 +1146,8 @@ void sta_info_init(struct ieee80211_local *local)
 	spin_lock_init(&local->tim_lock);
 	mutex_init(&local->sta_mtx);
 	INIT_LIST_HEAD(&local->sta_list);
+	spin_lock_init(&local->ps_sta_lock);
+	INIT_LIST_HEAD(&local->ps_sta_list);
 
 	setup_timer(&local->sta_cleanup, sta_info_cleanup,
 		    (unsigned long)local);
@@ -860,6 +1171,7 @@ int sta_info_flush(struct ieee80211_local *local,
 		   struct ieee80211_sub_if_data *sdata)
 {
 	struct sta_info *sta, *tmp;
+	LIST_HEAD(free_list);
 	int ret = 0;
 
 	might_sleep();
@@ -867,10 +1179,12 @@ int sta_info_flush(struct ieee80211_local *local,
 	mutex_lock(&local->sta_mtx);
 	list_for_each_entry_safe(sta, tmp, &local->sta_list, list) {
 		if (!sdata || sdata == sta->sdata) {
-			WARN_ON(__sta_info_destroy(sta));
+			if (!WARN_ON(__sta_info_destroy_part1(sta)))
+				list_add_tail(&sta->free_list, &free_list);
 			ret++;
 		}
 	}
+	sta_info_destroy_batch(&free_list);
 	mutex_unlock(&local->sta_mtx);
 
 	return ret;
@@ -881,6 +1195,7 @@ void ieee80211_sta_expire(struct ieee80211_sub_if_data *sdata,
 {
 	struct ieee80211_local *local = sdata->local;
 	struct sta_info *sta, *tmp;
+	LIST_HEAD(free_list);
 
 	mutex_lock(&local->sta_mtx);
 
@@ -893,10 +1208,13 @@ void ieee80211_sta_expire(struct ieee80211_sub_if_data *sdata,
 			printk(KERN_DEBUG "%s: expiring inactive STA %pM\n",
 			       sdata->name, sta->sta.addr);
 #endif
-			WARN_ON(__sta_info_destroy(sta));
+			if (!WARN_ON(__sta_info_destroy_part1(sta)))
+				list_add_tail(&sta->free_list, &free_list);
 		}
 	}
 
+	sta_info_destroy_batch(&free_list);
+
 	mutex_unlock(&local->sta_mtx);
 }
 
@@ -952,12 +1270,60 @@ static void clear_sta_ps_flags(void *_sta)
 		atomic_dec(&sdata->bss->num_sta_ps);
 }
 
+/*
+ * Frames buffered for a sleeping station are supposed to wait until it
+ * wakes up, so CoDel only considers the time beyond one listen interval
+ * to be queueing delay.
+ */
+static void sta_ps_codel_params(struct sta_info *sta,
+				struct ieee80211_codel_params *params)
+{
+	u32 beacon_int = sta->sdata->vif.bss_conf.beacon_int ?: 100;
+	u32 sleep = sta->listen_interval * beacon_int * 1024;
+
+	params->target = IEEE80211_CODEL_TARGET + sleep;
+	params->interval = IEEE80211_CODEL_INTERVAL + sleep;
+}
+
+/*
+ * Dequeue the next frame buffered for the station on the given AC,
+ * filtered frames first as they are older.
+ */
+static struct sk_buff *sta_ps_dequeue(struct sta_info *sta, int ac,
+				      struct sk_buff_head *dropped)
+{
+	struct ieee80211_local *local = sta->local;
+	struct ieee80211_codel_params params;
+	struct sk_buff *skb;
+	unsigned long flags;
+	int len;
+
+	sta_ps_codel_params(sta, &params);
+
+	spin_lock_irqsave(&sta->tx_filtered[ac].lock, flags);
+	skb = ieee80211_codel_dequeue(&sta->tx_filtered[ac], &params,
+				      &sta->filtered_cvars[ac], dropped);
+	spin_unlock_irqrestore(&sta->tx_filtered[ac].lock, flags);
+	if (skb)
+		return skb;
+
+	spin_lock_irqsave(&sta->ps_tx_buf[ac].lock, flags);
+	len = skb_queue_len(&sta->ps_tx_buf[ac]);
+	skb = ieee80211_codel_dequeue(&sta->ps_tx_buf[ac], &params,
+				      &sta->ps_cvars[ac], dropped);
+	local->total_ps_buffered -= len - skb_queue_len(&sta->ps_tx_buf[ac]);
+	spin_unlock_irqrestore(&sta->ps_tx_buf[ac].lock, flags);
+
+	return skb;
+}
+
 /* powersave support code */
 void ieee80211_sta_ps_deliver_wakeup(struct sta_info *sta)
 {
 	struct ieee80211_sub_if_data *sdata = sta->sdata;
 	struct ieee80211_local *local = sdata->local;
-	struct sk_buff_head pending;
+	struct sk_buff_head pending, dropped;
+	struct sk_buff *skb;
 	int filtered = 0, buffered = 0, ac;
 
 	clear_sta_flag(sta, WLAN_STA_SP);
@@ -969,24 +1335,21 @@ void ieee80211_sta_ps_deliver_wakeup(struct sta_info *sta)
 		drv_sta_notify(local, sdata, STA_NOTIFY_AWAKE, &sta->sta);
 
 	skb_queue_head_init(&pending);
+	__skb_queue_head_init(&dropped);
 
-	/* Send all buffered frames to the station */
+	/* Send all buffered frames the AQM doesn't drop to the station */
 	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
-		int count = skb_queue_len(&pending), tmp;
+		filtered += skb_queue_len(&sta->tx_filtered[ac]);
+		buffered += skb_queue_len(&sta->ps_tx_buf[ac]);
 
-		skb_queue_splice_tail_init(&sta->tx_filtered[ac], &pending);
-		tmp = skb_queue_len(&pending);
-		filtered += tmp - count;
-		count = tmp;
-
-		skb_queue_splice_tail_init(&sta->ps_tx_buf[ac], &pending);
-		tmp = skb_queue_len(&pending);
-		buffered += tmp - count;
+		while ((skb = sta_ps_dequeue(sta, ac, &dropped)))
+			skb_queue_tail(&pending, skb);
 	}
 
 	ieee80211_add_pending_skbs_fn(local, &pending, clear_sta_ps_flags, sta);
+	ieee80211_sta_txq_wakeup(sta);
 
-	local->total_ps_buffered -= buffered;
+	__skb_queue_purge(&dropped);
 
 	sta_info_recalc_tim(sta);
 
@@ -1071,12 +1434,13 @@ ieee80211_sta_ps_deliver_response(struct sta_info *sta,
 	bool more_data = false;
 	int ac;
 	unsigned long driver_release_tids = 0;
-	struct sk_buff_head frames;
+	struct sk_buff_head frames, dropped;
 
 	/* Service or PS-Poll period starts */
 	set_sta_flag(sta, WLAN_STA_SP);
 
 	__skb_queue_head_init(&frames);
+	__skb_queue_head_init(&dropped);
 
 	/*
 	 * Get response frame(s) and more data bit for it.
@@ -1097,13 +1461,7 @@ ieee80211_sta_ps_deliver_response(struct sta_info *sta,
 				struct sk_buff *skb;
 
 				while (n_frames > 0) {
-					skb = skb_dequeue(&sta->tx_filtered[ac]);
-					if (!skb) {
-						skb = skb_dequeue(
-							&sta->ps_tx_buf[ac]);
-						if (skb)
-							local->total_ps_buffered--;
-					}
+					skb = sta_ps_dequeue(sta, ac, &dropped);
 					if (!skb)
 						break;
 					n_frames--;
@@ -1133,6 +1491,8 @@ ieee80211_sta_ps_deliver_response(struct sta_info *sta,
 		}
 	}
 
+	__skb_queue_purge(&dropped);
+
 	if (!found) {
 		int tid;
 
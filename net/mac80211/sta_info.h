@@ -15,7 +15,10 @@
 #include <linux/workqueue.h>
 #include <linux/average.h>
 #include <linux/etherdevice.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
 #include "key.h"
+#include "codel.h"
 
 /**
  * enum ieee80211_sta_info_flags - Stations flags
@@ -83,6 +86,9 @@ enum ieee80211_sta_info_flags {
 #define HT_AGG_MAX_RETRIES		15
 #define HT_AGG_BURST_RETRIES		3
 #define HT_AGG_RETRIES_PERIOD		(15 * HZ)
+#define HT_AGG_TX_WINDOW		(HZ / 10)
+#define HT_AGG_DEFAULT_MIN_PPS		50
+#define HT_AGG_DEFAULT_IDLE_TIMEOUT	5000
 
 #define HT_AGG_STATE_DRV_READY		0
 #define HT_AGG_STATE_RESPONSE_RECEIVED	1
@@ -90,6 +96,7 @@ enum ieee80211_sta_info_flags {
 #define HT_AGG_STATE_STOPPING		3
 #define HT_AGG_STATE_WANT_START		4
 #define HT_AGG_STATE_WANT_STOP		5
+#define HT_AGG_STATE_START_SYNC		6
 
 /**
  * struct tid_ampdu_tx - TID aggregation information (Tx).
@@ -106,6 +113,10 @@ enum ieee80211_sta_info_flags {
  * @buf_size: reorder buffer size at receiver
  * @failed_bar_ssn: ssn of the last failed BAR tx attempt
  * @bar_pending: BAR needs to be re-sent
+ * @start_time: time (in jiffies) the session was requested
+ * @start_gen: TX path synchronisation generation the session waits for
+ *	while %HT_AGG_STATE_START_SYNC is set, see ieee80211_agg_start_sync()
+ * @amsdu: the peer accepted A-MSDUs inside the A-MPDUs of this session
  *
  * This structure's lifetime is managed by RCU, assignments to
  * the array holding it must hold the aggregation mutex.
@@ -130,6 +141,11 @@ struct tid_ampdu_tx {
 
 	u16 failed_bar_ssn;
 	bool bar_pending;
+
+	unsigned long start_time;
+	u32 start_gen;
+
+	bool amsdu;
 };
 
 /**
@@ -185,6 +201,8 @@ struct tid_ampdu_rx {
  *	RX timer expired until the work for it runs
  * @tid_rx_stop_requested:  bitmap indicating which BA sessions per TID the
  *	driver requested to close until the work for it runs
+ * @tx_window_start: start of the current traffic measurement window per TID
+ * @tx_window_frames: frames sent without a session in the current window
  * @mtx: mutex to protect all TX data (except non-NULL assignments
  *	to tid_tx[idx], which are protected by the sta spinlock)
  */
@@ -201,8 +219,29 @@ struct sta_ampdu_mlme {
 	unsigned long last_addba_req_time[STA_TID_NUM];
 	u8 addba_req_num[STA_TID_NUM];
 	u8 dialog_token_allocator;
+	unsigned long tx_window_start[STA_TID_NUM];
+	u32 tx_window_frames[STA_TID_NUM];
 };
 
+/**
+ * struct ieee80211_sta_pcpu_stats - per-CPU station traffic counters
+ *
+ * The RX and TX paths may run concurrently on different CPUs, so the
+ * hot counters are kept per CPU and only summed up when read, see
+ * sta_info_get_stats(). Writers always run with BHs disabled.
+ *
+ * @syncp: synchronisation for the 64-bit counters on 32-bit hosts
+ * @rx_packets: number of MSDUs received from this STA
+ * @rx_bytes: number of bytes received from this STA
+ * @tx_packets: number of MSDUs transmitted to this STA
+ * @tx_bytes: number of bytes transmitted to this STA
+ * @tx_fragments: number of transmitted MPDUs
+ */
+struct ieee80211_sta_pcpu_stats {
+	struct u64_stats_sync syncp;
+	u64 rx_packets, rx_bytes;
+	u64 tx_packets, tx_bytes, tx_fragments;
+};
 
 /**
  * struct sta_info - STA information
@@ -211,6 +250,7 @@ struct sta_ampdu_mlme {
  * mac80211 is communicating with.
  *
  * @list: global linked list entry
+ * @free_list: list entry used while a batch of stations is being destroyed
  * @hnext: hash table linked list pointer
  * @local: pointer to the global information
  * @sdata: virtual interface this station belongs to
@@ -218,6 +258,12 @@ struct sta_ampdu_mlme {
  * @gtk: group keys negotiated with this station, if any
  * @rate_ctrl: rate control algorithm reference
  * @rate_ctrl_priv: rate control private per-STA pointer
+ * @rate_ctrl_pinned: rate control algorithm was selected for this station
+ *	and doesn't follow the interface's selection
+ * @rate_ctrl_switching: the station is being moved to another rate control
+ *	algorithm, protected by @lock
+ * @rate_ctrl_init_pending: rate control was to be initialized while
+ *	switching, the new algorithm must be; protected by @lock
  * @last_tx_rate: rate used for last transmit, to report to userspace as
  *	"the" transmit rate
  * @last_rx_rate_idx: rx status rate index of the last data packet
@@ -233,9 +279,15 @@ struct sta_ampdu_mlme {
  *	transmit but were filtered by hardware due to STA having
  *	entered power saving state, these are also delivered to
  *	the station when it leaves powersave or polls for frames
+ * @ps_list: entry in the local list of stations with PS-buffered frames,
+ *	protected by the local ps_sta_lock
+ * @ps_deadline: time (in jiffies) at which the oldest frame buffered for
+ *	this station expires, orders @ps_list; may be early but never late
+ * @ps_cvars: CoDel state of the @ps_tx_buf queues
+ * @filtered_cvars: CoDel state of the @tx_filtered queues
  * @driver_buffered_tids: bitmap of TIDs the driver has data buffered on
- * @rx_packets: Number of MSDUs received from this STA
- * @rx_bytes: Number of bytes received from this STA
+ * @pcpu_stats: per-CPU RX/TX packet and byte counters, allocated when
+ *	the station is inserted
  * @wep_weak_iv_count: number of weak WEP IVs received from this station
  * @last_rx: time (in jiffies) when last frame was received from this STA
  * @last_connected: time (in seconds) when a station got connected
@@ -249,10 +301,25 @@ struct sta_ampdu_mlme {
  * @tx_retry_failed: number of frames that failed retry
  * @tx_retry_count: total number of retries for frames to this STA
  * @fail_avg: moving percentage of failed MSDUs
- * @tx_packets: number of RX/TX MSDUs
- * @tx_bytes: number of bytes transmitted to this STA
- * @tx_fragments: number of transmitted MPDUs
  * @tid_seq: per-TID sequence numbers for sending to this STA
+ * @amsdu_lock: protects the software A-MSDU state below
+ * @amsdu_list: entry in the local list of stations holding frames for
+ *	A-MSDU aggregation, protected by the local amsdu_lock
+ * @amsdu_skb: per-TID frame (or A-MSDU) currently being aggregated
+ * @amsdu_frames: number of MSDUs packed into @amsdu_skb
+ * @tx_amsdu: number of A-MSDUs transmitted to this STA
+ * @tx_amsdu_msdus: number of MSDUs carried in those A-MSDUs
+ * @tx_amsdu_full: A-MSDUs closed because the next MSDU would not fit
+ * @tx_amsdu_single: held frames that were flushed without a companion
+ * @txq: per-TID queues of frames waiting to be pulled by the driver,
+ *	protected by the local txq_lock
+ * @txq_list: per-AC entry in the local list of active TX queues
+ * @airtime_deficit: per-AC airtime (usecs) left in the current scheduler
+ *	round, may go negative
+ * @tx_airtime: total airtime (usecs) used transmitting to this STA
+ * @txq_drops: frames dropped because the TX queues were full
+ * @avg_txq_delay: moving average of the TX queueing delay (usecs)
+ * @max_txq_delay: largest TX queueing delay seen (usecs)
  * @ampdu_mlme: A-MPDU state machine state
  * @timer_to_tid: identity mapping to ID timers
  * @llid: Local link ID
@@ -274,7 +341,7 @@ struct sta_ampdu_mlme {
  */
 struct sta_info {
 	/* General information, mostly static */
-	struct list_head list;
+	struct list_head list, free_list;
 	struct sta_info __rcu *hnext;
 	struct ieee80211_local *local;
 	struct ieee80211_sub_if_data *sdata;
@@ -282,6 +349,7 @@ struct sta_info {
 	struct ieee80211_key __rcu *ptk;
 	struct rate_control_ref *rate_ctrl;
 	void *rate_ctrl_priv;
+	bool rate_ctrl_pinned, rate_ctrl_switching, rate_ctrl_init_pending;
 	spinlock_t lock;
 
 	struct work_struct drv_unblock_wk;
@@ -303,10 +371,15 @@ struct sta_info {
 	 */
 	struct sk_buff_head ps_tx_buf[IEEE80211_NUM_ACS];
 	struct sk_buff_head tx_filtered[IEEE80211_NUM_ACS];
+	struct list_head ps_list;
+	unsigned long ps_deadline;
+	struct ieee80211_codel_vars ps_cvars[IEEE80211_NUM_ACS];
+	struct ieee80211_codel_vars filtered_cvars[IEEE80211_NUM_ACS];
 	unsigned long driver_buffered_tids;
 
+	struct ieee80211_sta_pcpu_stats __percpu *pcpu_stats;
+
 	/* Updated from RX path only, no locking requirements */
-	unsigned long rx_packets, rx_bytes;
 	unsigned long wep_weak_iv_count;
 	unsigned long last_rx;
 	long last_connected;
@@ -325,14 +398,28 @@ struct sta_info {
 	unsigned int fail_avg;
 
 	/* Updated from TX path only, no locking requirements */
-	unsigned long tx_packets;
-	unsigned long tx_bytes;
-	unsigned long tx_fragments;
 	struct ieee80211_tx_rate last_tx_rate;
 	int last_rx_rate_idx;
 	int last_rx_rate_flag;
 	u16 tid_seq[IEEE80211_QOS_CTL_TID_MASK + 1];
 
+	/* Software A-MSDU aggregation, see ieee80211_amsdu_aggregate() */
+	spinlock_t amsdu_lock;
+	struct list_head amsdu_list;
+	struct sk_buff *amsdu_skb[IEEE80211_QOS_CTL_TAG1D_MASK + 1];
+	u8 amsdu_frames[IEEE80211_QOS_CTL_TAG1D_MASK + 1];
+	unsigned long tx_amsdu, tx_amsdu_msdus;
+	unsigned long tx_amsdu_full, tx_amsdu_single;
+
+	/* intermediate TX queues, see ieee80211_tx_dequeue() */
+	struct sk_buff_head txq[IEEE80211_QOS_CTL_TAG1D_MASK + 1];
+	struct list_head txq_list[IEEE80211_NUM_ACS];
+	s32 airtime_deficit[IEEE80211_NUM_ACS];
+	u64 tx_airtime;
+	unsigned long txq_drops;
+	struct ewma avg_txq_delay;
+	u32 max_txq_delay;
+
 	/*
 	 * Aggregation information, locked with lock.
 	 */
@@ -369,6 +456,29 @@ struct sta_info {
 	struct ieee80211_sta sta;
 };
 
+static inline void sta_stats_rx(struct sta_info *sta,
+				unsigned int packets, unsigned int bytes)
+{
+	struct ieee80211_sta_pcpu_stats *stats = this_cpu_ptr(sta->pcpu_stats);
+
+	u64_stats_update_begin(&stats->syncp);
+	stats->rx_packets += packets;
+	stats->rx_bytes += bytes;
+	u64_stats_update_end(&stats->syncp);
+}
+
+static inline void sta_stats_tx(struct sta_info *sta, unsigned int packets,
+				unsigned int fragments, unsigned int bytes)
+{
+	struct ieee80211_sta_pcpu_stats *stats = this_cpu_ptr(sta->pcpu_stats);
+
+	u64_stats_update_begin(&stats->syncp);
+	stats->tx_packets += packets;
+	stats->tx_fragments += fragments;
+	stats->tx_bytes += bytes;
+	u64_stats_update_end(&stats->syncp);
+}
+
 static inline enum nl80211_plink_state sta_plink_state(struct sta_info *sta)
 {
 #ifdef CONFIG_MAC80211_MESH
@@ -456,10 +566,6 @@ rcu_dereference_protected_tid_tx(struct sta_info *sta, int tid)
  * smaller than this value, the minimum value here is used instead. */
 #define STA_TX_BUFFER_EXPIRE (10 * HZ)
 
-/* How often station data is cleaned up (e.g., expiration of buffered frames)
- */
-#define STA_INFO_CLEANUP_INTERVAL (10 * HZ)
-
 /*
  * Get a STA info, must be under RCU read lock.
  */
@@ -523,7 +629,12 @@ int sta_info_destroy_addr(struct ieee80211_sub_if_data *sdata,
 int sta_info_destroy_addr_bss(struct ieee80211_sub_if_data *sdata,
 			      const u8 *addr);
 
+void sta_info_get_stats(struct sta_info *sta,
+			struct ieee80211_sta_pcpu_stats *sum);
+
 void sta_info_recalc_tim(struct sta_info *sta);
+void sta_info_ps_buffered(struct sta_info *sta);
+bool __sta_info_ps_prune(struct sta_info *sta);
 
 void sta_info_init(struct ieee80211_local *local);
 void sta_info_stop(struct ieee80211_local *local);
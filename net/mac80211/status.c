@@ -137,13 +137,10 @@ static void ieee80211_handle_filtered_frame(struct ieee80211_local *local,
 	 */
 	if (test_sta_flag(sta, WLAN_STA_PS_STA) &&
 	    skb_queue_len(&sta->tx_filtered[ac]) < STA_MAX_TX_BUFFER) {
+		ieee80211_codel_stamp(skb);
 		skb_queue_tail(&sta->tx_filtered[ac], skb);
+		sta_info_ps_buffered(sta);
 		sta_info_recalc_tim(sta);
-
-		if (!timer_pending(&local->sta_cleanup))
-			mod_timer(&local->sta_cleanup,
-				  round_jiffies(jiffies +
-						STA_INFO_CLEANUP_INTERVAL));
 		return;
 	}
 
@@ -349,6 +346,7 @@ void ieee80211_tx_status(struct ieee80211_hw *hw, struct sk_buff *skb)
 	struct sta_info *sta, *tmp;
 	int retry_count = -1, i;
 	int rates_idx = -1;
+	u8 ac;
 	bool send_to_cooked;
 	bool acked;
 	struct ieee80211_bar *bar;
@@ -444,6 +442,12 @@ void ieee80211_tx_status(struct ieee80211_hw *hw, struct sk_buff *skb)
 		}
 
 		rate_control_tx_status(local, sband, sta, skb);
+		if (local->ops->wake_tx_queue) {
+			ac = ieee802_1d_to_ac[skb->priority &
+					      IEEE80211_QOS_CTL_TAG1D_MASK];
+			ieee80211_sta_register_airtime(sta, ac,
+				ieee80211_tx_airtime(local, sband, skb));
+		}
 		if (ieee80211_vif_is_mesh(&sta->sdata->vif))
 			ieee80211s_update_metric(local, sta, skb);
 
@@ -326,7 +326,11 @@ static void purge_old_ps_buffers(struct ieee80211_local *local)
 	int total = 0, purged = 0;
 	struct sk_buff *skb;
 	struct ieee80211_sub_if_data *sdata;
-	struct sta_info *sta;
+	struct sta_info *sta, *tmp;
+	struct sk_buff_head purge;
+	unsigned long flags;
+
+	__skb_queue_head_init(&purge);
 
 	/*
 	 * virtual interfaces are protected by RCU
@@ -346,11 +350,15 @@ static void purge_old_ps_buffers(struct ieee80211_local *local)
 		total += skb_queue_len(&ap->ps_bc_buf);
 	}
 
+	rcu_read_unlock();
+
 	/*
 	 * Drop one frame from each station from the lowest-priority
-	 * AC that has frames at all.
+	 * AC that has frames at all. Only stations that have frames
+	 * buffered need to be looked at.
 	 */
-	list_for_each_entry_rcu(sta, &local->sta_list, list) {
+	spin_lock_irqsave(&local->ps_sta_lock, flags);
+	list_for_each_entry_safe(sta, tmp, &local->ps_sta_list, ps_list) {
 		int ac;
 
 		for (ac = IEEE80211_AC_BK; ac >= IEEE80211_AC_VO; ac--) {
@@ -358,21 +366,33 @@ static void purge_old_ps_buffers(struct ieee80211_local *local)
 			total += skb_queue_len(&sta->ps_tx_buf[ac]);
 			if (skb) {
 				purged++;
-				dev_kfree_skb(skb);
+				__skb_queue_tail(&purge, skb);
 				break;
 			}
 		}
+
+		__sta_info_ps_prune(sta);
 	}
+	spin_unlock_irqrestore(&local->ps_sta_lock, flags);
 
-	rcu_read_unlock();
+	/* free the frames only now that interrupts are enabled again */
+	__skb_queue_purge(&purge);
 
 	local->total_ps_buffered = total;
+	local->ps_purged += purged;
 #ifdef CONFIG_MAC80211_VERBOSE_PS_DEBUG
 	wiphy_debug(local->hw.wiphy, "PS buffers full - purged %d frames\n",
 		    purged);
 #endif
 }
 
+static void ieee80211_ps_buffer_count(struct ieee80211_local *local)
+{
+	local->total_ps_buffered++;
+	if (local->total_ps_buffered > local->ps_buffered_peak)
+		local->ps_buffered_peak = local->total_ps_buffered;
+}
+
 static ieee80211_tx_result
 ieee80211_tx_h_multicast_ps_buf(struct ieee80211_tx_data *tx)
 {
@@ -417,7 +437,7 @@ ieee80211_tx_h_multicast_ps_buf(struct ieee80211_tx_data *tx)
 #endif
 		dev_kfree_skb(skb_dequeue(&tx->sdata->bss->ps_bc_buf));
 	} else
-		tx->local->total_ps_buffered++;
+		ieee80211_ps_buffer_count(tx->local);
 
 	skb_queue_tail(&tx->sdata->bss->ps_bc_buf, tx->skb);
 
@@ -446,7 +466,6 @@ ieee80211_tx_h_unicast_ps_buf(struct ieee80211_tx_data *tx)
 	struct sta_info *sta = tx->sta;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(tx->skb);
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)tx->skb->data;
-	struct ieee80211_local *local = tx->local;
 
 	if (unlikely(!sta))
 		return TX_CONTINUE;
@@ -481,17 +500,14 @@ ieee80211_tx_h_unicast_ps_buf(struct ieee80211_tx_data *tx)
 #endif
 			dev_kfree_skb(old);
 		} else
-			tx->local->total_ps_buffered++;
+			ieee80211_ps_buffer_count(tx->local);
 
 		info->control.jiffies = jiffies;
 		info->control.vif = &tx->sdata->vif;
 		info->flags |= IEEE80211_TX_INTFL_NEED_TXPROCESSING;
+		ieee80211_codel_stamp(tx->skb);
 		skb_queue_tail(&sta->ps_tx_buf[ac], tx->skb);
-
-		if (!timer_pending(&local->sta_cleanup))
-			mod_timer(&local->sta_cleanup,
-				  round_jiffies(jiffies +
-						STA_INFO_CLEANUP_INTERVAL));
+		sta_info_ps_buffered(sta);
 
 		/*
 		 * We queued up some frames, so the TIM bit might
@@ -542,6 +558,7 @@ ieee80211_tx_h_select_key(struct ieee80211_tx_data *tx)
 	struct ieee80211_key *key = NULL;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(tx->skb);
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)tx->skb->data;
+	int tail_need;
 
 	if (unlikely(info->flags & IEEE80211_TX_INTFL_DONT_ENCRYPT))
 		tx->key = NULL;
@@ -604,6 +621,18 @@ ieee80211_tx_h_select_key(struct ieee80211_tx_data *tx)
 		if (!skip_hw && tx->key &&
 		    tx->key->flags & KEY_FLAG_UPLOADED_TO_HARDWARE)
 			info->control.hw_key = &tx->key->conf;
+
+		/*
+		 * The frame may have been resized before the key needed
+		 * tailroom, see increment_tailroom_need_count().
+		 */
+		tail_need = IEEE80211_ENCRYPT_TAILROOM - skb_tailroom(tx->skb);
+		if (unlikely(tx->key && tail_need > 0) &&
+		    (!info->control.hw_key ||
+		     info->control.hw_key->flags &
+				IEEE80211_KEY_FLAG_GENERATE_MMIC) &&
+		    pskb_expand_head(tx->skb, 0, tail_need, GFP_ATOMIC))
+			return TX_DROP;
 	}
 
 	return TX_CONTINUE;
@@ -993,15 +1022,16 @@ static ieee80211_tx_result debug_noinline
 ieee80211_tx_h_stats(struct ieee80211_tx_data *tx)
 {
 	struct sk_buff *skb;
+	unsigned int fragments = 0, bytes = 0;
 
 	if (!tx->sta)
 		return TX_CONTINUE;
 
-	tx->sta->tx_packets++;
 	skb_queue_walk(&tx->skbs, skb) {
-		tx->sta->tx_fragments++;
-		tx->sta->tx_bytes += skb->len;
+		fragments++;
+		bytes += skb->len;
 	}
+	sta_stats_tx(tx->sta, 1, fragments, bytes);
 
 	return TX_CONTINUE;
 }
@@ -1182,6 +1212,8 @@ ieee80211_tx_prepare(struct ieee80211_sub_if_data *sdata,
 
 			if (unlikely(queued))
 				return TX_QUEUED;
+		} else {
+			ieee80211_agg_tx_policy(tx->sta, tid, skb);
 		}
 	}
 
@@ -1214,7 +1246,7 @@ static bool ieee80211_tx_frags(struct ieee80211_local *local,
 			       struct sk_buff_head *skbs,
 			       bool txpending)
 {
-	struct sk_buff *skb, *tmp;
+	struct sk_buff *skb, *tmp, *frag;
 	struct ieee80211_tx_info *info;
 	unsigned long flags;
 
@@ -1227,8 +1259,13 @@ static bool ieee80211_tx_frags(struct ieee80211_local *local,
 			/*
 			 * Since queue is stopped, queue up frames for later
 			 * transmission from the tx-pending tasklet when the
-			 * queue is woken again.
+			 * queue is woken again. Frames the tasklet puts back
+			 * keep the time they were first queued, only any
+			 * fragments created meanwhile need a stamp.
 			 */
+			skb_queue_walk(skbs, frag)
+				if (!txpending || !frag->tstamp.tv64)
+					ieee80211_codel_stamp(frag);
 			if (txpending)
 				skb_queue_splice_init(skbs, &local->pending[q]);
 			else
@@ -1245,6 +1282,9 @@ static bool ieee80211_tx_frags(struct ieee80211_local *local,
 		info->control.vif = vif;
 		info->control.sta = sta;
 
+		/* the CoDel stamp is internal to mac80211 */
+		skb->tstamp.tv64 = 0;
+
 		__skb_unlink(skb, skbs);
 		drv_tx(local, skb);
 	}
@@ -1252,6 +1292,259 @@ static bool ieee80211_tx_frags(struct ieee80211_local *local,
 	return true;
 }
 
+/*
+ * Per-station TX queueing
+ *
+ * With drivers implementing wake_tx_queue(), unicast data frames to a
+ * station are put on per-station, per-TID queues once they have been
+ * through the TX handlers. The driver pulls them with ieee80211_tx_dequeue()
+ * which serves the stations of an AC in deficit round-robin order: each
+ * station may use IEEE80211_AIRTIME_QUANTUM usecs of airtime per round, as
+ * accounted from the TX status, so a slow station gets the same airtime
+ * rather than the same number of frames as a fast one.
+ */
+
+/* drop the oldest frame of the longest queue of this AC */
+static void ieee80211_txq_drop_longest(struct ieee80211_local *local, u8 ac)
+{
+	struct sk_buff_head *longest = NULL;
+	struct sta_info *sta, *victim = NULL;
+	int tid;
+
+	list_for_each_entry(sta, &local->active_txqs[ac], txq_list[ac]) {
+		for (tid = 0; tid < ARRAY_SIZE(sta->txq); tid++) {
+			if (ieee802_1d_to_ac[tid] != ac)
+				continue;
+			if (!longest ||
+			    skb_queue_len(&sta->txq[tid]) > skb_queue_len(longest)) {
+				longest = &sta->txq[tid];
+				victim = sta;
+			}
+		}
+	}
+
+	if (WARN_ON(!longest || skb_queue_empty(longest)))
+		return;
+
+	dev_kfree_skb(__skb_dequeue(longest));
+	local->txq_len[ac]--;
+	victim->txq_drops++;
+}
+
+static void ieee80211_txq_enqueue(struct ieee80211_local *local,
+				  struct ieee80211_vif *vif,
+				  struct sta_info *sta,
+				  struct sk_buff_head *skbs)
+{
+	struct sk_buff *skb = skb_peek(skbs);
+	u8 tid = skb->priority & IEEE80211_QOS_CTL_TAG1D_MASK;
+	u8 ac = ieee802_1d_to_ac[tid];
+	struct ieee80211_tx_info *info;
+
+	spin_lock_bh(&local->txq_lock);
+
+	while ((skb = __skb_dequeue(skbs))) {
+		info = IEEE80211_SKB_CB(skb);
+		info->control.vif = vif;
+		info->control.sta = &sta->sta;
+		__net_timestamp(skb);
+
+		if (skb_queue_len(&sta->txq[tid]) >= IEEE80211_TXQ_TID_LIMIT) {
+			dev_kfree_skb(__skb_dequeue(&sta->txq[tid]));
+			local->txq_len[ac]--;
+			sta->txq_drops++;
+		}
+
+		__skb_queue_tail(&sta->txq[tid], skb);
+		local->txq_len[ac]++;
+	}
+
+	if (list_empty(&sta->txq_list[ac]))
+		list_add_tail(&sta->txq_list[ac], &local->active_txqs[ac]);
+
+	while (local->txq_len[ac] > IEEE80211_TXQ_AC_LIMIT)
+		ieee80211_txq_drop_longest(local, ac);
+
+	spin_unlock_bh(&local->txq_lock);
+
+	drv_wake_tx_queue(local, ac);
+}
+
+static struct sk_buff *ieee80211_sta_txq_dequeue(struct sta_info *sta, u8 ac)
+{
+	int tid;
+
+	/* higher TIDs of the AC first */
+	for (tid = ARRAY_SIZE(sta->txq) - 1; tid >= 0; tid--) {
+		if (ieee802_1d_to_ac[tid] != ac ||
+		    skb_queue_empty(&sta->txq[tid]))
+			continue;
+		return __skb_dequeue(&sta->txq[tid]);
+	}
+
+	return NULL;
+}
+
+struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw, u8 ac)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+	struct list_head *active = &local->active_txqs[ac];
+	struct sk_buff *skb = NULL;
+	struct sta_info *sta;
+	u32 delay;
+
+	spin_lock_bh(&local->txq_lock);
+
+	while (!list_empty(active)) {
+		sta = list_first_entry(active, struct sta_info, txq_list[ac]);
+
+		/*
+		 * Frames that were queued while the station was going to
+		 * sleep wait for it to wake up, see ieee80211_sta_txq_wakeup()
+		 */
+		if (test_sta_flag(sta, WLAN_STA_PS_STA) ||
+		    test_sta_flag(sta, WLAN_STA_PS_DRIVER)) {
+			list_del_init(&sta->txq_list[ac]);
+			continue;
+		}
+
+		if (sta->airtime_deficit[ac] <= 0) {
+			sta->airtime_deficit[ac] += IEEE80211_AIRTIME_QUANTUM;
+			list_move_tail(&sta->txq_list[ac], active);
+			continue;
+		}
+
+		skb = ieee80211_sta_txq_dequeue(sta, ac);
+		if (skb)
+			break;
+
+		/* nothing left on this AC, the station drops out */
+		list_del_init(&sta->txq_list[ac]);
+	}
+
+	if (skb) {
+		local->txq_len[ac]--;
+
+		delay = ktime_us_delta(ktime_get_real(), skb->tstamp);
+		skb->tstamp.tv64 = 0;
+		ewma_add(&sta->avg_txq_delay, delay);
+		if (delay > sta->max_txq_delay)
+			sta->max_txq_delay = delay;
+	}
+
+	spin_unlock_bh(&local->txq_lock);
+
+	return skb;
+}
+EXPORT_SYMBOL(ieee80211_tx_dequeue);
+
+void ieee80211_sta_register_airtime(struct sta_info *sta, u8 ac, u32 airtime)
+{
+	struct ieee80211_local *local = sta->local;
+
+	spin_lock_bh(&local->txq_lock);
+	sta->tx_airtime += airtime;
+	sta->airtime_deficit[ac] -= airtime;
+	spin_unlock_bh(&local->txq_lock);
+}
+
+/*
+ * A station went to sleep: hand its queued frames over to the filtered
+ * frame queues, which the PS code releases on wakeup, PS-Poll or in a
+ * service period. The frames already went through the TX handlers, so
+ * like frames the hardware filtered they are marked as retransmissions
+ * and are not processed again.
+ */
+void ieee80211_sta_txq_ps_start(struct sta_info *sta)
+{
+	struct ieee80211_local *local = sta->local;
+	struct ieee80211_tx_info *info;
+	struct sk_buff_head parked;
+	struct sk_buff *skb;
+	int ac, tid;
+
+	if (!local->ops->wake_tx_queue)
+		return;
+
+	__skb_queue_head_init(&parked);
+
+	spin_lock_bh(&local->txq_lock);
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
+		list_del_init(&sta->txq_list[ac]);
+	for (tid = 0; tid < ARRAY_SIZE(sta->txq); tid++) {
+		ac = ieee802_1d_to_ac[tid];
+		local->txq_len[ac] -= skb_queue_len(&sta->txq[tid]);
+		skb_queue_splice_tail_init(&sta->txq[tid], &parked);
+	}
+	spin_unlock_bh(&local->txq_lock);
+
+	if (skb_queue_empty(&parked))
+		return;
+
+	while ((skb = __skb_dequeue(&parked))) {
+		ac = ieee802_1d_to_ac[skb->priority &
+				      IEEE80211_QOS_CTL_TAG1D_MASK];
+		if (skb_queue_len(&sta->tx_filtered[ac]) >= STA_MAX_TX_BUFFER) {
+			sta->txq_drops++;
+			dev_kfree_skb(skb);
+			continue;
+		}
+
+		info = IEEE80211_SKB_CB(skb);
+		info->control.jiffies = jiffies;
+		info->flags |= IEEE80211_TX_INTFL_NEED_TXPROCESSING |
+			       IEEE80211_TX_INTFL_RETRANSMISSION;
+		ieee80211_codel_stamp(skb);
+		skb_queue_tail(&sta->tx_filtered[ac], skb);
+	}
+
+	sta_info_ps_buffered(sta);
+	sta_info_recalc_tim(sta);
+}
+
+/* put the queues of a station that woke up back into the rotation */
+void ieee80211_sta_txq_wakeup(struct sta_info *sta)
+{
+	struct ieee80211_local *local = sta->local;
+	unsigned long wake = 0;
+	int ac, tid;
+
+	if (!local->ops->wake_tx_queue)
+		return;
+
+	spin_lock_bh(&local->txq_lock);
+	for (tid = 0; tid < ARRAY_SIZE(sta->txq); tid++) {
+		ac = ieee802_1d_to_ac[tid];
+		if (skb_queue_empty(&sta->txq[tid]))
+			continue;
+		if (list_empty(&sta->txq_list[ac]))
+			list_add_tail(&sta->txq_list[ac],
+				      &local->active_txqs[ac]);
+		__set_bit(ac, &wake);
+	}
+	spin_unlock_bh(&local->txq_lock);
+
+	for_each_set_bit(ac, &wake, IEEE80211_NUM_ACS)
+		drv_wake_tx_queue(local, ac);
+}
+
+/* called after an RCU grace period once the station was unlinked */
+void ieee80211_sta_txq_purge(struct sta_info *sta)
+{
+	struct ieee80211_local *local = sta->local;
+	int ac, tid;
+
+	spin_lock_bh(&local->txq_lock);
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
+		list_del_init(&sta->txq_list[ac]);
+	for (tid = 0; tid < ARRAY_SIZE(sta->txq); tid++) {
+		ac = ieee802_1d_to_ac[tid];
+		local->txq_len[ac] -= skb_queue_len(&sta->txq[tid]);
+		__skb_queue_purge(&sta->txq[tid]);
+	}
+	spin_unlock_bh(&local->txq_lock);
+}
+
 /*
  * Returns false if the frame couldn't be transmitted but was queued instead.
  */
@@ -1296,7 +1589,11 @@ static bool __ieee80211_tx(struct ieee80211_local *local,
 		break;
 	}
 
-	if (local->ops->tx_frags)
+	if (sta && local->ops->wake_tx_queue &&
+	    ieee80211_is_data_present(fc) &&
+	    !(info->flags & IEEE80211_TX_CTL_NO_PS_BUFFER))
+		ieee80211_txq_enqueue(local, vif, sta, skbs);
+	else if (local->ops->tx_frags)
 		drv_tx_frags(local, vif, pubsta, skbs);
 	else
 		result = ieee80211_tx_frags(local, vif, pubsta, skbs,
@@ -1484,19 +1781,105 @@ void ieee80211_xmit(struct ieee80211_sub_if_data *sdata, struct sk_buff *skb)
 	rcu_read_unlock();
 }
 
+/*
+ * handle one radiotap argument of an injected frame,
+ * returns false if the frame should be dropped
+ */
+static bool ieee80211_parse_tx_radiotap_arg(struct sk_buff *skb,
+					    int index, u8 *arg, int rtap_len)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	u16 txflags;
+
+	/* see if this argument is something we can use */
+	switch (index) {
+	/*
+	 * You must take care when dereferencing arg for multibyte
+	 * types... the pointer is not aligned.  Use
+	 * get_unaligned((type *)arg) to dereference arg for type
+	 * "type" safely on all arches.
+	 */
+	case IEEE80211_RADIOTAP_FLAGS:
+		if (*arg & IEEE80211_RADIOTAP_F_FCS) {
+			/*
+			 * this indicates that the skb we have been
+			 * handed has the 32-bit FCS CRC at the end...
+			 * we should react to that by snipping it off
+			 * because it will be recomputed and added
+			 * on transmission
+			 */
+			if (skb->len < (rtap_len + FCS_LEN))
+				return false;
+
+			skb_trim(skb, skb->len - FCS_LEN);
+		}
+		if (*arg & IEEE80211_RADIOTAP_F_WEP)
+			info->flags &= ~IEEE80211_TX_INTFL_DONT_ENCRYPT;
+		if (*arg & IEEE80211_RADIOTAP_F_FRAG)
+			info->flags &= ~IEEE80211_TX_CTL_DONTFRAG;
+		break;
+
+	case IEEE80211_RADIOTAP_TX_FLAGS:
+		txflags = get_unaligned_le16(arg);
+		if (txflags & IEEE80211_RADIOTAP_F_TX_NOACK)
+			info->flags |= IEEE80211_TX_CTL_NO_ACK;
+		break;
+
+	/*
+	 * Please update the file
+	 * Documentation/networking/mac80211-injection.txt
+	 * when parsing new fields here.
+	 */
+
+	default:
+		break;
+	}
+
+	return true;
+}
+
 static bool ieee80211_parse_tx_radiotap(struct sk_buff *skb)
 {
+	static const int handled[] = {
+		IEEE80211_RADIOTAP_FLAGS,
+		IEEE80211_RADIOTAP_TX_FLAGS,
+	};
 	struct ieee80211_radiotap_iterator iterator;
+	struct ieee80211_radiotap_layout layout;
 	struct ieee80211_radiotap_header *rthdr =
 		(struct ieee80211_radiotap_header *) skb->data;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
-	int ret = ieee80211_radiotap_iterator_init(&iterator, rthdr, skb->len,
-						   NULL);
-	u16 txflags;
+	int i, ret;
 
 	info->flags |= IEEE80211_TX_INTFL_DONT_ENCRYPT |
 		       IEEE80211_TX_CTL_DONTFRAG;
 
+	/*
+	 * Fast path: for plain headers the field offsets are looked
+	 * up rather than found by walking the present bitmap.
+	 */
+	ret = ieee80211_radiotap_get_layout(rthdr, skb->len, &layout);
+	if (!ret) {
+		for (i = 0; i < ARRAY_SIZE(handled); i++) {
+			if (!(layout.present & BIT(handled[i])))
+				continue;
+			if (!ieee80211_parse_tx_radiotap_arg(skb, handled[i],
+					skb->data + layout.offset[handled[i]],
+					layout.len))
+				return false;
+		}
+
+		/* layout.len was sanity-checked against skb->len */
+		skb_pull(skb, layout.len);
+		return true;
+	}
+
+	if (ret != -EOPNOTSUPP)
+		return false;
+
+	ret = ieee80211_radiotap_iterator_init(&iterator, rthdr, skb->len,
+					       NULL);
+
 	/*
 	 * for every radiotap entry that is present
 	 * (ieee80211_radiotap_iterator_next returns -ENOENT when no more
@@ -1509,49 +1892,11 @@ static bool ieee80211_parse_tx_radiotap(struct sk_buff *skb)
 		if (ret)
 			continue;
 
-		/* see if this argument is something we can use */
-		switch (iterator.this_arg_index) {
-		/*
-		 * You must take care when dereferencing iterator.this_arg
-		 * for multibyte types... the pointer is not aligned.  Use
-		 * get_unaligned((type *)iterator.this_arg) to dereference
-		 * iterator.this_arg for type "type" safely on all arches.
-		*/
-		case IEEE80211_RADIOTAP_FLAGS:
-			if (*iterator.this_arg & IEEE80211_RADIOTAP_F_FCS) {
-				/*
-				 * this indicates that the skb we have been
-				 * handed has the 32-bit FCS CRC at the end...
-				 * we should react to that by snipping it off
-				 * because it will be recomputed and added
-				 * on transmission
-				 */
-				if (skb->len < (iterator._max_length + FCS_LEN))
-					return false;
-
-				skb_trim(skb, skb->len - FCS_LEN);
-			}
-			if (*iterator.this_arg & IEEE80211_RADIOTAP_F_WEP)
-				info->flags &= ~IEEE80211_TX_INTFL_DONT_ENCRYPT;
-			if (*iterator.this_arg & IEEE80211_RADIOTAP_F_FRAG)
-				info->flags &= ~IEEE80211_TX_CTL_DONTFRAG;
-			break;
-
-		case IEEE80211_RADIOTAP_TX_FLAGS:
-			txflags = get_unaligned_le16(iterator.this_arg);
-			if (txflags & IEEE80211_RADIOTAP_F_TX_NOACK)
-				info->flags |= IEEE80211_TX_CTL_NO_ACK;
-			break;
-
-		/*
-		 * Please update the file
-		 * Documentation/networking/mac80211-injection.txt
-		 * when parsing new fields here.
-		 */
-
-		default:
-			break;
-		}
+		if (!ieee80211_parse_tx_radiotap_arg(skb,
+						     iterator.this_arg_index,
+						     iterator.this_arg,
+						     iterator._max_length))
+			return false;
 	}
 
 	if (ret != -ENOENT) /* ie, if we didn't simply run out of fields */
@@ -1695,6 +2040,421 @@ fail:
 	return NETDEV_TX_OK; /* meaning, we dealt with the skb */
 }
 
+/*
+ * Software A-MSDU aggregation
+ *
+ * Unicast QoS data frames to a station with an operational TX BA session
+ * on the frame's TID, for which the station accepted A-MSDUs in its ADDBA
+ * response, are not handed to ieee80211_xmit() right away, but
+ * held back per station and TID. Frames for the same station and TID that
+ * are transmitted before the A-MSDU tasklet gets to run -- typically a
+ * burst the qdisc dequeues in one go -- are appended to the held frame as
+ * A-MSDU subframes. The tasklet then sends whatever is still held, so a
+ * frame is never delayed by more than one softirq round.
+ */
+
+/*
+ * A-MSDUs are only built inside A-MPDUs, where the whole MPDU including
+ * its header, security overhead and FCS is limited to 4095 bytes no
+ * matter what A-MSDU size the station advertises.
+ */
+static int ieee80211_amsdu_max_len(struct sta_info *sta, int hdrlen)
+{
+	int max_len = IEEE80211_MAX_MPDU_LEN_HT_BA - hdrlen - FCS_LEN -
+		      IEEE80211_ENCRYPT_HEADROOM - IEEE80211_ENCRYPT_TAILROOM;
+
+	if (!(sta->sta.ht_cap.cap & IEEE80211_HT_CAP_MAX_AMSDU))
+		max_len = min(max_len, IEEE80211_MAX_AMSDU_LEN_HT_3839);
+
+	return max_len;
+}
+
+/* turn the held frame into an A-MSDU carrying it as the first subframe */
+static bool ieee80211_amsdu_prepare_head(struct ieee80211_sub_if_data *sdata,
+					 struct sk_buff *head, int hdrlen,
+					 int max_len)
+{
+	struct ieee80211_local *local = sdata->local;
+	struct ieee80211_hdr *hdr = (void *)head->data;
+	struct ethhdr *eth;
+	int head_need, tail_need;
+	u8 da[ETH_ALEN], sa[ETH_ALEN];
+	u8 *qc;
+
+	memcpy(da, ieee80211_get_DA(hdr), ETH_ALEN);
+	memcpy(sa, ieee80211_get_SA(hdr), ETH_ALEN);
+
+	head_need = sizeof(*eth) + IEEE80211_ENCRYPT_HEADROOM +
+		    local->tx_headroom - skb_headroom(head);
+	head_need = max_t(int, 0, head_need);
+	tail_need = max_len + hdrlen + IEEE80211_ENCRYPT_TAILROOM - head->len;
+	tail_need = max_t(int, 0, tail_need - skb_tailroom(head));
+
+	if ((head_need || tail_need || skb_cloned(head)) &&
+	    pskb_expand_head(head, head_need, tail_need, GFP_ATOMIC))
+		return false;
+
+	/* insert the subframe header between 802.11 header and LLC */
+	eth = (void *)(skb_push(head, sizeof(*eth)) + hdrlen);
+	memmove(head->data, head->data + sizeof(*eth), hdrlen);
+	memcpy(eth->h_dest, da, ETH_ALEN);
+	memcpy(eth->h_source, sa, ETH_ALEN);
+	eth->h_proto = htons(head->len - hdrlen - sizeof(*eth));
+
+	hdr = (void *)head->data;
+	qc = ieee80211_get_qos_ctl(hdr);
+	*qc |= IEEE80211_QOS_CTL_A_MSDU_PRESENT;
+
+	/* the A-MSDU is addressed to the BSSID rather than the DA/SA */
+	if (ieee80211_has_fromds(hdr->frame_control))
+		memcpy(hdr->addr3, hdr->addr2, ETH_ALEN);
+	else if (ieee80211_has_tods(hdr->frame_control))
+		memcpy(hdr->addr3, hdr->addr1, ETH_ALEN);
+
+	return true;
+}
+
+/*
+ * Append the MSDU in skb to the frame held for sta/tid, returns false
+ * if it doesn't fit; the caller frees skb only on success.
+ */
+static bool ieee80211_amsdu_add(struct sta_info *sta, u8 tid,
+				struct sk_buff *skb, int hdrlen)
+{
+	struct sk_buff *head = sta->amsdu_skb[tid];
+	struct ieee80211_hdr *hdr = (void *)skb->data;
+	int max_len = ieee80211_amsdu_max_len(sta, hdrlen);
+	int msdu_len = skb->len - hdrlen;
+	int amsdu_len = head->len - hdrlen;
+	struct ethhdr *eth;
+	int pad;
+
+	if (sta->amsdu_frames[tid] >= IEEE80211_AMSDU_MAX_SUBFRAMES)
+		return false;
+
+	/* the held frame doesn't have its subframe header yet */
+	if (sta->amsdu_frames[tid] == 1)
+		amsdu_len += sizeof(*eth);
+
+	pad = -amsdu_len & 3;
+	if (amsdu_len + pad + sizeof(*eth) + msdu_len > max_len)
+		return false;
+
+	if (sta->amsdu_frames[tid] == 1 &&
+	    !ieee80211_amsdu_prepare_head(sta->sdata, head, hdrlen, max_len))
+		return false;
+
+	memset(skb_put(head, pad), 0, pad);
+	eth = (void *)skb_put(head, sizeof(*eth));
+	memcpy(eth->h_dest, ieee80211_get_DA(hdr), ETH_ALEN);
+	memcpy(eth->h_source, ieee80211_get_SA(hdr), ETH_ALEN);
+	eth->h_proto = htons(msdu_len);
+	skb_copy_bits(skb, hdrlen, skb_put(head, msdu_len), msdu_len);
+
+	sta->amsdu_frames[tid]++;
+	return true;
+}
+
+/* detach the frame held for sta/tid, call with the sta's amsdu_lock held */
+static struct sk_buff *ieee80211_amsdu_take(struct sta_info *sta, u8 tid)
+{
+	struct sk_buff *skb = sta->amsdu_skb[tid];
+
+	if (!skb)
+		return NULL;
+
+	if (sta->amsdu_frames[tid] > 1) {
+		sta->tx_amsdu++;
+		sta->tx_amsdu_msdus += sta->amsdu_frames[tid];
+	} else {
+		sta->tx_amsdu_single++;
+	}
+
+	sta->amsdu_skb[tid] = NULL;
+	sta->amsdu_frames[tid] = 0;
+	return skb;
+}
+
+static bool ieee80211_amsdu_eligible(struct ieee80211_sub_if_data *sdata,
+				     struct sk_buff *skb, int hdrlen)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	const u8 *payload = skb->data + hdrlen;
+
+	/* frames that want their own TX status can't be merged */
+	if (info->flags)
+		return false;
+
+	/* only plain RFC 1042 encapsulated frames, and never EAPOL */
+	if (skb->len < hdrlen + sizeof(rfc1042_header) + 2 ||
+	    memcmp(payload, rfc1042_header, sizeof(rfc1042_header)))
+		return false;
+
+	payload += sizeof(rfc1042_header);
+	return *(__be16 *)payload != sdata->control_port_protocol;
+}
+
+/*
+ * Returns true if the frame was consumed, i.e. held back or merged into
+ * a frame that is being held back.
+ */
+static bool ieee80211_amsdu_aggregate(struct ieee80211_sub_if_data *sdata,
+				      struct sk_buff *skb)
+{
+	struct ieee80211_local *local = sdata->local;
+	struct ieee80211_hdr *hdr = (void *)skb->data;
+	struct sk_buff *flush = NULL;
+	struct tid_ampdu_tx *tid_tx;
+	struct sta_info *sta;
+	bool consumed = false;
+	int hdrlen;
+	u8 tid;
+
+	if (!(local->hw.flags & IEEE80211_HW_TX_AMSDU))
+		return false;
+
+	if (!ieee80211_is_data_qos(hdr->frame_control) ||
+	    ieee80211_has_a4(hdr->frame_control) ||
+	    is_multicast_ether_addr(hdr->addr1) ||
+	    ieee80211_vif_is_mesh(&sdata->vif))
+		return false;
+
+	hdrlen = ieee80211_hdrlen(hdr->frame_control);
+	tid = skb->priority & IEEE80211_QOS_CTL_TAG1D_MASK;
+
+	rcu_read_lock();
+
+	sta = sta_info_get(sdata, hdr->addr1);
+	if (!sta || !sta->sta.ht_cap.ht_supported)
+		goto out;
+
+	spin_lock_bh(&sta->amsdu_lock);
+
+	tid_tx = rcu_dereference(sta->ampdu_mlme.tid_tx[tid]);
+	if (!tid_tx || !test_bit(HT_AGG_STATE_OPERATIONAL, &tid_tx->state) ||
+	    !tid_tx->amsdu || !ieee80211_amsdu_eligible(sdata, skb, hdrlen)) {
+		/* keep ordering: what we held goes out first */
+		flush = ieee80211_amsdu_take(sta, tid);
+		goto unlock;
+	}
+
+	if (sta->amsdu_skb[tid]) {
+		if (ieee80211_amsdu_add(sta, tid, skb, hdrlen)) {
+			dev_kfree_skb(skb);
+			consumed = true;
+			goto unlock;
+		}
+		sta->tx_amsdu_full++;
+		flush = ieee80211_amsdu_take(sta, tid);
+	}
+
+	/* the held frame is extended in place, so it has to be linear */
+	if (skb_is_nonlinear(skb))
+		goto unlock;
+
+	sta->amsdu_skb[tid] = skb;
+	sta->amsdu_frames[tid] = 1;
+	consumed = true;
+
+	spin_lock(&local->amsdu_lock);
+	if (list_empty(&sta->amsdu_list))
+		list_add_tail(&sta->amsdu_list, &local->amsdu_list);
+	spin_unlock(&local->amsdu_lock);
+
+	tasklet_schedule(&local->amsdu_tasklet);
+
+ unlock:
+	spin_unlock_bh(&sta->amsdu_lock);
+	if (flush)
+		ieee80211_xmit(sdata, flush);
+ out:
+	rcu_read_unlock();
+	return consumed;
+}
+
+static void ieee80211_sta_amsdu_flush(struct sta_info *sta)
+{
+	struct sk_buff_head frames;
+	struct sk_buff *skb;
+	u8 tid;
+
+	__skb_queue_head_init(&frames);
+
+	spin_lock_bh(&sta->amsdu_lock);
+	for (tid = 0; tid < ARRAY_SIZE(sta->amsdu_skb); tid++) {
+		skb = ieee80211_amsdu_take(sta, tid);
+		if (skb)
+			__skb_queue_tail(&frames, skb);
+	}
+	spin_unlock_bh(&sta->amsdu_lock);
+
+	while ((skb = __skb_dequeue(&frames)))
+		ieee80211_xmit(sta->sdata, skb);
+}
+
+void ieee80211_amsdu_tasklet(unsigned long data)
+{
+	struct ieee80211_local *local = (struct ieee80211_local *)data;
+	struct sta_info *sta;
+
+	rcu_read_lock();
+	spin_lock_bh(&local->amsdu_lock);
+	while (!list_empty(&local->amsdu_list)) {
+		sta = list_first_entry(&local->amsdu_list,
+				       struct sta_info, amsdu_list);
+		list_del_init(&sta->amsdu_list);
+		spin_unlock_bh(&local->amsdu_lock);
+
+		ieee80211_sta_amsdu_flush(sta);
+
+		spin_lock_bh(&local->amsdu_lock);
+	}
+	spin_unlock_bh(&local->amsdu_lock);
+	rcu_read_unlock();
+}
+
+/*
+ * Drop the frames held for a station that is going away; the TX path
+ * must no longer be able to find the station, i.e. this has to be
+ * called after an RCU grace period.
+ */
+void ieee80211_sta_amsdu_purge(struct sta_info *sta)
+{
+	struct ieee80211_local *local = sta->local;
+	u8 tid;
+
+	spin_lock_bh(&local->amsdu_lock);
+	list_del_init(&sta->amsdu_list);
+	spin_unlock_bh(&local->amsdu_lock);
+
+	/*
+	 * The tasklet may already have taken the station off the list and
+	 * still be flushing it; wait for it, it can't find it any more.
+	 */
+	tasklet_disable(&local->amsdu_tasklet);
+	tasklet_enable(&local->amsdu_tasklet);
+
+	spin_lock_bh(&sta->amsdu_lock);
+	for (tid = 0; tid < ARRAY_SIZE(sta->amsdu_skb); tid++) {
+		dev_kfree_skb(sta->amsdu_skb[tid]);
+		sta->amsdu_skb[tid] = NULL;
+		sta->amsdu_frames[tid] = 0;
+	}
+	spin_unlock_bh(&sta->amsdu_lock);
+}
+
+static bool ieee80211_mc2uc_eligible(struct ieee80211_sub_if_data *sdata,
+				     struct sk_buff *skb)
+{
+	struct ieee80211_if_ap *ap = &sdata->u.ap;
+	const struct ethhdr *eth = (void *)skb->data;
+	int num_sta;
+
+	if (sdata->vif.type != NL80211_IFTYPE_AP || !ap->mc2uc_max_sta)
+		return false;
+
+	if (!is_multicast_ether_addr(eth->h_dest))
+		return false;
+
+	num_sta = atomic_read(&ap->num_sta_authorized);
+	if (!num_sta || num_sta > ap->mc2uc_max_sta)
+		return false;
+
+	/*
+	 * Leave anything but IP and ARP alone, in particular the control
+	 * port protocol.
+	 */
+	switch (eth->h_proto) {
+	case cpu_to_be16(ETH_P_ARP):
+	case cpu_to_be16(ETH_P_IP):
+	case cpu_to_be16(ETH_P_IPV6):
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Send a multicast data frame on an AP interface as a unicast copy to each
+ * authorized station. Multicast goes out at the lowest basic rate and isn't
+ * acknowledged or aggregated, while the copies are sent at each station's
+ * own rate and may be aggregated. Returns true if the frame was consumed.
+ */
+static bool ieee80211_multicast_to_unicast(struct ieee80211_sub_if_data *sdata,
+					   struct sk_buff *skb)
+{
+	struct ieee80211_local *local = sdata->local;
+	struct ieee80211_supported_band *sband;
+	struct ieee80211_tx_rate mc_rate = {};
+	struct sta_info *sta, *prev = NULL;
+	struct sk_buff *copy;
+	struct sk_buff_head copies;
+	size_t len;
+	u32 mc_dur, uc_dur = 0;
+	int dur;
+
+	if (!ieee80211_mc2uc_eligible(sdata, skb))
+		return false;
+
+	__skb_queue_head_init(&copies);
+
+	sband = local->hw.wiphy->bands[local->hw.conf.channel->band];
+	/* 802.11 header and LLC/SNAP instead of the Ethernet header */
+	len = skb->len - ETH_HLEN + 24 + 8;
+
+	if (sdata->vif.bss_conf.basic_rates)
+		mc_rate.idx = ffs(sdata->vif.bss_conf.basic_rates) - 1;
+	mc_dur = ieee80211_tx_rate_duration(local, sband, &mc_rate, len);
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(sta, &local->sta_list, list) {
+		if (sta->sdata != sdata ||
+		    !test_sta_flag(sta, WLAN_STA_AUTHORIZED))
+			continue;
+
+		/* don't send the frame back to where it came from */
+		if (!compare_ether_addr(sta->sta.addr, skb->data + ETH_ALEN))
+			continue;
+
+		/* the last station gets the original frame */
+		if (prev) {
+			copy = skb_clone(skb, GFP_ATOMIC);
+			if (!copy || skb_cow_head(copy, 0)) {
+				dev_kfree_skb(copy);
+				break;
+			}
+			memcpy(copy->data, prev->sta.addr, ETH_ALEN);
+			__skb_queue_tail(&copies, copy);
+		}
+
+		/* assume no savings for stations we haven't sent to yet */
+		dur = ieee80211_tx_rate_duration(local, sband,
+						 &sta->last_tx_rate, len);
+		uc_dur += dur ?: mc_dur;
+		prev = sta;
+	}
+
+	if (!prev || skb_cow_head(skb, 0)) {
+		rcu_read_unlock();
+		__skb_queue_purge(&copies);
+		return false;
+	}
+	memcpy(skb->data, prev->sta.addr, ETH_ALEN);
+	__skb_queue_tail(&copies, skb);
+	rcu_read_unlock();
+
+	ieee80211_sdata_mc2uc_stats(sdata, skb_queue_len(&copies),
+				    mc_dur, uc_dur);
+
+	while ((copy = __skb_dequeue(&copies))) {
+		/* the copies may well map to a different AC now */
+		skb_set_queue_mapping(copy, ieee80211_select_queue(sdata, copy));
+		ieee80211_subif_start_xmit(copy, sdata->dev);
+	}
+
+	return true;
+}
+
 /**
  * ieee80211_subif_start_xmit - netif start_xmit function for Ethernet-type
  * subinterfaces (wlan#, WDS, and VLAN interfaces)
@@ -1737,6 +2497,15 @@ netdev_tx_t ieee80211_subif_start_xmit(struct sk_buff *skb,
 		goto fail;
 	}
 
+	/*
+	 * Forwarded frames still carry their RX timestamp, the field is
+	 * used for the time frames spend on mac80211's queues.
+	 */
+	skb->tstamp.tv64 = 0;
+
+	if (ieee80211_multicast_to_unicast(sdata, skb))
+		return NETDEV_TX_OK;
+
 	/* convert Ethernet header to proper 802.11 header (based on
 	 * operation mode) */
 	ethertype = (skb->data[12] << 8) | skb->data[13];
@@ -2095,8 +2864,7 @@ netdev_tx_t ieee80211_subif_start_xmit(struct sk_buff *skb,
 	nh_pos += hdrlen;
 	h_pos += hdrlen;
 
-	dev->stats.tx_packets++;
-	dev->stats.tx_bytes += skb->len;
+	ieee80211_sdata_tx_stats(sdata, skb->len);
 
 	/* Update skb pointers to various headers since this modified frame
 	 * is going to go through Linux networking code that may potentially
@@ -2113,6 +2881,9 @@ netdev_tx_t ieee80211_subif_start_xmit(struct sk_buff *skb,
 	info->flags = info_flags;
 	info->ack_frame_id = info_id;
 
+	if (ieee80211_amsdu_aggregate(sdata, skb))
+		return NETDEV_TX_OK;
+
 	ieee80211_xmit(sdata, skb);
 
 	return NETDEV_TX_OK;
@@ -2177,10 +2948,17 @@ void ieee80211_tx_pending(unsigned long data)
 {
 	struct ieee80211_local *local = (struct ieee80211_local *)data;
 	struct ieee80211_sub_if_data *sdata;
+	struct ieee80211_codel_params params = {
+		.target = IEEE80211_CODEL_TARGET,
+		.interval = IEEE80211_CODEL_INTERVAL,
+	};
+	struct sk_buff_head dropped;
 	unsigned long flags;
 	int i;
 	bool txok;
 
+	__skb_queue_head_init(&dropped);
+
 	rcu_read_lock();
 
 	spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
@@ -2194,8 +2972,16 @@ void ieee80211_tx_pending(unsigned long data)
 			continue;
 
 		while (!skb_queue_empty(&local->pending[i])) {
-			struct sk_buff *skb = __skb_dequeue(&local->pending[i]);
-			struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+			struct sk_buff *skb;
+			struct ieee80211_tx_info *info;
+
+			skb = ieee80211_codel_dequeue(&local->pending[i],
+						      &params,
+						      &local->pending_cvars[i],
+						      &dropped);
+			if (!skb)
+				break;
+			info = IEEE80211_SKB_CB(skb);
 
 			if (WARN_ON(!info->control.vif)) {
 				kfree_skb(skb);
@@ -2226,6 +3012,8 @@ void ieee80211_tx_pending(unsigned long data)
 	spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
 
 	rcu_read_unlock();
+
+	__skb_queue_purge(&dropped);
 }
 
 /* functions for drivers to get certain frames */
@@ -2237,15 +3025,12 @@ static void ieee80211_beacon_add_tim(struct ieee80211_sub_if_data *sdata,
 {
 	u8 *pos, *tim;
 	int aid0 = 0;
-	int i, have_bits = 0, n1, n2;
+	int have_bits = 0, n1, n2;
 
 	/* Generate bitmap for TIM only if there are any STAs in power save
 	 * mode. */
 	if (atomic_read(&bss->num_sta_ps) > 0)
-		/* in the hope that this is faster than
-		 * checking byte-for-byte */
-		have_bits = !bitmap_empty((unsigned long*)bss->tim,
-					  IEEE80211_MAX_AID+1);
+		have_bits = bss->tim_bits > 0;
 
 	if (bss->dtim_count == 0)
 		bss->dtim_count = sdata->vif.bss_conf.dtim_period - 1;
@@ -2266,21 +3051,16 @@ static void ieee80211_beacon_add_tim(struct ieee80211_sub_if_data *sdata,
 	if (have_bits) {
 		/* Find largest even number N1 so that bits numbered 1 through
 		 * (N1 x 8) - 1 in the bitmap are 0 and number N2 so that bits
-		 * (N2 + 1) x 8 through 2007 are 0. */
-		n1 = 0;
-		for (i = 0; i < IEEE80211_MAX_TIM_LEN; i++) {
-			if (bss->tim[i]) {
-				n1 = i & 0xfe;
-				break;
-			}
-		}
-		n2 = n1;
-		for (i = IEEE80211_MAX_TIM_LEN - 1; i >= n1; i--) {
-			if (bss->tim[i]) {
-				n2 = i;
-				break;
-			}
-		}
+		 * (N2 + 1) x 8 through 2007 are 0. All the bits are within
+		 * tim_min/tim_max, which only need to be tightened when bits
+		 * at the edges were cleared. */
+		while (!bss->tim[bss->tim_min])
+			bss->tim_min++;
+		while (!bss->tim[bss->tim_max])
+			bss->tim_max--;
+
+		n1 = bss->tim_min & 0xfe;
+		n2 = bss->tim_max;
 
 		/* Bitmap control */
 		*pos++ = n1 | aid0;
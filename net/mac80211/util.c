@@ -159,6 +159,98 @@ int ieee80211_frame_duration(struct ieee80211_local *local, size_t len,
 	return dur;
 }
 
+/* data bits per OFDM symbol of a single spatial stream, 20 and 40 MHz */
+static const u16 ieee80211_ht_bits_per_symbol[2][8] = {
+	{ 26, 52, 78, 104, 156, 208, 234, 260 },
+	{ 54, 108, 162, 216, 324, 432, 486, 540 },
+};
+
+static int ieee80211_ht_frame_duration(size_t len, int mcs, bool ht40,
+				       bool sgi)
+{
+	int streams, nsym, dur;
+
+	if (mcs > 31)
+		mcs = 0;
+	streams = mcs / 8 + 1;
+
+	nsym = DIV_ROUND_UP(16 + 8 * (len + 4) + 6,
+			    ieee80211_ht_bits_per_symbol[ht40][mcs % 8] *
+			    streams);
+
+	/* SIFS, L-STF + L-LTF + L-SIG, HT-SIG, HT-STF, HT-LTFs */
+	dur = 16 + 20 + 8 + 4 + 4 * streams;
+	dur += sgi ? DIV_ROUND_UP(nsym * 36, 10) : nsym * 4;
+
+	return dur;
+}
+
+/*
+ * Duration (in usecs) of a single transmission of a @len bytes frame at
+ * rate @r, or 0 if the rate isn't valid.
+ */
+int ieee80211_tx_rate_duration(struct ieee80211_local *local,
+			       struct ieee80211_supported_band *sband,
+			       const struct ieee80211_tx_rate *r, size_t len)
+{
+	struct ieee80211_rate *rate;
+
+	if (r->idx < 0)
+		return 0;
+
+	if (r->flags & IEEE80211_TX_RC_MCS)
+		return ieee80211_ht_frame_duration(len, r->idx,
+				r->flags & IEEE80211_TX_RC_40_MHZ_WIDTH,
+				r->flags & IEEE80211_TX_RC_SHORT_GI);
+
+	if (!sband || r->idx >= sband->n_bitrates)
+		return 0;
+
+	rate = &sband->bitrates[r->idx];
+	return ieee80211_frame_duration(local, len, rate->bitrate,
+			rate->flags & IEEE80211_RATE_ERP_G,
+			r->flags & IEEE80211_TX_RC_USE_SHORT_PREAMBLE);
+}
+
+/*
+ * Airtime (in usecs) a transmitted frame used, including all retries;
+ * prefers the driver's report and estimates it from the rates otherwise.
+ * The status union isn't cleared by mac80211, so the report is only
+ * trusted from drivers saying they fill it in.
+ */
+u32 ieee80211_tx_airtime(struct ieee80211_local *local,
+			 struct ieee80211_supported_band *sband,
+			 struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_tx_rate *r;
+	size_t len = skb->len;
+	u32 airtime = 0;
+	int i, dur;
+
+	if ((local->hw.flags & IEEE80211_HW_REPORTS_TX_AIRTIME) &&
+	    info->status.tx_time)
+		return info->status.tx_time;
+
+	/* the status of an A-MPDU covers all its subframes */
+	if ((info->flags & IEEE80211_TX_STAT_AMPDU) && info->status.ampdu_len)
+		len *= info->status.ampdu_len;
+
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		r = &info->status.rates[i];
+		if (r->idx < 0 || !r->count)
+			break;
+
+		dur = ieee80211_tx_rate_duration(local, sband, r, len);
+		if (!dur)
+			break;
+
+		airtime += dur * r->count;
+	}
+
+	return airtime;
+}
+
 /* Exported duration function for driver use */
 __le16 ieee80211_generic_frame_duration(struct ieee80211_hw *hw,
 					struct ieee80211_vif *vif,
@@ -387,6 +479,8 @@ void ieee80211_add_pending_skb(struct ieee80211_local *local,
 		return;
 	}
 
+	ieee80211_codel_stamp(skb);
+
 	spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
 	__ieee80211_stop_queue(hw, queue, IEEE80211_QUEUE_STOP_REASON_SKB_ADD);
 	__skb_queue_tail(&local->pending[queue], skb);
@@ -417,6 +511,7 @@ void ieee80211_add_pending_skbs_fn(struct ieee80211_local *local,
 		}
 
 		queue = skb_get_queue_mapping(skb);
+		ieee80211_codel_stamp(skb);
 		__skb_queue_tail(&local->pending[queue], skb);
 	}
 
@@ -1389,6 +1484,8 @@ int ieee80211_reconfig(struct ieee80211_local *local)
 	mb();
 	local->resuming = false;
 
+	ieee80211_agg_start_restart(local);
+
 	list_for_each_entry(sdata, &local->interfaces, list) {
 		switch(sdata->vif.type) {
 		case NL80211_IFTYPE_STATION:
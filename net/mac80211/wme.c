@@ -172,8 +172,9 @@ void ieee80211_set_qos_hdr(struct ieee80211_sub_if_data *sdata,
 
 		tid = skb->priority & IEEE80211_QOS_CTL_TAG1D_MASK;
 
-		/* preserve EOSP bit */
-		ack_policy = *p & IEEE80211_QOS_CTL_EOSP;
+		/* preserve EOSP and A-MSDU present bits */
+		ack_policy = *p & (IEEE80211_QOS_CTL_EOSP |
+				   IEEE80211_QOS_CTL_A_MSDU_PRESENT);
 
 		if (is_multicast_ether_addr(hdr->addr1) ||
 		    sdata->noack_map & BIT(tid)) {
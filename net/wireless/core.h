@@ -61,6 +61,8 @@ struct cfg80211_registered_device {
 	struct list_head bss_list;
 	struct rb_root bss_tree;
 	u32 bss_generation;
+	/* bss_generation at which an entry was last removed */
+	u32 bss_unlink_generation;
 	struct cfg80211_scan_request *scan_req; /* protected by RTNL */
 	struct cfg80211_sched_scan_request *sched_scan_req;
 	unsigned long suspend_at;
@@ -132,8 +134,19 @@ struct cfg80211_internal_bss {
 	unsigned long ts;
 	struct kref ref;
 	atomic_t hold;
+	u32 generation;
 	bool beacon_ies_allocated;
 	bool proberesp_ies_allocated;
+#ifdef CONFIG_CFG80211_WEXT
+	/*
+	 * cached WEXT scan events generated from the IEs, the generic IE
+	 * events follow the first wext_ies_len bytes; protected by bss_lock
+	 */
+	char *wext_ies;
+	u16 wext_ies_len;
+	u16 wext_genie_len;
+	bool wext_ies_compat;
+#endif
 
 	/* must be last because of priv member */
 	struct cfg80211_bss pub;
@@ -365,7 +378,8 @@ void __cfg80211_connect_result(struct net_device *dev, const u8 *bssid,
 			       struct cfg80211_bss *bss);
 int cfg80211_mlme_register_mgmt(struct wireless_dev *wdev, u32 snd_pid,
 				u16 frame_type, const u8 *match_data,
-				int match_len);
+				int match_len, u32 batch_size,
+				u32 batch_timeout);
 void cfg80211_mlme_unregister_socket(struct wireless_dev *wdev, u32 nlpid);
 void cfg80211_mlme_purge_registrations(struct wireless_dev *wdev);
 int cfg80211_mlme_mgmt_tx(struct cfg80211_registered_device *rdev,
@@ -12,6 +12,7 @@
 #include <linux/wireless.h>
 #include <net/cfg80211.h>
 #include <net/iw_handler.h>
+#include <net/netlink.h>
 #include "core.h"
 #include "nl80211.h"
 
@@ -605,12 +606,90 @@ struct cfg80211_mgmt_registration {
 
 	__le16 frame_type;
 
+	/* batched delivery, protected by mgmt_registrations_lock */
+	struct wireless_dev *wdev;
+	struct nl80211_mgmt_batch batch;
+	struct timer_list batch_timer;
+	unsigned long batch_timeout;
+	u32 batch_size;
+	u32 dropped;
+
 	u8 match[];
 };
 
+/* must hold wdev->mgmt_registrations_lock */
+static void cfg80211_mgmt_batch_flush(struct cfg80211_mgmt_registration *reg)
+{
+	struct cfg80211_registered_device *rdev = wiphy_to_dev(reg->wdev->wiphy);
+	unsigned int count = reg->batch.count;
+
+	if (!reg->batch.msg)
+		return;
+
+	if (nl80211_mgmt_batch_send(&reg->batch, rdev, reg->nlpid,
+				    reg->dropped))
+		reg->dropped += count;
+}
+
+static void cfg80211_mgmt_batch_timer(unsigned long data)
+{
+	struct cfg80211_mgmt_registration *reg = (void *)data;
+	struct wireless_dev *wdev = reg->wdev;
+
+	spin_lock_bh(&wdev->mgmt_registrations_lock);
+	cfg80211_mgmt_batch_flush(reg);
+	spin_unlock_bh(&wdev->mgmt_registrations_lock);
+}
+
+/* must hold wdev->mgmt_registrations_lock */
+static int cfg80211_mgmt_batch_queue(struct cfg80211_mgmt_registration *reg,
+				     struct net_device *dev, int freq,
+				     int sig_mbm, const u8 *buf, size_t len,
+				     gfp_t gfp)
+{
+	struct cfg80211_registered_device *rdev = wiphy_to_dev(reg->wdev->wiphy);
+	bool retried = false;
+
+ again:
+	if (!reg->batch.msg) {
+		if (nl80211_mgmt_batch_start(&reg->batch, rdev, dev, gfp)) {
+			reg->dropped++;
+			return -ENOMEM;
+		}
+		mod_timer(&reg->batch_timer, jiffies + reg->batch_timeout);
+	}
+
+	if (nl80211_mgmt_batch_add(&reg->batch, freq, sig_mbm, buf, len)) {
+		/* doesn't fit, send what we have and start a new batch */
+		if (retried || !reg->batch.count) {
+			reg->dropped++;
+			return -EMSGSIZE;
+		}
+		cfg80211_mgmt_batch_flush(reg);
+		retried = true;
+		goto again;
+	}
+
+	if (reg->batch.count >= reg->batch_size) {
+		del_timer(&reg->batch_timer);
+		cfg80211_mgmt_batch_flush(reg);
+	}
+
+	return 0;
+}
+
+static void cfg80211_mgmt_reg_free(struct cfg80211_mgmt_registration *reg)
+{
+	del_timer_sync(&reg->batch_timer);
+	if (reg->batch.msg)
+		nlmsg_free(reg->batch.msg);
+	kfree(reg);
+}
+
 int cfg80211_mlme_register_mgmt(struct wireless_dev *wdev, u32 snd_pid,
 				u16 frame_type, const u8 *match_data,
-				int match_len)
+				int match_len, u32 batch_size,
+				u32 batch_timeout)
 {
 	struct wiphy *wiphy = wdev->wiphy;
 	struct cfg80211_registered_device *rdev = wiphy_to_dev(wiphy);
@@ -658,6 +737,11 @@ int cfg80211_mlme_register_mgmt(struct wireless_dev *wdev, u32 snd_pid,
 	nreg->match_len = match_len;
 	nreg->nlpid = snd_pid;
 	nreg->frame_type = cpu_to_le16(frame_type);
+	nreg->wdev = wdev;
+	nreg->batch_size = batch_size;
+	nreg->batch_timeout = max(1UL, msecs_to_jiffies(batch_timeout));
+	setup_timer(&nreg->batch_timer, cfg80211_mgmt_batch_timer,
+		    (unsigned long)nreg);
 	list_add(&nreg->list, &wdev->mgmt_registrations);
 
 	if (rdev->ops->mgmt_frame_register)
@@ -675,6 +759,7 @@ void cfg80211_mlme_unregister_socket(struct wireless_dev *wdev, u32 nlpid)
 	struct wiphy *wiphy = wdev->wiphy;
 	struct cfg80211_registered_device *rdev = wiphy_to_dev(wiphy);
 	struct cfg80211_mgmt_registration *reg, *tmp;
+	LIST_HEAD(unregistered);
 
 	spin_lock_bh(&wdev->mgmt_registrations_lock);
 
@@ -689,12 +774,15 @@ void cfg80211_mlme_unregister_socket(struct wireless_dev *wdev, u32 nlpid)
 						       frame_type, false);
 		}
 
-		list_del(&reg->list);
-		kfree(reg);
+		list_move(&reg->list, &unregistered);
 	}
 
 	spin_unlock_bh(&wdev->mgmt_registrations_lock);
 
+	/* the batch timer takes the lock, so stop it outside of it */
+	list_for_each_entry_safe(reg, tmp, &unregistered, list)
+		cfg80211_mgmt_reg_free(reg);
+
 	if (nlpid == wdev->ap_unexpected_nlpid)
 		wdev->ap_unexpected_nlpid = 0;
 }
@@ -702,15 +790,14 @@ void cfg80211_mlme_unregister_socket(struct wireless_dev *wdev, u32 nlpid)
 void cfg80211_mlme_purge_registrations(struct wireless_dev *wdev)
 {
 	struct cfg80211_mgmt_registration *reg, *tmp;
+	LIST_HEAD(unregistered);
 
 	spin_lock_bh(&wdev->mgmt_registrations_lock);
-
-	list_for_each_entry_safe(reg, tmp, &wdev->mgmt_registrations, list) {
-		list_del(&reg->list);
-		kfree(reg);
-	}
-
+	list_splice_init(&wdev->mgmt_registrations, &unregistered);
 	spin_unlock_bh(&wdev->mgmt_registrations_lock);
+
+	list_for_each_entry_safe(reg, tmp, &unregistered, list)
+		cfg80211_mgmt_reg_free(reg);
 }
 
 int cfg80211_mlme_mgmt_tx(struct cfg80211_registered_device *rdev,
@@ -853,6 +940,15 @@ bool cfg80211_rx_mgmt(struct net_device *dev, int freq, int sig_mbm,
 
 		/* found match! */
 
+		if (reg->batch_size > 1) {
+			if (cfg80211_mgmt_batch_queue(reg, dev, freq, sig_mbm,
+						      buf, len, gfp))
+				continue;
+
+			result = true;
+			break;
+		}
+
 		/* Indicate the received Action frame to user space */
 		if (nl80211_send_mgmt(rdev, dev, reg->nlpid,
 				      freq, sig_mbm,
@@ -206,6 +206,11 @@ static const struct nla_policy nl80211_policy[NL80211_ATTR_MAX+1] = {
 	[NL80211_ATTR_NOACK_MAP] = { .type = NLA_U16 },
 	[NL80211_ATTR_INACTIVITY_TIMEOUT] = { .type = NLA_U16 },
 	[NL80211_ATTR_BG_SCAN_PERIOD] = { .type = NLA_U16 },
+	[NL80211_ATTR_SCAN_SINCE_GENERATION] = { .type = NLA_U32 },
+	[NL80211_ATTR_SCAN_OMIT_IES] = { .type = NLA_FLAG },
+	[NL80211_ATTR_FRAME_BATCH_SIZE] = { .type = NLA_U32 },
+	[NL80211_ATTR_FRAME_BATCH_TIMEOUT] = { .type = NLA_U32 },
+	[NL80211_ATTR_STA_RATE_STATS] = { .type = NLA_FLAG },
 };
 
 /* policy for the key attributes */
@@ -2469,6 +2474,15 @@ static int nl80211_send_station(struct sk_buff *msg, u32 pid, u32 seq,
 	if (sinfo->filled & STATION_INFO_BEACON_LOSS_COUNT)
 		NLA_PUT_U32(msg, NL80211_STA_INFO_BEACON_LOSS,
 			    sinfo->beacon_loss_count);
+	if (sinfo->filled & STATION_INFO_TX_AIRTIME)
+		NLA_PUT_U64(msg, NL80211_STA_INFO_TX_AIRTIME,
+			    sinfo->tx_airtime);
+	if (sinfo->filled & STATION_INFO_TX_QUEUE_DELAY)
+		NLA_PUT_U32(msg, NL80211_STA_INFO_TX_QUEUE_DELAY,
+			    sinfo->tx_queue_delay);
+	if (sinfo->filled & STATION_INFO_RATE_STATS)
+		NLA_PUT(msg, NL80211_STA_INFO_RATE_STATS,
+			sinfo->rate_stats_len, sinfo->rate_stats);
 	if (sinfo->filled & STATION_INFO_BSS_PARAM) {
 		bss_param = nla_nest_start(msg, NL80211_STA_INFO_BSS_PARAM);
 		if (!bss_param)
@@ -2505,6 +2519,12 @@ static int nl80211_send_station(struct sk_buff *msg, u32 pid, u32 seq,
 	return -EMSGSIZE;
 }
 
+/*
+ * Room for the rate control statistics of one station; small enough
+ * that a station still fits into a single dump message.
+ */
+#define NL80211_RATE_STATS_BUFSIZE	2048
+
 static int nl80211_dump_station(struct sk_buff *skb,
 				struct netlink_callback *cb)
 {
@@ -2513,19 +2533,37 @@ static int nl80211_dump_station(struct sk_buff *skb,
 	struct net_device *netdev;
 	u8 mac_addr[ETH_ALEN];
 	int sta_idx = cb->args[1];
+	bool first = !cb->args[0];
+	void *rate_stats = NULL;
 	int err;
 
 	err = nl80211_prepare_netdev_dump(skb, cb, &dev, &netdev);
 	if (err)
 		return err;
 
+	/* the attributes were parsed by nl80211_get_ifidx() */
+	if (first && nl80211_fam.attrbuf[NL80211_ATTR_STA_RATE_STATS])
+		cb->args[2] = 1;
+
 	if (!dev->ops->dump_station) {
 		err = -EOPNOTSUPP;
 		goto out_err;
 	}
 
+	if (cb->args[2]) {
+		rate_stats = kmalloc(NL80211_RATE_STATS_BUFSIZE, GFP_KERNEL);
+		if (!rate_stats) {
+			err = -ENOMEM;
+			goto out_err;
+		}
+	}
+
 	while (1) {
 		memset(&sinfo, 0, sizeof(sinfo));
+		if (rate_stats) {
+			sinfo.rate_stats = rate_stats;
+			sinfo.rate_stats_len = NL80211_RATE_STATS_BUFSIZE;
+		}
 		err = dev->ops->dump_station(&dev->wiphy, netdev, sta_idx,
 					     mac_addr, &sinfo);
 		if (err == -ENOENT)
@@ -2548,6 +2586,7 @@ static int nl80211_dump_station(struct sk_buff *skb,
 	cb->args[1] = sta_idx;
 	err = skb->len;
  out_err:
+	kfree(rate_stats);
 	nl80211_finish_netdev_dump(dev);
 
 	return err;
@@ -2572,21 +2611,35 @@ static int nl80211_get_station(struct sk_buff *skb, struct genl_info *info)
 	if (!rdev->ops->get_station)
 		return -EOPNOTSUPP;
 
+	if (info->attrs[NL80211_ATTR_STA_RATE_STATS]) {
+		sinfo.rate_stats = kmalloc(NL80211_RATE_STATS_BUFSIZE,
+					   GFP_KERNEL);
+		if (!sinfo.rate_stats)
+			return -ENOMEM;
+		sinfo.rate_stats_len = NL80211_RATE_STATS_BUFSIZE;
+	}
+
 	err = rdev->ops->get_station(&rdev->wiphy, dev, mac_addr, &sinfo);
 	if (err)
-		return err;
+		goto out;
 
 	msg = nlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
-	if (!msg)
-		return -ENOMEM;
+	if (!msg) {
+		err = -ENOMEM;
+		goto out;
+	}
 
 	if (nl80211_send_station(msg, info->snd_pid, info->snd_seq, 0,
 				 rdev, dev, mac_addr, &sinfo) < 0) {
 		nlmsg_free(msg);
-		return -ENOBUFS;
+		err = -ENOBUFS;
+		goto out;
 	}
 
-	return genlmsg_reply(msg, info);
+	err = genlmsg_reply(msg, info);
+ out:
+	kfree(sinfo.rate_stats);
+	return err;
 }
 
 /*
@@ -4131,12 +4184,17 @@ static int nl80211_stop_sched_scan(struct sk_buff *skb,
 	return err;
 }
 
+/* cb->args[3] flags for nl80211_dump_scan() */
+#define NL80211_SCAN_DUMP_SINCE		BIT(0)
+#define NL80211_SCAN_DUMP_OMIT_IES	BIT(1)
+
 static int nl80211_send_bss(struct sk_buff *msg, struct netlink_callback *cb,
 			    u32 seq, int flags,
 			    struct cfg80211_registered_device *rdev,
 			    struct wireless_dev *wdev,
 			    struct cfg80211_internal_bss *intbss)
 {
+	unsigned long dump_flags = cb->args[3];
 	struct cfg80211_bss *res = &intbss->pub;
 	void *hdr;
 	struct nlattr *bss;
@@ -4152,12 +4210,17 @@ static int nl80211_send_bss(struct sk_buff *msg, struct netlink_callback *cb,
 
 	NLA_PUT_U32(msg, NL80211_ATTR_GENERATION, rdev->bss_generation);
 	NLA_PUT_U32(msg, NL80211_ATTR_IFINDEX, wdev->netdev->ifindex);
+	if (dump_flags & NL80211_SCAN_DUMP_SINCE)
+		NLA_PUT_U32(msg, NL80211_ATTR_SCAN_SINCE_GENERATION,
+			    (u32)cb->args[2]);
 
 	bss = nla_nest_start(msg, NL80211_ATTR_BSS);
 	if (!bss)
 		goto nla_put_failure;
 	if (!is_zero_ether_addr(res->bssid))
 		NLA_PUT(msg, NL80211_BSS_BSSID, ETH_ALEN, res->bssid);
+	if (dump_flags & NL80211_SCAN_DUMP_OMIT_IES)
+		goto skip_ies;
 	if (res->information_elements && res->len_information_elements)
 		NLA_PUT(msg, NL80211_BSS_INFORMATION_ELEMENTS,
 			res->len_information_elements,
@@ -4166,6 +4229,7 @@ static int nl80211_send_bss(struct sk_buff *msg, struct netlink_callback *cb,
 	    res->beacon_ies != res->information_elements)
 		NLA_PUT(msg, NL80211_BSS_BEACON_IES,
 			res->len_beacon_ies, res->beacon_ies);
+ skip_ies:
 	if (res->tsf)
 		NLA_PUT_U64(msg, NL80211_BSS_TSF, res->tsf);
 	if (res->beacon_interval)
@@ -4219,12 +4283,27 @@ static int nl80211_dump_scan(struct sk_buff *skb,
 	struct cfg80211_internal_bss *scan;
 	struct wireless_dev *wdev;
 	int start = cb->args[1], idx = 0;
+	bool first = !cb->args[0];
+	u32 since;
 	int err;
 
 	err = nl80211_prepare_netdev_dump(skb, cb, &rdev, &dev);
 	if (err)
 		return err;
 
+	/* the attributes were parsed by nl80211_get_ifidx() */
+	if (first) {
+		struct nlattr **attrbuf = nl80211_fam.attrbuf;
+
+		if (attrbuf[NL80211_ATTR_SCAN_SINCE_GENERATION]) {
+			cb->args[2] = nla_get_u32(
+				attrbuf[NL80211_ATTR_SCAN_SINCE_GENERATION]);
+			cb->args[3] |= NL80211_SCAN_DUMP_SINCE;
+		}
+		if (attrbuf[NL80211_ATTR_SCAN_OMIT_IES])
+			cb->args[3] |= NL80211_SCAN_DUMP_OMIT_IES;
+	}
+
 	wdev = dev->ieee80211_ptr;
 
 	wdev_lock(wdev);
@@ -4235,9 +4314,22 @@ static int nl80211_dump_scan(struct sk_buff *skb,
 	cb->seq = rdev->bss_generation;
 #endif
 
+	/*
+	 * A partial dump cannot express removals, so if anything was
+	 * unlinked after the generation userspace knows about, fall
+	 * back to dumping everything.
+	 */
+	since = cb->args[2];
+	if (first && (cb->args[3] & NL80211_SCAN_DUMP_SINCE) &&
+	    (s32)(rdev->bss_unlink_generation - since) > 0)
+		cb->args[3] &= ~NL80211_SCAN_DUMP_SINCE;
+
 	list_for_each_entry(scan, &rdev->bss_list, list) {
 		if (++idx <= start)
 			continue;
+		if ((cb->args[3] & NL80211_SCAN_DUMP_SINCE) &&
+		    (s32)(scan->generation - since) <= 0)
+			continue;
 		if (nl80211_send_bss(skb, cb,
 				cb->nlh->nlmsg_seq, NLM_F_MULTI,
 				rdev, wdev, scan) < 0) {
@@ -5583,6 +5675,8 @@ static int nl80211_register_mgmt(struct sk_buff *skb, struct genl_info *info)
 	struct cfg80211_registered_device *rdev = info->user_ptr[0];
 	struct net_device *dev = info->user_ptr[1];
 	u16 frame_type = IEEE80211_FTYPE_MGMT | IEEE80211_STYPE_ACTION;
+	u32 batch_size = 1;
+	u32 batch_timeout = NL80211_DEFAULT_FRAME_BATCH_TIMEOUT;
 
 	if (!info->attrs[NL80211_ATTR_FRAME_MATCH])
 		return -EINVAL;
@@ -5603,10 +5697,23 @@ static int nl80211_register_mgmt(struct sk_buff *skb, struct genl_info *info)
 	if (!rdev->ops->mgmt_tx)
 		return -EOPNOTSUPP;
 
+	if (info->attrs[NL80211_ATTR_FRAME_BATCH_SIZE])
+		batch_size =
+			nla_get_u32(info->attrs[NL80211_ATTR_FRAME_BATCH_SIZE]);
+
+	if (info->attrs[NL80211_ATTR_FRAME_BATCH_TIMEOUT])
+		batch_timeout = nla_get_u32(
+			info->attrs[NL80211_ATTR_FRAME_BATCH_TIMEOUT]);
+
+	if (batch_size > NL80211_MAX_FRAME_BATCH_SIZE ||
+	    batch_timeout > NL80211_MAX_FRAME_BATCH_TIMEOUT)
+		return -EINVAL;
+
 	return cfg80211_mlme_register_mgmt(dev->ieee80211_ptr, info->snd_pid,
 			frame_type,
 			nla_data(info->attrs[NL80211_ATTR_FRAME_MATCH]),
-			nla_len(info->attrs[NL80211_ATTR_FRAME_MATCH]));
+			nla_len(info->attrs[NL80211_ATTR_FRAME_MATCH]),
+			batch_size, batch_timeout);
 }
 
 static int nl80211_tx_mgmt(struct sk_buff *skb, struct genl_info *info)
@@ -7745,6 +7852,80 @@ int nl80211_send_mgmt(struct cfg80211_registered_device *rdev,
 	return -ENOBUFS;
 }
 
+int nl80211_mgmt_batch_start(struct nl80211_mgmt_batch *batch,
+			     struct cfg80211_registered_device *rdev,
+			     struct net_device *netdev, gfp_t gfp)
+{
+	batch->msg = nlmsg_new(NLMSG_GOODSIZE, gfp);
+	if (!batch->msg)
+		return -ENOMEM;
+
+	batch->hdr = nl80211hdr_put(batch->msg, 0, 0, 0,
+				    NL80211_CMD_FRAME_BATCH);
+	if (!batch->hdr)
+		goto nla_put_failure;
+
+	NLA_PUT_U32(batch->msg, NL80211_ATTR_WIPHY, rdev->wiphy_idx);
+	NLA_PUT_U32(batch->msg, NL80211_ATTR_IFINDEX, netdev->ifindex);
+
+	batch->frames = nla_nest_start(batch->msg, NL80211_ATTR_FRAME_BATCH);
+	if (!batch->frames)
+		goto nla_put_failure;
+
+	batch->count = 0;
+	return 0;
+
+ nla_put_failure:
+	nlmsg_free(batch->msg);
+	batch->msg = NULL;
+	return -ENOBUFS;
+}
+
+int nl80211_mgmt_batch_add(struct nl80211_mgmt_batch *batch,
+			   int freq, int sig_dbm, const u8 *buf, size_t len)
+{
+	struct sk_buff *msg = batch->msg;
+	struct nlattr *frame;
+
+	frame = nla_nest_start(msg, batch->count + 1);
+	if (!frame)
+		return -EMSGSIZE;
+
+	NLA_PUT_U32(msg, NL80211_ATTR_WIPHY_FREQ, freq);
+	if (sig_dbm)
+		NLA_PUT_U32(msg, NL80211_ATTR_RX_SIGNAL_DBM, sig_dbm);
+	NLA_PUT(msg, NL80211_ATTR_FRAME, len, buf);
+
+	nla_nest_end(msg, frame);
+	batch->count++;
+	return 0;
+
+ nla_put_failure:
+	nla_nest_cancel(msg, frame);
+	return -EMSGSIZE;
+}
+
+int nl80211_mgmt_batch_send(struct nl80211_mgmt_batch *batch,
+			    struct cfg80211_registered_device *rdev,
+			    u32 nlpid, u32 dropped)
+{
+	struct sk_buff *msg = batch->msg;
+
+	batch->msg = NULL;
+
+	nla_nest_end(msg, batch->frames);
+	NLA_PUT_U32(msg, NL80211_ATTR_FRAME_BATCH_DROPPED, dropped);
+
+	genlmsg_end(msg, batch->hdr);
+
+	return genlmsg_unicast(wiphy_net(&rdev->wiphy), msg, nlpid);
+
+ nla_put_failure:
+	genlmsg_cancel(msg, batch->hdr);
+	nlmsg_free(msg);
+	return -ENOBUFS;
+}
+
 void nl80211_send_mgmt_tx_status(struct cfg80211_registered_device *rdev,
 				 struct net_device *netdev, u64 cookie,
 				 const u8 *buf, size_t len, bool ack,
@@ -95,6 +95,34 @@ int nl80211_send_mgmt(struct cfg80211_registered_device *rdev,
 		      struct net_device *netdev, u32 nlpid,
 		      int freq, int sig_dbm,
 		      const u8 *buf, size_t len, gfp_t gfp);
+
+/* limits for batched management frame registrations */
+#define NL80211_MAX_FRAME_BATCH_SIZE		64
+#define NL80211_DEFAULT_FRAME_BATCH_TIMEOUT	5
+#define NL80211_MAX_FRAME_BATCH_TIMEOUT		100
+
+/**
+ * struct nl80211_mgmt_batch - a %NL80211_CMD_FRAME_BATCH message being built
+ * @msg: the message, %NULL if no batch is pending
+ * @hdr: genetlink header of @msg
+ * @frames: the %NL80211_ATTR_FRAME_BATCH nest in @msg
+ * @count: number of frames added so far
+ */
+struct nl80211_mgmt_batch {
+	struct sk_buff *msg;
+	void *hdr;
+	struct nlattr *frames;
+	unsigned int count;
+};
+
+int nl80211_mgmt_batch_start(struct nl80211_mgmt_batch *batch,
+			     struct cfg80211_registered_device *rdev,
+			     struct net_device *netdev, gfp_t gfp);
+int nl80211_mgmt_batch_add(struct nl80211_mgmt_batch *batch,
+			   int freq, int sig_dbm, const u8 *buf, size_t len);
+int nl80211_mgmt_batch_send(struct nl80211_mgmt_batch *batch,
+			    struct cfg80211_registered_device *rdev,
+			    u32 nlpid, u32 dropped);
 void nl80211_send_mgmt_tx_status(struct cfg80211_registered_device *rdev,
 				 struct net_device *netdev, u64 cookie,
 				 const u8 *buf, size_t len, bool ack,
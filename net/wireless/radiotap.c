@@ -16,6 +16,9 @@
 
 #include <linux/kernel.h>
 #include <linux/export.h>
+#include <linux/hash.h>
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
 #include <net/cfg80211.h>
 #include <net/ieee80211_radiotap.h>
 #include <asm/unaligned.h>
@@ -51,6 +54,25 @@ static const struct ieee80211_radiotap_namespace radiotap_ns = {
 	.align_size = rtap_namespace_sizes,
 };
 
+/*
+ * Cache of field offsets for the present bitmaps seen recently, see
+ * ieee80211_radiotap_get_layout(). Writers are serialized by the lock,
+ * readers only check the sequence count.
+ */
+#define RTAP_LAYOUT_CACHE_BITS	4
+
+struct rtap_layout_cache_entry {
+	seqcount_t seq;
+	bool valid;
+	u32 present;
+	int end;
+	u8 offset[IEEE80211_RADIOTAP_LAYOUT_FIELDS];
+};
+
+static struct rtap_layout_cache_entry
+rtap_layout_cache[1 << RTAP_LAYOUT_CACHE_BITS];
+static DEFINE_SPINLOCK(rtap_layout_lock);
+
 /**
  * ieee80211_radiotap_iterator_init - radiotap parser iterator initialization
  * @iterator: radiotap_iterator to initialize
@@ -356,3 +378,101 @@ int ieee80211_radiotap_iterator_next(
 	}
 }
 EXPORT_SYMBOL(ieee80211_radiotap_iterator_next);
+
+static int rtap_compute_layout(u32 present, u8 *offset)
+{
+	int arg = sizeof(struct ieee80211_radiotap_header);
+	int i, align;
+
+	for (i = 0; i < IEEE80211_RADIOTAP_LAYOUT_FIELDS; i++) {
+		if (!(present & BIT(i)))
+			continue;
+
+		/* alignment is relative to the start of the header */
+		align = rtap_namespace_sizes[i].align;
+		arg = ALIGN(arg, align);
+		offset[i] = arg;
+		arg += rtap_namespace_sizes[i].size;
+	}
+
+	return arg;
+}
+
+/**
+ * ieee80211_radiotap_get_layout - look up radiotap field offsets
+ * @radiotap_header: radiotap header to parse
+ * @max_length: total length we can parse into (eg, whole packet length)
+ * @layout: filled with the header length and the field offsets
+ *
+ * Returns: 0 on success, -EINVAL if the header is invalid, or
+ * -EOPNOTSUPP if the header uses extended bitmaps, namespaces or fields
+ * not in &struct ieee80211_radiotap_layout, in which case the caller has
+ * to fall back to ieee80211_radiotap_iterator_init() and friends.
+ *
+ * This is a faster alternative to iterating over the header for the
+ * common case of a single present bitmap word: the offsets only depend
+ * on that word, so they are computed once and then served from a small
+ * cache. Offsets are relative to the start of the header; as with the
+ * iterator, multibyte fields must be read with get_unaligned().
+ *
+ * Must not be called from hard interrupt context.
+ */
+int ieee80211_radiotap_get_layout(
+	struct ieee80211_radiotap_header *radiotap_header,
+	int max_length, struct ieee80211_radiotap_layout *layout)
+{
+	struct rtap_layout_cache_entry *e;
+	unsigned int seq;
+	bool hit;
+	u32 present;
+	int end;
+
+	BUILD_BUG_ON(ARRAY_SIZE(rtap_namespace_sizes) !=
+		     IEEE80211_RADIOTAP_LAYOUT_FIELDS);
+
+	/* Linux only supports version 0 radiotap format */
+	if (radiotap_header->it_version)
+		return -EINVAL;
+
+	layout->len = get_unaligned_le16(&radiotap_header->it_len);
+	if (max_length < layout->len)
+		return -EINVAL;
+
+	present = get_unaligned_le32(&radiotap_header->it_present);
+	if (present & ~(BIT(IEEE80211_RADIOTAP_LAYOUT_FIELDS) - 1))
+		return -EOPNOTSUPP;
+
+	layout->present = present;
+
+	e = &rtap_layout_cache[hash_32(present, RTAP_LAYOUT_CACHE_BITS)];
+
+	do {
+		seq = read_seqcount_begin(&e->seq);
+		hit = e->valid && e->present == present;
+		if (hit) {
+			end = e->end;
+			memcpy(layout->offset, e->offset,
+			       sizeof(layout->offset));
+		}
+	} while (read_seqcount_retry(&e->seq, seq));
+
+	if (!hit) {
+		end = rtap_compute_layout(present, layout->offset);
+
+		spin_lock_bh(&rtap_layout_lock);
+		write_seqcount_begin(&e->seq);
+		e->valid = true;
+		e->present = present;
+		e->end = end;
+		memcpy(e->offset, layout->offset, sizeof(e->offset));
+		write_seqcount_end(&e->seq);
+		spin_unlock_bh(&rtap_layout_lock);
+	}
+
+	/* the fields must not extend beyond the stated header length */
+	if (end > layout->len)
+		return -EINVAL;
+
+	return 0;
+}
+EXPORT_SYMBOL(ieee80211_radiotap_get_layout);
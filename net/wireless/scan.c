@@ -168,6 +168,9 @@ static void bss_release(struct kref *ref)
 		kfree(bss->pub.beacon_ies);
 	if (bss->proberesp_ies_allocated)
 		kfree(bss->pub.proberesp_ies);
+#ifdef CONFIG_CFG80211_WEXT
+	kfree(bss->wext_ies);
+#endif
 
 	BUG_ON(atomic_read(&bss->hold));
 
@@ -210,8 +213,10 @@ void cfg80211_bss_expire(struct cfg80211_registered_device *dev)
 		expired = true;
 	}
 
-	if (expired)
+	if (expired) {
 		dev->bss_generation++;
+		dev->bss_unlink_generation = dev->bss_generation;
+	}
 }
 
 const u8 *cfg80211_find_ie(u8 eid, const u8 *ies, int len)
@@ -600,6 +605,17 @@ copy_hidden_ies(struct cfg80211_internal_bss *res,
 			res->pub.len_beacon_ies);
 }
 
+#ifdef CONFIG_CFG80211_WEXT
+/* must hold dev->bss_lock! */
+static void cfg80211_bss_wext_invalidate(struct cfg80211_internal_bss *bss)
+{
+	kfree(bss->wext_ies);
+	bss->wext_ies = NULL;
+	bss->wext_ies_len = 0;
+	bss->wext_genie_len = 0;
+}
+#endif
+
 static struct cfg80211_internal_bss *
 cfg80211_bss_update(struct cfg80211_registered_device *dev,
 		    struct cfg80211_internal_bss *res)
@@ -627,6 +643,9 @@ cfg80211_bss_update(struct cfg80211_registered_device *dev,
 		found->pub.signal = res->pub.signal;
 		found->pub.capability = res->pub.capability;
 		found->ts = res->ts;
+#ifdef CONFIG_CFG80211_WEXT
+		cfg80211_bss_wext_invalidate(found);
+#endif
 
 		/* Update IEs */
 		if (res->pub.proberesp_ies) {
@@ -735,6 +754,7 @@ cfg80211_bss_update(struct cfg80211_registered_device *dev,
 	}
 
 	dev->bss_generation++;
+	found->generation = dev->bss_generation;
 	spin_unlock_bh(&dev->bss_lock);
 
 	kref_get(&found->ref);
@@ -908,6 +928,7 @@ void cfg80211_unlink_bss(struct wiphy *wiphy, struct cfg80211_bss *pub)
 	if (!list_empty(&bss->list)) {
 		__cfg80211_unlink_bss(dev, bss);
 		dev->bss_generation++;
+		dev->bss_unlink_generation = dev->bss_generation;
 	}
 	spin_unlock_bh(&dev->bss_lock);
 }
@@ -1098,78 +1119,82 @@ static inline unsigned int elapsed_jiffies_msecs(unsigned long start)
 	return jiffies_to_msecs(end + (MAX_JIFFY_OFFSET - start) + 1);
 }
 
-static char *
-ieee80211_bss(struct wiphy *wiphy, struct iw_request_info *info,
-	      struct cfg80211_internal_bss *bss, char *current_ev,
-	      char *end_buf)
+/* widest " Last beacon: %ums ago" string ieee80211_bss() can generate */
+#define IEEE80211_BSS_WEXT_AGE_MAX	(sizeof(" Last beacon: 4294967295ms ago") - 1)
+
+/*
+ * Length of the events ieee80211_bss() generates around the cached
+ * IE-derived part: AP address, two frequencies, quality, encoding and
+ * the two custom strings. Only the age of the last beacon can't be
+ * known exactly in advance, as time passes until the events are
+ * generated, so its widest form is assumed.
+ */
+static size_t ieee80211_bss_wext_dyn_len(struct wiphy *wiphy,
+					 struct iw_request_info *info,
+					 struct cfg80211_internal_bss *bss)
 {
-	struct iw_event iwe;
-	u8 *buf, *cfg, *p;
-	u8 *ie = bss->pub.information_elements;
-	int rem = bss->pub.len_information_elements, i, sig;
-	bool ismesh = false;
+	char buf[32];
+	size_t len;
 
-	memset(&iwe, 0, sizeof(iwe));
-	iwe.cmd = SIOCGIWAP;
-	iwe.u.ap_addr.sa_family = ARPHRD_ETHER;
-	memcpy(iwe.u.ap_addr.sa_data, bss->pub.bssid, ETH_ALEN);
-	current_ev = iwe_stream_add_event(info, current_ev, end_buf, &iwe,
-					  IW_EV_ADDR_LEN);
+	len = iwe_stream_event_len_adjust(info, IW_EV_ADDR_LEN) +
+	      2 * iwe_stream_event_len_adjust(info, IW_EV_FREQ_LEN);
+	if (wiphy->signal_type != CFG80211_SIGNAL_TYPE_NONE)
+		len += iwe_stream_event_len_adjust(info, IW_EV_QUAL_LEN);
 
-	memset(&iwe, 0, sizeof(iwe));
-	iwe.cmd = SIOCGIWFREQ;
-	iwe.u.freq.m = ieee80211_frequency_to_channel(bss->pub.channel->center_freq);
-	iwe.u.freq.e = 0;
-	current_ev = iwe_stream_add_event(info, current_ev, end_buf, &iwe,
-					  IW_EV_FREQ_LEN);
+	/* encoding, TSF and age */
+	len += 3 * iwe_stream_point_len(info);
+	len += scnprintf(buf, sizeof(buf), "tsf=%016llx",
+			 (unsigned long long)(bss->pub.tsf));
+	len += IEEE80211_BSS_WEXT_AGE_MAX;
 
-	memset(&iwe, 0, sizeof(iwe));
-	iwe.cmd = SIOCGIWFREQ;
-	iwe.u.freq.m = bss->pub.channel->center_freq;
-	iwe.u.freq.e = 6;
-	current_ev = iwe_stream_add_event(info, current_ev, end_buf, &iwe,
-					  IW_EV_FREQ_LEN);
+	return len;
+}
 
-	if (wiphy->signal_type != CFG80211_SIGNAL_TYPE_NONE) {
-		memset(&iwe, 0, sizeof(iwe));
-		iwe.cmd = IWEVQUAL;
-		iwe.u.qual.updated = IW_QUAL_LEVEL_UPDATED |
-				     IW_QUAL_NOISE_INVALID |
-				     IW_QUAL_QUAL_UPDATED;
-		switch (wiphy->signal_type) {
-		case CFG80211_SIGNAL_TYPE_MBM:
-			sig = bss->pub.signal / 100;
-			iwe.u.qual.level = sig;
-			iwe.u.qual.updated |= IW_QUAL_DBM;
-			if (sig < -110)		/* rather bad */
-				sig = -110;
-			else if (sig > -40)	/* perfect */
-				sig = -40;
-			/* will give a range of 0 .. 70 */
-			iwe.u.qual.qual = sig + 110;
+/* upper bound of what ieee80211_bss_ies() and ieee80211_scan_add_ies() add */
+static size_t ieee80211_bss_wext_ies_bound(struct cfg80211_internal_bss *bss)
+{
+	u8 *ie = bss->pub.information_elements;
+	int rem = bss->pub.len_information_elements;
+	size_t len = IW_EV_UINT_LEN;
+
+	/* generic IE events, see ieee80211_scan_add_ies() */
+	len += rem + (rem / 512 + 2) * IW_EV_POINT_LEN;
+
+	while (rem >= 2) {
+		if (ie[1] > rem - 2)
 			break;
-		case CFG80211_SIGNAL_TYPE_UNSPEC:
-			iwe.u.qual.level = bss->pub.signal;
-			/* will give range 0 .. 100 */
-			iwe.u.qual.qual = bss->pub.signal;
+
+		switch (ie[0]) {
+		case WLAN_EID_SSID:
+		case WLAN_EID_MESH_ID:
+			len += IW_EV_POINT_LEN + ie[1];
 			break;
-		default:
-			/* not reached */
+		case WLAN_EID_MESH_CONFIG:
+			len += 7 * (IW_EV_POINT_LEN + 50);
+			break;
+		case WLAN_EID_SUPP_RATES:
+		case WLAN_EID_EXT_SUPP_RATES:
+			len += IW_EV_LCP_LEN + ie[1] * IW_EV_PARAM_LEN;
 			break;
 		}
-		current_ev = iwe_stream_add_event(info, current_ev, end_buf,
-						  &iwe, IW_EV_QUAL_LEN);
+		rem -= ie[1] + 2;
+		ie += ie[1] + 2;
 	}
 
-	memset(&iwe, 0, sizeof(iwe));
-	iwe.cmd = SIOCGIWENCODE;
-	if (bss->pub.capability & WLAN_CAPABILITY_PRIVACY)
-		iwe.u.data.flags = IW_ENCODE_ENABLED | IW_ENCODE_NOKEY;
-	else
-		iwe.u.data.flags = IW_ENCODE_DISABLED;
-	iwe.u.data.length = 0;
-	current_ev = iwe_stream_add_point(info, current_ev, end_buf,
-					  &iwe, "");
+	return len;
+}
+
+static char *
+ieee80211_bss_ies(struct iw_request_info *info,
+		  struct cfg80211_internal_bss *bss, char *current_ev,
+		  char *end_buf)
+{
+	struct iw_event iwe;
+	char buf[50];
+	u8 *cfg, *p;
+	u8 *ie = bss->pub.information_elements;
+	int rem = bss->pub.len_information_elements, i;
+	bool ismesh = false;
 
 	while (rem >= 2) {
 		/* invalid data */
@@ -1197,51 +1222,45 @@ ieee80211_bss(struct wiphy *wiphy, struct iw_request_info *info,
 			ismesh = true;
 			if (ie[1] != sizeof(struct ieee80211_meshconf_ie))
 				break;
-			buf = kmalloc(50, GFP_ATOMIC);
-			if (!buf)
-				break;
 			cfg = ie + 2;
 			memset(&iwe, 0, sizeof(iwe));
 			iwe.cmd = IWEVCUSTOM;
-			sprintf(buf, "Mesh Network Path Selection Protocol ID: "
+			iwe.u.data.length = scnprintf(buf, sizeof(buf),
+				"Mesh Network Path Selection Protocol ID: "
 				"0x%02X", cfg[0]);
-			iwe.u.data.length = strlen(buf);
 			current_ev = iwe_stream_add_point(info, current_ev,
 							  end_buf,
 							  &iwe, buf);
-			sprintf(buf, "Path Selection Metric ID: 0x%02X",
-				cfg[1]);
-			iwe.u.data.length = strlen(buf);
+			iwe.u.data.length = scnprintf(buf, sizeof(buf),
+				"Path Selection Metric ID: 0x%02X", cfg[1]);
 			current_ev = iwe_stream_add_point(info, current_ev,
 							  end_buf,
 							  &iwe, buf);
-			sprintf(buf, "Congestion Control Mode ID: 0x%02X",
-				cfg[2]);
-			iwe.u.data.length = strlen(buf);
+			iwe.u.data.length = scnprintf(buf, sizeof(buf),
+				"Congestion Control Mode ID: 0x%02X", cfg[2]);
 			current_ev = iwe_stream_add_point(info, current_ev,
 							  end_buf,
 							  &iwe, buf);
-			sprintf(buf, "Synchronization ID: 0x%02X", cfg[3]);
-			iwe.u.data.length = strlen(buf);
+			iwe.u.data.length = scnprintf(buf, sizeof(buf),
+				"Synchronization ID: 0x%02X", cfg[3]);
 			current_ev = iwe_stream_add_point(info, current_ev,
 							  end_buf,
 							  &iwe, buf);
-			sprintf(buf, "Authentication ID: 0x%02X", cfg[4]);
-			iwe.u.data.length = strlen(buf);
+			iwe.u.data.length = scnprintf(buf, sizeof(buf),
+				"Authentication ID: 0x%02X", cfg[4]);
 			current_ev = iwe_stream_add_point(info, current_ev,
 							  end_buf,
 							  &iwe, buf);
-			sprintf(buf, "Formation Info: 0x%02X", cfg[5]);
-			iwe.u.data.length = strlen(buf);
+			iwe.u.data.length = scnprintf(buf, sizeof(buf),
+				"Formation Info: 0x%02X", cfg[5]);
 			current_ev = iwe_stream_add_point(info, current_ev,
 							  end_buf,
 							  &iwe, buf);
-			sprintf(buf, "Capabilities: 0x%02X", cfg[6]);
-			iwe.u.data.length = strlen(buf);
+			iwe.u.data.length = scnprintf(buf, sizeof(buf),
+				"Capabilities: 0x%02X", cfg[6]);
 			current_ev = iwe_stream_add_point(info, current_ev,
 							  end_buf,
 							  &iwe, buf);
-			kfree(buf);
 			break;
 		case WLAN_EID_SUPP_RATES:
 		case WLAN_EID_EXT_SUPP_RATES:
@@ -1280,25 +1299,149 @@ ieee80211_bss(struct wiphy *wiphy, struct iw_request_info *info,
 						  &iwe, IW_EV_UINT_LEN);
 	}
 
-	buf = kmalloc(30, GFP_ATOMIC);
-	if (buf) {
-		memset(&iwe, 0, sizeof(iwe));
-		iwe.cmd = IWEVCUSTOM;
-		sprintf(buf, "tsf=%016llx", (unsigned long long)(bss->pub.tsf));
-		iwe.u.data.length = strlen(buf);
-		current_ev = iwe_stream_add_point(info, current_ev, end_buf,
-						  &iwe, buf);
+	return current_ev;
+}
+
+/*
+ * Build, if needed, the cached events derived from the IEs and the
+ * capability field. Returns false if they couldn't be cached, in which
+ * case ieee80211_bss() generates them on the fly.
+ *
+ * must hold dev->bss_lock!
+ */
+static bool ieee80211_bss_wext_cache(struct iw_request_info *info,
+				     struct cfg80211_internal_bss *bss)
+{
+	bool compat = info->flags & IW_REQUEST_FLAG_COMPAT;
+	size_t bound = ieee80211_bss_wext_ies_bound(bss);
+	char *buf, *pos;
+
+	if (bss->wext_ies && bss->wext_ies_compat == compat)
+		return true;
+
+	cfg80211_bss_wext_invalidate(bss);
+
+	buf = kmalloc(bound, GFP_ATOMIC);
+	if (!buf)
+		return false;
+
+	/* the bound guarantees that nothing is truncated here */
+	pos = ieee80211_bss_ies(info, bss, buf, buf + bound);
+	bss->wext_ies_len = pos - buf;
+	ieee80211_scan_add_ies(info, &bss->pub, &pos, buf + bound);
+	bss->wext_genie_len = pos - buf - bss->wext_ies_len;
+
+	bss->wext_ies = kmemdup(buf, pos - buf, GFP_ATOMIC);
+	kfree(buf);
+	if (!bss->wext_ies) {
+		bss->wext_ies_len = 0;
+		bss->wext_genie_len = 0;
+		return false;
+	}
+
+	bss->wext_ies_compat = compat;
+	return true;
+}
+
+static char *
+ieee80211_bss(struct wiphy *wiphy, struct iw_request_info *info,
+	      struct cfg80211_internal_bss *bss, char *current_ev,
+	      char *end_buf)
+{
+	struct iw_event iwe;
+	char buf[32];
+	int sig;
+
+	memset(&iwe, 0, sizeof(iwe));
+	iwe.cmd = SIOCGIWAP;
+	iwe.u.ap_addr.sa_family = ARPHRD_ETHER;
+	memcpy(iwe.u.ap_addr.sa_data, bss->pub.bssid, ETH_ALEN);
+	current_ev = iwe_stream_add_event(info, current_ev, end_buf, &iwe,
+					  IW_EV_ADDR_LEN);
+
+	memset(&iwe, 0, sizeof(iwe));
+	iwe.cmd = SIOCGIWFREQ;
+	iwe.u.freq.m = ieee80211_frequency_to_channel(bss->pub.channel->center_freq);
+	iwe.u.freq.e = 0;
+	current_ev = iwe_stream_add_event(info, current_ev, end_buf, &iwe,
+					  IW_EV_FREQ_LEN);
+
+	memset(&iwe, 0, sizeof(iwe));
+	iwe.cmd = SIOCGIWFREQ;
+	iwe.u.freq.m = bss->pub.channel->center_freq;
+	iwe.u.freq.e = 6;
+	current_ev = iwe_stream_add_event(info, current_ev, end_buf, &iwe,
+					  IW_EV_FREQ_LEN);
+
+	if (wiphy->signal_type != CFG80211_SIGNAL_TYPE_NONE) {
 		memset(&iwe, 0, sizeof(iwe));
-		iwe.cmd = IWEVCUSTOM;
-		sprintf(buf, " Last beacon: %ums ago",
-			elapsed_jiffies_msecs(bss->ts));
-		iwe.u.data.length = strlen(buf);
-		current_ev = iwe_stream_add_point(info, current_ev,
-						  end_buf, &iwe, buf);
-		kfree(buf);
+		iwe.cmd = IWEVQUAL;
+		iwe.u.qual.updated = IW_QUAL_LEVEL_UPDATED |
+				     IW_QUAL_NOISE_INVALID |
+				     IW_QUAL_QUAL_UPDATED;
+		switch (wiphy->signal_type) {
+		case CFG80211_SIGNAL_TYPE_MBM:
+			sig = bss->pub.signal / 100;
+			iwe.u.qual.level = sig;
+			iwe.u.qual.updated |= IW_QUAL_DBM;
+			if (sig < -110)		/* rather bad */
+				sig = -110;
+			else if (sig > -40)	/* perfect */
+				sig = -40;
+			/* will give a range of 0 .. 70 */
+			iwe.u.qual.qual = sig + 110;
+			break;
+		case CFG80211_SIGNAL_TYPE_UNSPEC:
+			iwe.u.qual.level = bss->pub.signal;
+			/* will give range 0 .. 100 */
+			iwe.u.qual.qual = bss->pub.signal;
+			break;
+		default:
+			/* not reached */
+			break;
+		}
+		current_ev = iwe_stream_add_event(info, current_ev, end_buf,
+						  &iwe, IW_EV_QUAL_LEN);
+	}
+
+	memset(&iwe, 0, sizeof(iwe));
+	iwe.cmd = SIOCGIWENCODE;
+	if (bss->pub.capability & WLAN_CAPABILITY_PRIVACY)
+		iwe.u.data.flags = IW_ENCODE_ENABLED | IW_ENCODE_NOKEY;
+	else
+		iwe.u.data.flags = IW_ENCODE_DISABLED;
+	iwe.u.data.length = 0;
+	current_ev = iwe_stream_add_point(info, current_ev, end_buf,
+					  &iwe, "");
+
+	if (bss->wext_ies) {
+		memcpy(current_ev, bss->wext_ies, bss->wext_ies_len);
+		current_ev += bss->wext_ies_len;
+	} else {
+		current_ev = ieee80211_bss_ies(info, bss, current_ev, end_buf);
 	}
 
-	ieee80211_scan_add_ies(info, &bss->pub, &current_ev, end_buf);
+	memset(&iwe, 0, sizeof(iwe));
+	iwe.cmd = IWEVCUSTOM;
+	iwe.u.data.length = scnprintf(buf, sizeof(buf), "tsf=%016llx",
+				     (unsigned long long)(bss->pub.tsf));
+	current_ev = iwe_stream_add_point(info, current_ev, end_buf,
+					  &iwe, buf);
+	memset(&iwe, 0, sizeof(iwe));
+	iwe.cmd = IWEVCUSTOM;
+	iwe.u.data.length = scnprintf(buf, sizeof(buf),
+				     " Last beacon: %ums ago",
+				     elapsed_jiffies_msecs(bss->ts));
+	current_ev = iwe_stream_add_point(info, current_ev,
+					  end_buf, &iwe, buf);
+
+	if (bss->wext_ies) {
+		memcpy(current_ev, bss->wext_ies + bss->wext_ies_len,
+		       bss->wext_genie_len);
+		current_ev += bss->wext_genie_len;
+	} else {
+		ieee80211_scan_add_ies(info, &bss->pub, &current_ev, end_buf);
+	}
 
 	return current_ev;
 }
@@ -1311,18 +1454,35 @@ static int ieee80211_scan_results(struct cfg80211_registered_device *dev,
 	char *current_ev = buf;
 	char *end_buf = buf + len;
 	struct cfg80211_internal_bss *bss;
+	size_t needed = 0;
 
 	spin_lock_bh(&dev->bss_lock);
 	cfg80211_bss_expire(dev);
 
+	/*
+	 * Size everything up front so that a too small buffer is
+	 * reported before any of the results are generated. This is
+	 * exact but for the beacon age, and for the IE-derived events
+	 * of a BSS whose cache couldn't be allocated; those are bounded
+	 * from the IEs and, as that is only the case under memory
+	 * pressure, a slightly early E2BIG doesn't matter.
+	 */
 	list_for_each_entry(bss, &dev->bss_list, list) {
-		if (buf + len - current_ev <= IW_EV_ADDR_LEN) {
-			spin_unlock_bh(&dev->bss_lock);
-			return -E2BIG;
-		}
+		needed += ieee80211_bss_wext_dyn_len(&dev->wiphy, info, bss);
+		if (ieee80211_bss_wext_cache(info, bss))
+			needed += bss->wext_ies_len + bss->wext_genie_len;
+		else
+			needed += ieee80211_bss_wext_ies_bound(bss);
+	}
+
+	if (needed >= len) {
+		spin_unlock_bh(&dev->bss_lock);
+		return -E2BIG;
+	}
+
+	list_for_each_entry(bss, &dev->bss_list, list)
 		current_ev = ieee80211_bss(&dev->wiphy, info, bss,
 					   current_ev, end_buf);
-	}
 	spin_unlock_bh(&dev->bss_lock);
 	return current_ev - buf;
 }
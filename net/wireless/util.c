@@ -537,17 +537,133 @@ int ieee80211_data_from_8023(struct sk_buff *skb, const u8 *addr,
 EXPORT_SYMBOL(ieee80211_data_from_8023);
 
 
+static void __frame_add_frag(struct sk_buff *skb, const skb_frag_t *frag,
+			     int offset, int len)
+{
+	struct page *page = skb_frag_page(frag);
+
+	/* the whole fragment stays pinned, account for all of it */
+	get_page(page);
+	skb_add_rx_frag(skb, skb_shinfo(skb)->nr_frags, page,
+			frag->page_offset + offset, len, skb_frag_size(frag));
+}
+
+/*
+ * Attach @len bytes at @offset of @skb, which must all be in the paged
+ * part of @skb, to @frame by taking references to the pages.
+ */
+static void __ieee80211_amsdu_copy_frag(struct sk_buff *skb,
+					struct sk_buff *frame,
+					int offset, int len)
+{
+	const skb_frag_t *frag = &skb_shinfo(skb)->frags[0];
+	int cur_len;
+
+	offset -= skb_headlen(skb);
+
+	while (offset >= skb_frag_size(frag)) {
+		offset -= skb_frag_size(frag);
+		frag++;
+	}
+
+	while (len > 0) {
+		cur_len = min_t(int, len, skb_frag_size(frag) - offset);
+		__frame_add_frag(frame, frag, offset, cur_len);
+		len -= cur_len;
+		offset = 0;
+		frag++;
+	}
+}
+
+/*
+ * Attach @len bytes at @offset of the linear @skb to @frame through a
+ * clone sharing its data; returns false if no clone could be made.
+ */
+static bool __ieee80211_amsdu_clone_tail(struct sk_buff *skb,
+					 struct sk_buff *frame,
+					 int offset, int len)
+{
+	struct sk_buff *tail = skb_clone(skb, GFP_ATOMIC);
+
+	if (!tail)
+		return false;
+
+	skb_pull(tail, offset);
+	skb_trim(tail, len);
+
+	/* the clone keeps the whole shared buffer alive */
+	skb_shinfo(frame)->frag_list = tail;
+	frame->len += len;
+	frame->data_len += len;
+	frame->truesize += tail->truesize;
+	return true;
+}
+
+static struct sk_buff *
+__ieee80211_amsdu_copy(struct sk_buff *skb, unsigned int hlen,
+		       int offset, int len, bool reuse_frag)
+{
+	struct sk_buff *frame;
+	int cur_len = len;
+
+	/*
+	 * Only the start of the subframe, which gets its header rewritten,
+	 * is copied; the rest of the payload stays in the original buffer
+	 * and is shared, either as page fragments or through a clone.
+	 */
+	if (reuse_frag) {
+		if (offset + len > skb_headlen(skb))
+			cur_len = min(len, max_t(int, 32,
+					skb_headlen(skb) - offset));
+	} else if (!skb_is_nonlinear(skb)) {
+		cur_len = min(len, 32);
+	}
+
+	/*
+	 * Allocate and reserve two bytes more for payload
+	 * alignment since sizeof(struct ethhdr) is 14.
+	 */
+	frame = dev_alloc_skb(hlen + sizeof(struct ethhdr) + 2 + cur_len);
+	if (!frame)
+		return NULL;
+
+	skb_reserve(frame, hlen + sizeof(struct ethhdr) + 2);
+	skb_copy_bits(skb, offset, skb_put(frame, cur_len), cur_len);
+
+	len -= cur_len;
+	if (!len)
+		return frame;
+
+	offset += cur_len;
+
+	if (reuse_frag) {
+		__ieee80211_amsdu_copy_frag(skb, frame, offset, len);
+		return frame;
+	}
+
+	if (!__ieee80211_amsdu_clone_tail(skb, frame, offset, len)) {
+		dev_kfree_skb(frame);
+		return NULL;
+	}
+
+	return frame;
+}
+
 void ieee80211_amsdu_to_8023s(struct sk_buff *skb, struct sk_buff_head *list,
 			      const u8 *addr, enum nl80211_iftype iftype,
 			      const unsigned int extra_headroom,
 			      bool has_80211_header)
 {
+	unsigned int hlen = ALIGN(extra_headroom, 4);
 	struct sk_buff *frame = NULL;
 	u16 ethertype;
 	u8 *payload;
-	const struct ethhdr *eth;
-	int remaining, err;
-	u8 dst[ETH_ALEN], src[ETH_ALEN];
+	int offset = 0, remaining, err;
+	struct ethhdr eth;
+	bool reuse_frag = skb_shinfo(skb)->nr_frags &&
+			  !skb_has_frag_list(skb);
+	bool reuse_skb = false;
+	bool last = false;
 
 	if (has_80211_header) {
 		err = ieee80211_data_to_8023(skb, addr, iftype);
@@ -555,51 +671,40 @@ void ieee80211_amsdu_to_8023s(struct sk_buff *skb, struct sk_buff_head *list,
 			goto out;
 
 		/* skip the wrapping header */
-		eth = (struct ethhdr *) skb_pull(skb, sizeof(struct ethhdr));
-		if (!eth)
-			goto out;
-	} else {
-		eth = (struct ethhdr *) skb->data;
+		offset = sizeof(struct ethhdr);
 	}
 
-	while (skb != frame) {
+	while (!last) {
+		unsigned int subframe_len;
+		int len;
 		u8 padding;
-		__be16 len = eth->h_proto;
-		unsigned int subframe_len = sizeof(struct ethhdr) + ntohs(len);
-
-		remaining = skb->len;
-		memcpy(dst, eth->h_dest, ETH_ALEN);
-		memcpy(src, eth->h_source, ETH_ALEN);
 
+		if (skb_copy_bits(skb, offset, &eth, sizeof(eth)))
+			goto purge;
+		len = ntohs(eth.h_proto);
+		subframe_len = sizeof(struct ethhdr) + len;
 		padding = (4 - subframe_len) & 0x3;
+
 		/* the last MSDU has no padding */
+		remaining = skb->len - offset;
 		if (subframe_len > remaining)
 			goto purge;
 
-		skb_pull(skb, sizeof(struct ethhdr));
+		offset += sizeof(struct ethhdr);
+		last = remaining <= subframe_len + padding;
+
 		/* reuse skb for the last subframe */
-		if (remaining <= subframe_len + padding)
+		if (!skb_is_nonlinear(skb) && last) {
+			skb_pull(skb, offset);
 			frame = skb;
-		else {
-			unsigned int hlen = ALIGN(extra_headroom, 4);
-			/*
-			 * Allocate and reserve two bytes more for payload
-			 * alignment since sizeof(struct ethhdr) is 14.
-			 */
-			frame = dev_alloc_skb(hlen + subframe_len + 2);
+			reuse_skb = true;
+		} else {
+			frame = __ieee80211_amsdu_copy(skb, hlen, offset, len,
+						       reuse_frag);
 			if (!frame)
 				goto purge;
 
-			skb_reserve(frame, hlen + sizeof(struct ethhdr) + 2);
-			memcpy(skb_put(frame, ntohs(len)), skb->data,
-				ntohs(len));
-
-			eth = (struct ethhdr *)skb_pull(skb, ntohs(len) +
-							padding);
-			if (!eth) {
-				dev_kfree_skb(frame);
-				goto purge;
-			}
+			offset += len + padding;
 		}
 
 		skb_reset_network_header(frame);
@@ -616,17 +721,24 @@ void ieee80211_amsdu_to_8023s(struct sk_buff *skb, struct sk_buff_head *list,
 			/* remove RFC1042 or Bridge-Tunnel
 			 * encapsulation and replace EtherType */
 			skb_pull(frame, 6);
-			memcpy(skb_push(frame, ETH_ALEN), src, ETH_ALEN);
-			memcpy(skb_push(frame, ETH_ALEN), dst, ETH_ALEN);
+			memcpy(skb_push(frame, ETH_ALEN), eth.h_source,
+			       ETH_ALEN);
+			memcpy(skb_push(frame, ETH_ALEN), eth.h_dest,
+			       ETH_ALEN);
 		} else {
-			memcpy(skb_push(frame, sizeof(__be16)), &len,
+			memcpy(skb_push(frame, sizeof(__be16)), &eth.h_proto,
 				sizeof(__be16));
-			memcpy(skb_push(frame, ETH_ALEN), src, ETH_ALEN);
-			memcpy(skb_push(frame, ETH_ALEN), dst, ETH_ALEN);
+			memcpy(skb_push(frame, ETH_ALEN), eth.h_source,
+			       ETH_ALEN);
+			memcpy(skb_push(frame, ETH_ALEN), eth.h_dest,
+			       ETH_ALEN);
 		}
 		__skb_queue_tail(list, frame);
 	}
 
+	if (!reuse_skb)
+		dev_kfree_skb(skb);
+
 	return;
 
  purge: